@@ -19,6 +19,7 @@
  */
 
 #include "bitstream.h"
+#include "heif_limits.h"
 
 #include <assert.h>
 
@@ -27,6 +28,12 @@
 using namespace heif;
 
 
+const heif_resource_limits& BitstreamRange::get_limits() const
+{
+  return m_limits ? *m_limits : get_default_resource_limits();
+}
+
+
 uint8_t BitstreamRange::read8()
 {
   if (!read(1)) {
@@ -129,6 +129,12 @@ namespace heif {
 
     std::istream* get_istream() { return m_istr; }
 
+    // Limits for the boxes parsed from this range. Ranges of child boxes inherit them
+    // from their parent, the defaults are used if none are set.
+    void set_limits(const heif_resource_limits* limits) { m_limits = limits; }
+
+    const heif_resource_limits& get_limits() const;
+
   protected:
     void construct(std::istream* istr, uint64_t length, BitstreamRange* parent) {
       m_remaining = length;
@@ -136,11 +142,16 @@ namespace heif {
 
       m_istr = istr;
       m_parent_range = parent;
+
+      if (parent) {
+        m_limits = parent->m_limits;
+      }
     }
 
   private:
     std::istream* m_istr = nullptr;
     BitstreamRange* m_parent_range = nullptr;
+    const heif_resource_limits* m_limits = nullptr;
 
     uint64_t m_remaining;
     bool m_end_reached = false;
@@ -167,6 +178,9 @@ namespace heif {
       return data_length - bytes_remaining - nextbits_cnt/8;
     }
 
+    // Whether more bits were read than the buffer holds. The missing bits are read as zeros.
+    bool overrun() const { return nextbits_cnt < 0; }
+
   private:
     const uint8_t* data;
     int data_length;
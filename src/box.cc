@@ -19,6 +19,7 @@
  */
 
 #include "box.h"
+#include "heif_limits.h"
 
 #include <sstream>
 #include <iomanip>
@@ -29,11 +30,6 @@
 
 using namespace heif;
 
-static const size_t MAX_CHILDREN_PER_BOX = 1024;
-static const int MAX_ILOC_ITEMS = 1024;
-static const int MAX_ILOC_EXTENTS_PER_ITEM = 32;
-static const int MAX_MEMORY_BLOCK_SIZE = 50*1024*1024; // 50 MB
-
 heif::Error heif::Error::Ok(heif_error_Ok);
 
 
@@ -299,6 +295,10 @@ Error Box::read(BitstreamRange& range, std::shared_ptr<heif::Box>* result)
     box = std::make_shared<Box_clap>(hdr);
     break;
 
+  case fourcc("colr"):
+    box = std::make_shared<Box_colr>(hdr);
+    break;
+
   case fourcc("iref"):
     box = std::make_shared<Box_iref>(hdr);
     break;
@@ -404,14 +404,10 @@ Error Box::read_children(BitstreamRange& range, int max_number)
       return error;
     }
 
-    if (m_children.size() > MAX_CHILDREN_PER_BOX) {
-      std::stringstream sstr;
-      sstr << "Maximum number of child boxes " << MAX_CHILDREN_PER_BOX << " exceeded.";
-
+    uint32_t max_children = range.get_limits().max_children_per_box;
+    if (max_children && m_children.size() >= max_children) {
       // Sanity check.
-      return Error(heif_error_Memory_allocation_error,
-                   heif_suberror_Security_limit_exceeded,
-                   sstr.str());
+      return limit_exceeded_error("Number of child boxes", m_children.size() + 1, max_children);
     }
 
     m_children.push_back(std::move(box));
@@ -573,7 +569,7 @@ bool Box_meta::get_images(std::istream& istr, std::vector<std::vector<uint8_t>>*
     if (!hvcC->get_headers(&data)) {
       return false;
     }
-    if (!iloc->read_data(iloc_items[i], istr, &data)) {
+    if (!iloc->read_data(iloc_items[i], istr, &data, get_default_resource_limits().max_item_data_size)) {
       return false;
     }
 
@@ -669,14 +665,9 @@ Error Box_iloc::parse(BitstreamRange& range)
   }
 
   // Sanity check.
-  if (item_count > MAX_ILOC_ITEMS) {
-    std::stringstream sstr;
-    sstr << "iloc box contains " << item_count << " items, which exceeds the security limit of "
-         << MAX_ILOC_ITEMS << " items.";
-
-    return Error(heif_error_Memory_allocation_error,
-                 heif_suberror_Security_limit_exceeded,
-                 sstr.str());
+  uint32_t max_items = range.get_limits().max_items;
+  if (max_items && (uint32_t)item_count > max_items) {
+    return limit_exceeded_error("Number of items in iloc box", (uint32_t)item_count, max_items);
   }
 
   for (int i=0;i<item_count;i++) {
@@ -707,14 +698,9 @@ Error Box_iloc::parse(BitstreamRange& range)
 
     int extent_count = range.read16();
     // Sanity check.
-    if (extent_count > MAX_ILOC_EXTENTS_PER_ITEM) {
-      std::stringstream sstr;
-      sstr << "Number of extents in iloc box (" << extent_count << ") exceeds security limit ("
-           << MAX_ILOC_EXTENTS_PER_ITEM << ")\n";
-
-      return Error(heif_error_Memory_allocation_error,
-                   heif_suberror_Security_limit_exceeded,
-                   sstr.str());
+    uint32_t max_extents = range.get_limits().max_extents_per_item;
+    if (max_extents && (uint32_t)extent_count > max_extents) {
+      return limit_exceeded_error("Number of extents in iloc box", extent_count, max_extents);
     }
 
     for (int e=0;e<extent_count;e++) {
@@ -792,10 +778,22 @@ std::string Box_iloc::dump(Indent& indent) const
 
 Error Box_iloc::read_data(const Item& item, std::istream& istr,
                           const std::shared_ptr<Box_idat>& idat,
-                          std::vector<uint8_t>* dest) const
+                          std::vector<uint8_t>* dest, uint64_t max_size) const
 {
   istr.clear();
 
+  // all extent sizes are known, grow the buffer only once
+  uint64_t total = 0;
+  for (const auto& extent : item.extents) {
+    total += extent.length;
+  }
+
+  if (max_size && (dest->size() > max_size || max_size - dest->size() < total)) {
+    return limit_exceeded_error("Size of item data", dest->size() + total, max_size);
+  }
+
+  dest->reserve(static_cast<size_t>(dest->size() + total));
+
   for (const auto& extent : item.extents) {
     if (item.construction_method == 0) {
       istr.seekg(extent.offset + item.base_offset, std::ios::beg);
@@ -813,36 +811,13 @@ Error Box_iloc::read_data(const Item& item, std::istream& istr,
       }
 
       size_t old_size = dest->size();
-      if (MAX_MEMORY_BLOCK_SIZE - old_size < extent.length) {
-        std::stringstream sstr;
-        sstr << "iloc box contained " << extent.length << " bytes, total memory size would be "
-             << (old_size + extent.length) << " bytes, exceeding the security limit of "
-             << MAX_MEMORY_BLOCK_SIZE << " bytes";
-
-        return Error(heif_error_Memory_allocation_error,
-                     heif_suberror_Security_limit_exceeded,
-                     sstr.str());
+      if (max_size && (old_size > max_size || max_size - old_size < extent.length)) {
+        return limit_exceeded_error("Size of item data", old_size + extent.length, max_size);
       }
 
       dest->resize(static_cast<size_t>(old_size + extent.length));
       istr.read((char*)dest->data() + old_size, static_cast<size_t>(extent.length));
 
-#if 1
-  //printf("----------------------------\n");
-  uint8_t *p = (uint8_t*)dest->data() + old_size;
-  // change frame length to 0x0000001
-  *(p) = 0x00;
-  *(p+1) = 0x00;
-  *(p+2) = 0x00;
-  *(p+3) = 0x01;
-  //for(int m = 0; m < (int)extent.length; m++) {
-  //  printf("%02X ", *(p+m));
-  //}
-  //printf("---------------------------\n");
-
-
-#endif
-
       if (istr.eof()) {
           return Error(heif_error_Invalid_input,
                        heif_suberror_End_of_data);
@@ -855,10 +830,13 @@ Error Box_iloc::read_data(const Item& item, std::istream& istr,
                      "idat box referenced in iref box is not present in file");
       }
 
-      idat->read_data(istr,
-                      extent.offset + item.base_offset,
-                      extent.length,
-                      *dest);
+      Error err = idat->read_data(istr,
+                                  extent.offset + item.base_offset,
+                                  extent.length,
+                                  *dest, max_size);
+      if (err) {
+        return err;
+      }
     }
   }
 
@@ -945,6 +923,11 @@ Error Box_iinf::parse(BitstreamRange& range)
     return Error::Ok;
   }
 
+  uint32_t max_items = range.get_limits().max_items;
+  if (max_items && (uint32_t)item_count > max_items) {
+    return limit_exceeded_error("Number of items in iinf box", (uint32_t)item_count, max_items);
+  }
+
   // TODO: Only try to read "item_count" children.
   return read_children(range);
 }
@@ -1308,6 +1291,62 @@ int Box_clap::get_height_rounded() const
 
 
 
+Error Box_colr::parse(BitstreamRange& range)
+{
+  m_colour_type = range.read32();
+
+  if (m_colour_type == fourcc("nclx")) {
+    m_colour_primaries = range.read16();
+    m_transfer_characteristics = range.read16();
+    m_matrix_coefficients = range.read16();
+    m_full_range_flag = (range.read8() & 0x80) != 0;
+  }
+  else if (is_icc_profile()) {
+    uint64_t header_size = get_header_size() + 4;
+    if (get_box_size() <= header_size) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_End_of_data,
+                   "Empty ICC profile in 'colr' box");
+    }
+
+    uint64_t profile_size = get_box_size() - header_size;
+
+    const heif_resource_limits& limits = range.get_limits();
+    if (limits.max_item_data_size && profile_size > limits.max_item_data_size) {
+      return limit_exceeded_error("Size of ICC profile", profile_size, limits.max_item_data_size);
+    }
+
+    if (range.read(profile_size)) {
+      m_icc_profile.resize(static_cast<size_t>(profile_size));
+      range.get_istream()->read((char*)m_icc_profile.data(), profile_size);
+    }
+  }
+
+  return range.get_error();
+}
+
+
+std::string Box_colr::dump(Indent& indent) const
+{
+  std::ostringstream sstr;
+  sstr << Box::dump(indent);
+
+  sstr << indent << "colour type: " << to_fourcc(m_colour_type) << "\n";
+
+  if (m_colour_type == fourcc("nclx")) {
+    sstr << indent << "colour primaries: " << m_colour_primaries << "\n"
+         << indent << "transfer characteristics: " << m_transfer_characteristics << "\n"
+         << indent << "matrix coefficients: " << m_matrix_coefficients << "\n"
+         << indent << "full range: " << m_full_range_flag << "\n";
+  }
+  else if (is_icc_profile()) {
+    sstr << indent << "ICC profile size: " << m_icc_profile.size() << "\n";
+  }
+
+  return sstr.str();
+}
+
+
 Error Box_iref::parse(BitstreamRange& range)
 {
   parse_full_box_header(range);
@@ -1544,20 +1583,20 @@ std::string Box_hvcC::dump(Indent& indent) const
 
 bool Box_hvcC::get_headers(std::vector<uint8_t>* dest) const
 {
+  // Headers are written with the same NAL length prefix as the image data,
+  // so that the decoder can walk the whole stream with a single length size.
+
   for (const auto& array : m_nal_array) {
     for (const auto& unit : array.m_nal_units) {
-      //std::cout << "unit size: " << unit.size() << std::endl;
-#if 0	// change data lenght to 0x00000001 for ES
-      dest->push_back( (unit.size()>>24) & 0xFF );
-      dest->push_back( (unit.size()>>16) & 0xFF );
-      dest->push_back( (unit.size()>> 8) & 0xFF );
-      dest->push_back( (unit.size()>> 0) & 0xFF );
-#else
-      dest->push_back(0);
-      dest->push_back(0);
-      dest->push_back(0);
-      dest->push_back(1);
-#endif
+      if (m_length_size < 4 &&
+          (unit.size() >> (8*m_length_size)) != 0) {
+        // NAL unit does not fit into the length field
+        return false;
+      }
+
+      for (int i=m_length_size-1;i>=0;i--) {
+        dest->push_back( (unit.size()>>(8*i)) & 0xFF );
+      }
 
       dest->insert(dest->end(), unit.begin(), unit.end());
     }
@@ -1589,7 +1628,7 @@ std::string Box_idat::dump(Indent& indent) const
 
 
 Error Box_idat::read_data(std::istream& istr, uint64_t start, uint64_t length,
-                          std::vector<uint8_t>& out_data) const
+                          std::vector<uint8_t>& out_data, uint64_t max_size) const
 {
   // move to start of data
   istr.seekg(m_data_start_pos + (std::streampos)start, std::ios_base::beg);
@@ -1597,15 +1636,8 @@ Error Box_idat::read_data(std::istream& istr, uint64_t start, uint64_t length,
   // reserve space for the data in the output array
   auto curr_size = out_data.size();
 
-  if (MAX_MEMORY_BLOCK_SIZE - curr_size < length) {
-    std::stringstream sstr;
-    sstr << "idat box contained " << length << " bytes, total memory size would be "
-         << (curr_size + length) << " bytes, exceeding the security limit of "
-         << MAX_MEMORY_BLOCK_SIZE << " bytes";
-
-    return Error(heif_error_Memory_allocation_error,
-                 heif_suberror_Security_limit_exceeded,
-                 sstr.str());
+  if (max_size && (curr_size > max_size || max_size - curr_size < length)) {
+    return limit_exceeded_error("Size of item data", curr_size + length, max_size);
   }
 
   out_data.resize(static_cast<size_t>(curr_size + length));
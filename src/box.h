@@ -229,9 +229,11 @@ namespace heif {
 
     const std::vector<Item>& get_items() const { return m_items; }
 
+    // Append the data of 'item' to 'dest'. Fails if 'dest' would grow beyond 'max_size'
+    // bytes (0: no limit).
     Error read_data(const Item& item, std::istream& istr,
                     const std::shared_ptr<class Box_idat>&,
-                    std::vector<uint8_t>* dest) const;
+                    std::vector<uint8_t>* dest, uint64_t max_size) const;
     //Error read_all_data(std::istream& istr, std::vector<uint8_t>* dest) const;
 
   protected:
@@ -441,6 +443,44 @@ namespace heif {
   };
 
 
+  class Box_colr : public Box {
+  public:
+  Box_colr(const BoxHeader& hdr) : Box(hdr) { }
+
+    std::string dump(Indent&) const override;
+
+    // 'nclx', 'rICC' (restricted ICC profile) or 'prof' (unrestricted ICC profile).
+    // Boxes with other colour types are kept, but carry no data.
+    uint32_t get_colour_type() const { return m_colour_type; }
+
+    bool is_icc_profile() const { return m_colour_type == fourcc("rICC") || m_colour_type == fourcc("prof"); }
+
+    // --- 'nclx', ISO/IEC 23091-2 codes
+
+    uint16_t get_colour_primaries() const { return m_colour_primaries; }
+    uint16_t get_transfer_characteristics() const { return m_transfer_characteristics; }
+    uint16_t get_matrix_coefficients() const { return m_matrix_coefficients; }
+    bool get_full_range_flag() const { return m_full_range_flag; }
+
+    // --- 'rICC' and 'prof'
+
+    const std::vector<uint8_t>& get_icc_profile() const { return m_icc_profile; }
+
+  protected:
+    Error parse(BitstreamRange& range) override;
+
+  private:
+    uint32_t m_colour_type = 0;
+
+    uint16_t m_colour_primaries = 2;
+    uint16_t m_transfer_characteristics = 2;
+    uint16_t m_matrix_coefficients = 2;
+    bool m_full_range_flag = false;
+
+    std::vector<uint8_t> m_icc_profile;
+  };
+
+
   class Box_iref : public Box {
   public:
   Box_iref(const BoxHeader& hdr) : Box(hdr) { }
@@ -478,6 +518,9 @@ namespace heif {
 
     bool get_headers(std::vector<uint8_t>* dest) const;
 
+    // number of bytes of the NAL size prefix in front of each NAL unit
+    int get_length_size() const { return m_length_size; }
+
   protected:
     Error parse(BitstreamRange& range) override;
 
@@ -525,7 +568,10 @@ namespace heif {
     std::string dump(Indent&) const override;
 
     Error read_data(std::istream& istr, uint64_t start, uint64_t length,
-                    std::vector<uint8_t>& out_data) const;
+                    std::vector<uint8_t>& out_data, uint64_t max_size) const;
+
+    // file position of the first data byte
+    uint64_t get_data_start_pos() const { return static_cast<uint64_t>(std::streamoff(m_data_start_pos)); }
 
   protected:
     Error parse(BitstreamRange& range) override;
@@ -55,6 +55,7 @@ const char* heif::Error::get_error_string(heif_error_code err)
   case heif_error_Usage_error: return "Usage error";
   case heif_error_Memory_allocation_error: return "Memory allocation error";
   case heif_error_Decoder_plugin_error: return "Decoder plugin generated an error";
+  case heif_error_Encoding_error: return "Error while writing output data";
   }
 
   assert(false);
@@ -94,6 +95,7 @@ const char* heif::Error::get_error_string(heif_suberror_code err)
   case heif_suberror_Overlay_image_outside_of_canvas: return "Overlay image outside of canvas area";
   case heif_suberror_Auxiliary_image_type_unspecified: return "Type of auxiliary image unspecified";
   case heif_suberror_No_or_invalid_primary_image: return "No or invalid primary image";
+  case heif_suberror_Invalid_parameter_set: return "Invalid HEVC parameter set";
 
     // --- Memory_allocation_error ---
 
@@ -113,6 +115,10 @@ const char* heif::Error::get_error_string(heif_suberror_code err)
   case heif_suberror_Unsupported_image_type: return "Unsupported image type";
   case heif_suberror_Unsupported_data_version: return "Unsupported data version";
   case heif_suberror_Unsupported_color_conversion: return "Unsupported color conversion";
+
+    // --- Encoding_error ---
+
+  case heif_suberror_Cannot_write_output_data: return "Cannot write output data";
   }
 
   assert(false);
@@ -19,7 +19,15 @@
  */
 
 #include "heif.h"
+#include "heif_async.h"
+#include "heif_colormanagement.h"
 #include "heif_context.h"
+#include "heif_exif.h"
+#include "heif_hevc.h"
+#include "heif_limits.h"
+#include "heif_plugin_registry.h"
+#include "heif_push_parser.h"
+#include "heif_threads.h"
 #include "error.h"
 
 #include <memory>
@@ -34,6 +42,9 @@ using namespace heif;
 struct heif_context
 {
   std::shared_ptr<heif::HeifContext> context;
+
+  // completions of asynchronous decodes, shared with the running tasks
+  std::shared_ptr<heif::CompletionQueue> completions;
 };
 
 struct heif_image_handle
@@ -70,6 +81,7 @@ heif_handle heif_hendle_alloc(void)
 {
   struct heif_context* ctx = new heif_context;
   ctx->context = std::make_shared<HeifContext>();
+  ctx->completions = std::make_shared<CompletionQueue>();
 
   return ctx;
 }
@@ -93,6 +105,23 @@ struct heif_error heif_read_from_file(heif_handle h, const char* filename)
   return err.error_struct(ctx->context.get());
 }
 
+LIBHEIF_API
+struct heif_error heif_read_from_file_with_index(heif_handle h, const char* filename,
+                                                 const char* index_filename)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  std::string default_index_filename;
+  if (index_filename == nullptr) {
+    default_index_filename = std::string(filename) + ".hidx";
+    index_filename = default_index_filename.c_str();
+  }
+
+  Error err = ctx->context->read_from_file_with_index(filename, index_filename);
+
+  return err.error_struct(ctx->context.get());
+}
+
 // Read a HEIF file stored completely in memory.
 LIBHEIF_API
 struct heif_error heif_read_from_memory(heif_handle h, const void* mem, size_t size)
@@ -105,6 +134,17 @@ struct heif_error heif_read_from_memory(heif_handle h, const void* mem, size_t s
 
 }
 
+LIBHEIF_API
+struct heif_error heif_write_fast_start_file(heif_handle h, const char* output_filename,
+                                             int decoding_order)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  Error err = ctx->context->write_fast_start_file(output_filename, decoding_order != 0);
+
+  return err.error_struct(ctx->context.get());
+}
+
 // Get a handle to the primary image of the HEIF file.
 // This is the image that should be displayed primarily when there are several images in the file.
 LIBHEIF_API
@@ -128,16 +168,831 @@ int heif_get_number_of_images(heif_handle h)
 }
 
 
+LIBHEIF_API
+int heif_image_has_alpha_channel(heif_handle h, int image_idx)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  auto images = ctx->context->get_top_level_images();
+  if (image_idx < 0 || image_idx >= (int)images.size()) {
+    return 0;
+  }
+
+  return images[image_idx]->get_alpha_channel() ? 1 : 0;
+}
+
+
 LIBHEIF_API
 heif_error heif_get_image_data(heif_handle h, int image_idx, heif_image* out_data)
 {
   struct heif_context* ctx = (struct heif_context*)h;
 
 
-  ctx->context->get_heif_image_data(ctx->context->image_index_to_id(image_idx), out_data);
+  Error err = ctx->context->get_heif_image_data(ctx->context->image_index_to_id(image_idx), out_data);
+
+  return err.error_struct(ctx->context.get());
+}
+
+
+static void set_default_decoding_options(struct heif_decoding_options* options)
+{
+  options->version = 8;
+
+  options->bypass_image_cache = false;
+
+  options->progress_callback = nullptr;
+  options->progress_user_data = nullptr;
+  options->progress_granularity = heif_progress_granularity_tile;
+
+  options->ignore_transformations = false;
+
+  options->output_chroma = heif_chroma_undefined;
+  options->premultiply_alpha = false;
+
+  options->decoder_plugin = nullptr;
+
+  options->scale_denominator = 1;
+
+  options->plane_alignment = 0;
+  options->row_padding = 0;
+
+  options->convert_to_srgb = false;
+}
+
+
+LIBHEIF_API
+struct heif_decoding_options* heif_decoding_options_alloc(void)
+{
+  struct heif_decoding_options* options = new heif_decoding_options;
+
+  set_default_decoding_options(options);
+
+  return options;
+}
+
+
+LIBHEIF_API
+void heif_decoding_options_free(struct heif_decoding_options* options)
+{
+  delete options;
+}
+
+
+// Copy the fields known to the options version the caller was compiled with,
+// leave the others at their default values.
+static void normalize_decoding_options(const struct heif_decoding_options* options,
+                                       struct heif_decoding_options* out)
+{
+  set_default_decoding_options(out);
+
+  if (options == nullptr) {
+    return;
+  }
+
+  if (options->version >= 1) {
+    out->bypass_image_cache = options->bypass_image_cache;
+  }
+
+  if (options->version >= 2) {
+    out->progress_callback = options->progress_callback;
+    out->progress_user_data = options->progress_user_data;
+    out->progress_granularity = options->progress_granularity;
+  }
+
+  if (options->version >= 3) {
+    out->ignore_transformations = options->ignore_transformations;
+  }
+
+  if (options->version >= 4) {
+    out->output_chroma = options->output_chroma;
+    out->premultiply_alpha = options->premultiply_alpha;
+  }
+
+  if (options->version >= 5) {
+    out->decoder_plugin = options->decoder_plugin;
+  }
+
+  if (options->version >= 6) {
+    out->scale_denominator = options->scale_denominator;
+  }
+
+  if (options->version >= 7) {
+    out->plane_alignment = options->plane_alignment;
+    out->row_padding = options->row_padding;
+  }
+
+  if (options->version >= 8) {
+    out->convert_to_srgb = options->convert_to_srgb;
+  }
+}
+
+
+LIBHEIF_API
+struct heif_error heif_decode_image(heif_handle h, int image_idx,
+                                    const struct heif_decoding_options* options,
+                                    heif_image* out_data)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (out_data == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  heif_image_id ID = ctx->context->image_index_to_id(image_idx);
+  if (ID == INVALID_IMAGE_ID) {
+    Error err(heif_error_Usage_error, heif_suberror_Nonexisting_image_referenced);
+    return err.error_struct(ctx->context.get());
+  }
+
+  struct heif_decoding_options opts;
+  normalize_decoding_options(options, &opts);
+
+  std::shared_ptr<const HeifPixelImage> img;
+  Error err = ctx->context->decode_image(ID, opts, &img);
+  if (err) {
+    return err.error_struct(ctx->context.get());
+  }
+
+  err = ctx->context->attach_decoded_image(out_data, img);
+  return err.error_struct(ctx->context.get());
+}
+
+
+// --- depth maps
+
+LIBHEIF_API
+int heif_image_has_depth_channel(heif_handle h, int image_idx)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  auto images = ctx->context->get_top_level_images();
+  if (image_idx < 0 || image_idx >= (int)images.size()) {
+    return 0;
+  }
+
+  return images[image_idx]->get_depth_channel() ? 1 : 0;
+}
+
+
+LIBHEIF_API
+struct heif_error heif_get_depth_representation_info(heif_handle h, int image_idx,
+                                                     struct heif_depth_representation_info* out_info)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  auto images = ctx->context->get_top_level_images();
+  if (image_idx < 0 || image_idx >= (int)images.size() || out_info == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  auto depth = images[image_idx]->get_depth_channel();
+  if (!depth || !depth->has_depth_representation_info()) {
+    Error err(heif_error_Usage_error, heif_suberror_Nonexisting_image_referenced,
+              "Image has no depth representation info");
+    return err.error_struct(ctx->context.get());
+  }
+
+  *out_info = depth->get_depth_representation_info();
 
   return Error::Ok.error_struct(ctx->context.get());
-  
+}
+
+
+LIBHEIF_API
+struct heif_error heif_decode_depth_map(heif_handle h, int image_idx,
+                                        enum heif_depth_format format,
+                                        struct heif_depth_map* out_map)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (out_map == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  memset(out_map, 0, sizeof(*out_map));
+
+  heif_decoding_options opts;
+  normalize_decoding_options(nullptr, &opts);
+
+  heif_image_id ID = ctx->context->image_index_to_id(image_idx);
+
+  Error err = ctx->context->decode_depth_map(ID, opts, format, out_map);
+  return err.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+void heif_depth_map_release(struct heif_depth_map* map)
+{
+  if (map) {
+    delete static_cast<DepthMapBuffer*>(map->buffer);
+    map->buffer = nullptr;
+    map->data = nullptr;
+  }
+}
+
+
+// --- Exif metadata
+
+LIBHEIF_API
+struct heif_error heif_get_exif_data(heif_handle h, int image_idx,
+                                     const uint8_t** out_data, size_t* out_size)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (out_data == nullptr || out_size == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  auto exif = ctx->context->get_exif_metadata(ctx->context->image_index_to_id(image_idx));
+  if (!exif) {
+    Error err(heif_error_Usage_error, heif_suberror_Nonexisting_image_referenced,
+              "Image has no Exif data");
+    return err.error_struct(ctx->context.get());
+  }
+
+  Error err = ctx->context->get_metadata_data(exif, out_data, out_size);
+  return err.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+struct heif_error heif_get_exif_info(heif_handle h, int image_idx,
+                                     struct heif_exif_info* out_info)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (out_info == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  memset(out_info, 0, sizeof(*out_info));
+
+  const uint8_t* data;
+  size_t size;
+  heif_error result = heif_get_exif_data(h, image_idx, &data, &size);
+  if (result.code) {
+    return result;
+  }
+
+  ExifInfo info;
+  Error err = parse_exif_item(data, size, &info);
+  if (err) {
+    return err.error_struct(ctx->context.get());
+  }
+
+  out_info->has_orientation = info.has_orientation;
+  out_info->orientation = info.orientation;
+
+  out_info->has_capture_time = info.has_capture_time;
+  strncpy(out_info->capture_time, info.capture_time.c_str(), sizeof(out_info->capture_time) - 1);
+
+  out_info->has_dimensions = info.has_dimensions;
+  out_info->width = info.width;
+  out_info->height = info.height;
+
+  return Error::Ok.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+struct heif_error heif_get_hevc_info(heif_handle h, int image_idx,
+                                     struct heif_hevc_info* out_info)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (out_info == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  memset(out_info, 0, sizeof(*out_info));
+
+  const HEVCStreamInfo* info = ctx->context->get_hevc_info(ctx->context->image_index_to_id(image_idx));
+  if (!info) {
+    Error err(heif_error_Invalid_input, heif_suberror_No_hvcC_box,
+              "Image has no readable HEVC parameter sets");
+    return err.error_struct(ctx->context.get());
+  }
+
+  out_info->profile_idc = info->general_profile_idc;
+  out_info->level_idc = info->general_level_idc;
+  out_info->tier = info->general_tier_flag;
+
+  out_info->chroma = info->get_chroma();
+  out_info->bit_depth_luma = info->bit_depth_luma;
+  out_info->bit_depth_chroma = info->bit_depth_chroma;
+
+  out_info->coded_width = info->coded_width;
+  out_info->coded_height = info->coded_height;
+  out_info->crop_left = info->conf_win_left;
+  out_info->crop_right = info->conf_win_right;
+  out_info->crop_top = info->conf_win_top;
+  out_info->crop_bottom = info->conf_win_bottom;
+
+  out_info->ctb_size = 1 << info->log2_ctb_size;
+
+  out_info->has_colour_description = info->has_colour_description;
+  out_info->colour_primaries = info->colour_primaries;
+  out_info->transfer_characteristics = info->transfer_characteristics;
+  out_info->matrix_coefficients = info->matrix_coefficients;
+  out_info->full_range = info->full_range;
+
+  out_info->tile_columns = info->num_tile_columns;
+  out_info->tile_rows = info->num_tile_rows;
+  out_info->uniform_tile_spacing = info->uniform_tile_spacing;
+  out_info->wavefront_parallel_processing = info->entropy_coding_sync;
+
+  return Error::Ok.error_struct(ctx->context.get());
+}
+
+
+// --- colour information
+
+LIBHEIF_API
+struct heif_error heif_get_nclx_info(heif_handle h, int image_idx,
+                                     struct heif_nclx_info* out_info)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (out_info == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  heif_image_id ID = ctx->context->image_index_to_id(image_idx);
+  if (ID == INVALID_IMAGE_ID) {
+    Error err(heif_error_Usage_error, heif_suberror_Nonexisting_image_referenced);
+    return err.error_struct(ctx->context.get());
+  }
+
+  HeifContext::NclxColour colour = ctx->context->get_nclx_colour(ID);
+
+  out_info->source = colour.source;
+  out_info->colour_primaries = colour.colour_primaries;
+  out_info->transfer_characteristics = colour.transfer_characteristics;
+  out_info->matrix_coefficients = colour.matrix_coefficients;
+  out_info->full_range = colour.full_range;
+
+  return Error::Ok.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+struct heif_error heif_get_icc_profile(heif_handle h, int image_idx,
+                                       const uint8_t** out_data, size_t* out_size)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (out_data == nullptr || out_size == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  const std::vector<uint8_t>* profile =
+    ctx->context->get_icc_profile(ctx->context->image_index_to_id(image_idx));
+  if (!profile) {
+    Error err(heif_error_Usage_error, heif_suberror_Nonexisting_image_referenced,
+              "Image has no ICC profile");
+    return err.error_struct(ctx->context.get());
+  }
+
+  *out_data = profile->data();
+  *out_size = profile->size();
+  return Error::Ok.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+struct heif_error heif_decode_async(heif_handle h, int image_idx,
+                                    const struct heif_decoding_options* options,
+                                    heif_decode_callback callback, void* user_data)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (callback == nullptr) {
+    Error err(heif_error_Usage_error, heif_suberror_Null_pointer_argument);
+    return err.error_struct(ctx->context.get());
+  }
+
+  heif_image_id ID = ctx->context->image_index_to_id(image_idx);
+  if (ID == INVALID_IMAGE_ID) {
+    Error err(heif_error_Usage_error, heif_suberror_Nonexisting_image_referenced);
+    return err.error_struct(ctx->context.get());
+  }
+
+  struct heif_decoding_options opts;
+  normalize_decoding_options(options, &opts);
+
+  // The task keeps the context and the queue alive. If the handle is freed before
+  // the decode finished, the completion is never dispatched and simply dropped.
+  std::shared_ptr<HeifContext> context = ctx->context;
+  std::shared_ptr<CompletionQueue> completions = ctx->completions;
+
+  ThreadPool::get_instance().add_task([=]() {
+      std::shared_ptr<const HeifPixelImage> img;
+      Error decode_err = context->decode_image(ID, opts, &img);
+
+      completions->post([=]() {
+          Error err = decode_err;
+
+          heif_image* out_data = nullptr;
+          if (!err) {
+            out_data = context->create_heif_image_buffer();
+            err = context->attach_decoded_image(out_data, img);
+            if (err) {
+              context->destory_heif_image_buffer(out_data);
+              out_data = nullptr;
+            }
+          }
+
+          // holds the error message during the callback
+          ErrorBuffer error_buffer;
+
+          callback(h, image_idx, err.error_struct(&error_buffer), out_data, user_data);
+        });
+    });
+
+  return Error::Ok.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+int heif_get_completion_fd(heif_handle h)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  return ctx->completions->get_fd();
+}
+
+
+LIBHEIF_API
+int heif_dispatch_completions(heif_handle h)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  return ctx->completions->dispatch();
+}
+
+
+struct heif_push_parser
+{
+  heif::HeifPushParser parser;
+};
+
+
+LIBHEIF_API
+struct heif_push_parser* heif_push_parser_alloc(void)
+{
+  return new heif_push_parser;
+}
+
+
+LIBHEIF_API
+void heif_push_parser_free(struct heif_push_parser* parser)
+{
+  delete parser;
+}
+
+
+LIBHEIF_API
+struct heif_error heif_push_parser_push_data(struct heif_push_parser* parser,
+                                             const void* data, size_t size)
+{
+  Error err = parser->parser.push_data(static_cast<const uint8_t*>(data), size);
+  return err.error_struct(&parser->parser);
+}
+
+
+LIBHEIF_API
+struct heif_error heif_push_parser_push_data_at(struct heif_push_parser* parser, uint64_t offset,
+                                                const void* data, size_t size)
+{
+  Error err = parser->parser.push_data_at(offset, static_cast<const uint8_t*>(data), size);
+  return err.error_struct(&parser->parser);
+}
+
+
+static void copy_byte_ranges(const std::vector<heif_byte_range>& ranges,
+                             struct heif_byte_range* out_ranges, int max_ranges,
+                             int* out_num_ranges)
+{
+  for (size_t i = 0; i < ranges.size() && (int)i < max_ranges; i++) {
+    out_ranges[i] = ranges[i];
+  }
+
+  if (out_num_ranges) {
+    *out_num_ranges = (int)ranges.size();
+  }
+}
+
+
+LIBHEIF_API
+void heif_push_parser_get_fetch_ranges(const struct heif_push_parser* parser,
+                                       struct heif_byte_range* out_ranges, int max_ranges,
+                                       int* out_num_ranges)
+{
+  std::vector<heif_byte_range> ranges;
+  parser->parser.get_fetch_ranges(&ranges);
+
+  copy_byte_ranges(ranges, out_ranges, max_ranges, out_num_ranges);
+}
+
+
+LIBHEIF_API
+void heif_push_parser_end_of_data(struct heif_push_parser* parser)
+{
+  parser->parser.set_end_of_data();
+}
+
+
+LIBHEIF_API
+int heif_push_parser_has_ftyp(const struct heif_push_parser* parser)
+{
+  return parser->parser.has_ftyp() ? 1 : 0;
+}
+
+
+LIBHEIF_API
+int heif_push_parser_has_meta(const struct heif_push_parser* parser)
+{
+  return parser->parser.has_meta() ? 1 : 0;
+}
+
+
+LIBHEIF_API
+struct heif_error heif_read_from_push_parser(heif_handle h, struct heif_push_parser* parser)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  Error err = ctx->context->read_from_push_parser(parser->parser);
+
+  return err.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+int heif_image_data_available(heif_handle h, int image_idx)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  heif_image_id ID = ctx->context->image_index_to_id(image_idx);
+  if (ID == INVALID_IMAGE_ID) {
+    return 0;
+  }
+
+  return ctx->context->is_image_data_available(ID) ? 1 : 0;
+}
+
+
+LIBHEIF_API
+int heif_thumbnail_data_available(heif_handle h, int image_idx)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  auto images = ctx->context->get_top_level_images();
+  if (image_idx < 0 || image_idx >= (int)images.size()) {
+    return 0;
+  }
+
+  auto thumbnails = images[image_idx]->get_thumbnails();
+  if (thumbnails.empty()) {
+    return 0;
+  }
+
+  return ctx->context->is_image_data_available(thumbnails[0]->get_id()) ? 1 : 0;
+}
+
+
+LIBHEIF_API
+int heif_get_available_tile_rows(heif_handle h, int image_idx)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  heif_image_id ID = ctx->context->image_index_to_id(image_idx);
+  if (ID == INVALID_IMAGE_ID) {
+    return 0;
+  }
+
+  return ctx->context->get_available_tile_rows(ID);
+}
+
+
+LIBHEIF_API
+struct heif_error heif_get_fetch_ranges(heif_handle h, int image_idx,
+                                        enum heif_fetch_target target,
+                                        const struct heif_fetch_region* region,
+                                        uint64_t merge_gap,
+                                        struct heif_byte_range* out_ranges, int max_ranges,
+                                        int* out_num_ranges)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  heif_image_id ID = INVALID_IMAGE_ID;
+  if (target != heif_fetch_target_probe) {
+    ID = ctx->context->image_index_to_id(image_idx);
+    if (ID == INVALID_IMAGE_ID) {
+      Error err(heif_error_Usage_error, heif_suberror_Nonexisting_image_referenced);
+      return err.error_struct(ctx->context.get());
+    }
+  }
+
+  std::vector<heif_byte_range> ranges;
+  Error err = ctx->context->get_fetch_ranges(ID, target, region, merge_gap, &ranges);
+  if (err) {
+    return err.error_struct(ctx->context.get());
+  }
+
+  copy_byte_ranges(ranges, out_ranges, max_ranges, out_num_ranges);
+
+  return Error::Ok.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+void heif_get_default_resource_limits(struct heif_resource_limits* limits)
+{
+  *limits = get_default_resource_limits();
+}
+
+
+LIBHEIF_API
+struct heif_error heif_set_resource_limits(heif_handle h, const struct heif_resource_limits* limits)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (!limits || limits->version < 1) {
+    Error err(heif_error_Usage_error, heif_suberror_Unsupported_data_version,
+              "Resource limits have to be initialized with heif_get_default_resource_limits()");
+    return err.error_struct(ctx->context.get());
+  }
+
+  ctx->context->set_limits(*limits);
+
+  return Error::Ok.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+void heif_get_resource_limits(heif_handle h, struct heif_resource_limits* limits)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  *limits = ctx->context->get_limits();
+}
+
+
+LIBHEIF_API
+void heif_get_memory_usage(heif_handle h, struct heif_memory_usage* usage)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  const MemoryAccount& account = *ctx->context->get_memory_account();
+  usage->current_bytes = account.get_current();
+  usage->peak_bytes = account.get_peak();
+  usage->rejected_allocations = account.get_rejected();
+}
+
+
+LIBHEIF_API
+void heif_reset_peak_memory_usage(heif_handle h)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  ctx->context->get_memory_account()->reset_peak();
+}
+
+
+LIBHEIF_API
+struct heif_error heif_set_allocator(heif_handle h, const struct heif_allocator* allocator)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  if (allocator && (!allocator->alloc || !allocator->free)) {
+    Error err(heif_error_Usage_error, heif_suberror_Unspecified,
+              "The allocator needs alloc() and free()");
+    return err.error_struct(ctx->context.get());
+  }
+
+  std::shared_ptr<const Allocator> hooks;
+  if (allocator) {
+    hooks = std::make_shared<Allocator>(*allocator);
+  }
+
+  Error err = ctx->context->set_allocator(hooks);
+  return err.error_struct(ctx->context.get());
+}
+
+
+LIBHEIF_API
+void heif_set_buffer_pool_size(heif_handle h, uint64_t max_bytes)
+{
+  struct heif_context* ctx = (struct heif_context*)h;
+
+  ctx->context->get_memory_account()->get_buffer_pool()->set_max_retained_bytes(max_bytes);
+}
+
+
+LIBHEIF_API
+void heif_image_cache_set_budget(size_t bytes)
+{
+  ImageCache::get_instance().set_budget(bytes);
+}
+
+
+LIBHEIF_API
+void heif_image_cache_get_stats(struct heif_image_cache_stats* stats)
+{
+  ImageCache::get_instance().get_stats(stats);
+}
+
+
+LIBHEIF_API
+void heif_image_cache_clear(void)
+{
+  ImageCache::get_instance().clear();
+}
+
+
+LIBHEIF_API
+void heif_parsed_file_cache_set_capacity(size_t max_files)
+{
+  ParsedFileCache::get_instance().set_capacity(max_files);
+}
+
+
+LIBHEIF_API
+void heif_parsed_file_cache_get_stats(struct heif_parsed_file_cache_stats* stats)
+{
+  ParsedFileCache::get_instance().get_stats(stats);
+}
+
+
+LIBHEIF_API
+void heif_parsed_file_cache_clear(void)
+{
+  ParsedFileCache::get_instance().clear();
+}
+
+
+LIBHEIF_API
+int heif_have_color_management(void)
+{
+  return is_color_management_available() ? 1 : 0;
+}
+
+
+LIBHEIF_API
+void heif_color_transform_cache_set_capacity(size_t max_transforms)
+{
+  ColorTransformCache::get_instance().set_capacity(max_transforms);
+}
+
+
+LIBHEIF_API
+void heif_color_transform_cache_clear(void)
+{
+  ColorTransformCache::get_instance().clear();
+}
+
+
+LIBHEIF_API
+struct heif_error heif_register_decoder_plugin(const struct heif_decoder_plugin* plugin)
+{
+  Error err = register_decoder(plugin);
+
+  // there is no context to hold a message, use the static description of the error
+  heif_error result;
+  result.code = err.error_code;
+  result.subcode = err.sub_error_code;
+  result.message = (err ? Error::get_error_string(err.sub_error_code) : Error::kSuccess);
+  return result;
+}
+
+
+LIBHEIF_API
+int heif_get_decoder_plugins(enum heif_compression_format format,
+                             const struct heif_decoder_plugin** out_plugins, int count)
+{
+  std::vector<const heif_decoder_plugin*> plugins = get_decoders(format);
+
+  for (int i=0; i<count && i<(int)plugins.size(); i++) {
+    out_plugins[i] = plugins[i];
+  }
+
+  return (int)plugins.size();
+}
+
+
+LIBHEIF_API
+const char* heif_decoder_plugin_get_name(const struct heif_decoder_plugin* plugin)
+{
+  return plugin->get_plugin_name();
 }
 
 
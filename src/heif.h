@@ -89,7 +89,10 @@ enum heif_error_code {
   heif_error_Memory_allocation_error = 6,
 
   // The decoder plugin generated an error
-  heif_error_Decoder_plugin_error = 7
+  heif_error_Decoder_plugin_error = 7,
+
+  // Error while writing output data (index files, rewritten HEIF files).
+  heif_error_Encoding_error = 8
 };
 
 
@@ -161,6 +164,9 @@ enum heif_suberror_code {
 
   heif_suberror_No_infe_box = 125,
 
+  // HEVC parameter set (SPS/PPS) in the 'hvcC' box cannot be parsed
+  heif_suberror_Invalid_parameter_set = 126,
+
 
   // --- Memory_allocation_error ---
 
@@ -198,7 +204,12 @@ enum heif_suberror_code {
   heif_suberror_Unsupported_data_version = 3002,
 
   // The conversion of the source image to the requested chroma / colorspace is not supported.
-  heif_suberror_Unsupported_color_conversion = 3003
+  heif_suberror_Unsupported_color_conversion = 3003,
+
+
+  // --- Encoding_error ---
+
+  heif_suberror_Cannot_write_output_data = 5000
 };
 
 
@@ -319,7 +330,8 @@ enum heif_image_type
   HEIF_IMAGE_TYPE_HVC1 = 0,
   HEIF_IMAGE_TYPE_GRID = 1,
   HEIF_IMAGE_TYPE_IDEN = 2,
-  HEIF_IMAGE_TYPE_IOVL = 3
+  HEIF_IMAGE_TYPE_IOVL = 3,
+  HEIF_IMAGE_TYPE_JPEG = 4
 };
 
 typedef struct _heif_image{
@@ -334,6 +346,8 @@ typedef struct _heif_image{
   enum heif_image_type image_type; 
   // compressed image data
   base_image _image;
+  // size of the length prefix in front of each NAL unit in _image (1, 2 or 4 bytes)
+  int nal_length_size;
 
   // thumb 
   base_image thumb;
@@ -355,6 +369,14 @@ typedef struct _heif_image{
   uint8_t *yuv_image;
   int yuv_len;
 
+  // decoded image planes (Y, Cb, Cr), set by heif_decode_image().
+  // The pixel data is read-only, it may be shared with other images through the image cache.
+  uint8_t *planes[3];
+  int strides[3];
+
+  // reference to the decoded image owning the planes, released by heif_destory_image_buffer()
+  void *decoded_image;
+
 }heif_image;
 
 
@@ -404,10 +426,29 @@ void heif_handle_free(heif_handle h);
 LIBHEIF_API
 struct heif_error heif_read_from_file(heif_handle h, const char* filename);
 
+// Read a HEIF file from a named disk file, using an index file to avoid parsing the
+// file structure. If the index does not exist or does not match the file, the file
+// is parsed and the index is written. 'index_filename' may be NULL, the index is then
+// stored next to the file as "<filename>.hidx".
+LIBHEIF_API
+struct heif_error heif_read_from_file_with_index(heif_handle h, const char* filename,
+                                                 const char* index_filename);
+
 // Read a HEIF file stored completely in memory.
 LIBHEIF_API
 struct heif_error heif_read_from_memory(heif_handle h, const void* mem, size_t size);
 
+// Losslessly rewrite the loaded file with 'ftyp' and 'meta' before all item data
+// ("fast start"), so that it can be parsed and decoded from a prefix while it is downloaded.
+// Only the 'iloc' offsets change. If 'decoding_order' is non-zero, the item data is stored
+// in the order needed to show the primary image: thumbnails, the image and its tiles,
+// auxiliary images, metadata. Otherwise the original order is kept.
+// The file must have been parsed, not opened from an index. 'output_filename' may be the
+// input file.
+LIBHEIF_API
+struct heif_error heif_write_fast_start_file(heif_handle h, const char* output_filename,
+                                             int decoding_order);
+
 // Get a handle to the primary image of the HEIF file.
 // This is the image that should be displayed primarily when there are several images in the file.
 LIBHEIF_API
@@ -420,6 +461,11 @@ LIBHEIF_API
 int heif_get_number_of_images(heif_handle h);
 
 
+// Whether the image has an alpha channel, which is included in RGBA output.
+LIBHEIF_API
+int heif_image_has_alpha_channel(heif_handle h, int image_idx);
+
+
 LIBHEIF_API
 heif_image *heif_create_image_buffer(heif_handle h);
 
@@ -427,7 +473,595 @@ LIBHEIF_API
 void heif_destory_image_buffer(heif_handle h,heif_image *img);
 
 LIBHEIF_API
-heif_error heif_get_image_data(heif_handle h, int image_idx, heif_image* out_data);
+struct heif_error heif_get_image_data(heif_handle h, int image_idx, heif_image* out_data);
+
+
+// Part of the output image that has been decoded completely.
+struct heif_decoded_region
+{
+  // rectangle on the output canvas
+  int x, y;
+  int width, height;
+
+  // The whole output canvas. Regions reported earlier are final, the rest is
+  // still being decoded. Only valid during the callback.
+  int canvas_width, canvas_height;
+  int chroma;  // enum heif_chroma
+  const uint8_t* planes[3];
+  int strides[3];
+};
+
+typedef void (*heif_progress_callback)(const struct heif_decoded_region* region, void* user_data);
+
+enum heif_progress_granularity {
+  // report each tile of a grid image when it is placed on the canvas
+  heif_progress_granularity_tile = 0,
+
+  // report each complete row of tiles
+  heif_progress_granularity_tile_row = 1
+};
+
+struct heif_decoder_plugin;
+
+struct heif_decoding_options
+{
+  // version of this struct, set by heif_decoding_options_alloc()
+  uint8_t version;
+
+  // version 1 options
+
+  // Do not look up or store the decoded image in the image cache.
+  uint8_t bypass_image_cache;
+
+  // version 2 options
+
+  // Called from the decoding thread for each finished part of the output image.
+  // Images without tiles, or taken from the image cache, are reported as one region.
+  heif_progress_callback progress_callback;
+  void* progress_user_data;
+  enum heif_progress_granularity progress_granularity;
+
+  // version 3 options
+
+  // Return the image as it is coded, without applying its crop window ('clap'),
+  // rotation ('irot') and mirroring ('imir'). By default, these are applied while
+  // the decoded tiles are placed into the output image.
+  uint8_t ignore_transformations;
+
+  // version 4 options
+
+  // heif_chroma_undefined: return the image as coded (planar YCbCr or monochrome).
+  // heif_chroma_interleaved_24bit: RGB, heif_chroma_interleaved_32bit: RGBA.
+  // For RGBA, the alpha image is decoded in parallel to the colour image. Images
+  // without alpha are opaque. RGB(A) images are reported as one progress region.
+  int output_chroma;  // enum heif_chroma
+
+  // Multiply the colour components of RGBA output with the alpha value.
+  uint8_t premultiply_alpha;
+
+  // version 5 options
+
+  // Decode with this plugin instead of the registered plugin with the highest priority.
+  // Only used for compression formats that the plugin supports. Images from the image
+  // cache are returned regardless of the plugin that decoded them, set bypass_image_cache
+  // to compare decoders.
+  const struct heif_decoder_plugin* decoder_plugin;
+
+  // version 6 options
+
+  // Decode JPEG-coded images at 1/2, 1/4 or 1/8 of their size directly from the DCT
+  // coefficients, e.g. for previews. 1 decodes at full size. Images coded with other
+  // formats are always decoded at full size.
+  uint8_t scale_denominator;
+
+  // version 7 options
+
+  // Alignment of the output planes in bytes: the start of each plane and its stride are
+  // multiples of it, e.g. 64 for SIMD code or 4096 for page-aligned buffers. Has to be 0
+  // or a power of two up to 65536. 0 stores the rows without padding.
+  uint32_t plane_alignment;
+
+  // Bytes after the last pixel of each row that may be read and written, e.g. by SIMD
+  // code processing whole vectors. They are part of the stride.
+  uint32_t row_padding;
+
+  // version 8 options
+
+  // Convert RGB(A) output of images with an ICC profile to sRGB, e.g. Display P3 images
+  // for the web. Images without a profile are returned unchanged. Fails with
+  // heif_suberror_Unsupported_color_conversion if the library was built without
+  // colour management (see heif_have_color_management()).
+  uint8_t convert_to_srgb;
+};
+
+// Allocate decoding options and fill them with default values.
+// Has to be freed again with heif_decoding_options_free().
+LIBHEIF_API
+struct heif_decoding_options* heif_decoding_options_alloc(void);
+
+LIBHEIF_API
+void heif_decoding_options_free(struct heif_decoding_options*);
+
+// Decode an image into 'out_data'. 'options' may be NULL to use the default options.
+// The decoded planes are returned in out_data->planes / out_data->strides. The strides
+// may be larger than the plane width, see plane_alignment and row_padding.
+// Images previously decoded into 'out_data' are released.
+LIBHEIF_API
+struct heif_error heif_decode_image(heif_handle h, int image_idx,
+                                    const struct heif_decoding_options* options,
+                                    heif_image* out_data);
+
+
+// --- depth maps
+
+enum heif_depth_format
+{
+  // depth in the unit of z_near / z_far, or disparity for disparity representations
+  heif_depth_format_float32 = 0,
+
+  // the float32 value multiplied by 1000 (millimetres for depth in metres), clamped to 0..65535
+  heif_depth_format_uint16 = 1
+};
+
+struct heif_depth_map
+{
+  int width;
+  int height;
+  int format;  // enum heif_depth_format
+  int stride;  // bytes between rows
+  void* data;  // released by heif_depth_map_release()
+
+  // buffer owning 'data', allocated by the handle's allocator. Do not modify.
+  void* buffer;
+};
+
+LIBHEIF_API
+int heif_image_has_depth_channel(heif_handle h, int image_idx);
+
+LIBHEIF_API
+struct heif_error heif_get_depth_representation_info(heif_handle h, int image_idx,
+                                                     struct heif_depth_representation_info* out_info);
+
+// Decode the depth auxiliary image of an image and convert its samples according to
+// the depth representation info. Non-uniform disparity is not supported.
+LIBHEIF_API
+struct heif_error heif_decode_depth_map(heif_handle h, int image_idx,
+                                        enum heif_depth_format format,
+                                        struct heif_depth_map* out_map);
+
+LIBHEIF_API
+void heif_depth_map_release(struct heif_depth_map* map);
+
+
+// --- Exif metadata
+
+// Fields of the Exif data that are read without an Exif library.
+struct heif_exif_info
+{
+  int has_orientation;
+  int orientation;  // 1..8, TIFF orientation
+
+  int has_capture_time;
+  char capture_time[20];  // "YYYY:MM:DD HH:MM:SS", DateTimeOriginal or DateTime
+
+  int has_dimensions;
+  uint32_t width;   // PixelXDimension
+  uint32_t height;  // PixelYDimension
+};
+
+// Content of the image's Exif item: a 32 bit offset to the TIFF header, followed by the
+// Exif data. The data is read on first access; if the file is mapped, it points into the
+// input without a copy. It stays valid until the handle is freed.
+LIBHEIF_API
+struct heif_error heif_get_exif_data(heif_handle h, int image_idx,
+                                     const uint8_t** out_data, size_t* out_size);
+
+LIBHEIF_API
+struct heif_error heif_get_exif_info(heif_handle h, int image_idx,
+                                     struct heif_exif_info* out_info);
+
+
+// --- HEVC stream info
+
+// Properties of an HEVC coded image, read from the parameter sets in its 'hvcC' box without
+// decoding. For grid images, these are the properties of the first tile.
+struct heif_hevc_info
+{
+  int profile_idc;
+  int level_idc;
+  int tier;
+
+  int chroma;  // enum heif_chroma, heif_chroma_monochrome to heif_chroma_444
+  int bit_depth_luma;
+  int bit_depth_chroma;
+
+  // size of the decoded pictures, and the conformance window cropped from it
+  uint32_t coded_width;
+  uint32_t coded_height;
+  uint32_t crop_left;
+  uint32_t crop_right;
+  uint32_t crop_top;
+  uint32_t crop_bottom;
+
+  int ctb_size;  // size of the coding tree blocks, 16, 32 or 64
+
+  // colour description from the VUI, ISO/IEC 23091-2 codes, 2 (unspecified) if absent
+  int has_colour_description;
+  uint8_t colour_primaries;
+  uint8_t transfer_characteristics;
+  uint8_t matrix_coefficients;
+  int full_range;
+
+  // parallel decoding tools from the PPS, 1x1 tiles if tiles are not used
+  int tile_columns;
+  int tile_rows;
+  int uniform_tile_spacing;
+  int wavefront_parallel_processing;
+};
+
+LIBHEIF_API
+struct heif_error heif_get_hevc_info(heif_handle h, int image_idx,
+                                     struct heif_hevc_info* out_info);
+
+
+// --- colour information
+
+// Where the colour information of an image comes from.
+enum heif_colour_source
+{
+  heif_colour_source_default = 0,  // not signalled, full range and unspecified codes
+  heif_colour_source_colr = 1,     // 'colr' box of type 'nclx'
+  heif_colour_source_vui = 2       // VUI of the HEVC stream
+};
+
+// 'nclx' colour information, ISO/IEC 23091-2 codes. RGB output is converted with
+// 'matrix_coefficients' and 'full_range'.
+struct heif_nclx_info
+{
+  int source;  // enum heif_colour_source
+
+  uint16_t colour_primaries;
+  uint16_t transfer_characteristics;
+  uint16_t matrix_coefficients;
+  int full_range;
+};
+
+LIBHEIF_API
+struct heif_error heif_get_nclx_info(heif_handle h, int image_idx,
+                                     struct heif_nclx_info* out_info);
+
+// ICC profile of the image ('colr' box of type 'rICC' or 'prof'). Grid and identity images
+// without their own profile return the profile of the image they are derived from.
+// The data is not copied and stays valid until the handle is freed.
+LIBHEIF_API
+struct heif_error heif_get_icc_profile(heif_handle h, int image_idx,
+                                       const uint8_t** out_data, size_t* out_size);
+
+
+// --- asynchronous decoding
+
+// Called when an asynchronous decode has finished. On success, 'image' holds the decoded
+// image and has to be released with heif_destory_image_buffer(). On error, 'image' is NULL.
+// err.message is only valid during the callback.
+typedef void (*heif_decode_callback)(heif_handle h, int image_idx, struct heif_error err,
+                                     heif_image* image, void* user_data);
+
+// Decode an image on the library's thread pool and return immediately.
+// The callback is called from heif_dispatch_completions() after the decode finished.
+// 'options' are copied and may be freed after this call.
+// Decodes that finish after the handle was freed are discarded.
+LIBHEIF_API
+struct heif_error heif_decode_async(heif_handle h, int image_idx,
+                                    const struct heif_decoding_options* options,
+                                    heif_decode_callback callback, void* user_data);
+
+// File descriptor (an eventfd) that is readable while finished decodes are waiting
+// to be dispatched. It can be registered in poll/epoll and is owned by the handle.
+LIBHEIF_API
+int heif_get_completion_fd(heif_handle h);
+
+// Call the callbacks of all finished asynchronous decodes in the calling thread.
+// Never blocks. Returns the number of callbacks called.
+LIBHEIF_API
+int heif_dispatch_completions(heif_handle h);
+
+
+// --- files that are still arriving
+
+// A push parser receives a file in chunks, e.g. while it is downloaded or uploaded.
+// As soon as the 'ftyp' and 'meta' boxes have arrived, the file can be read into a handle
+// with heif_read_from_push_parser(). Its images can then be decoded while the rest of the
+// data is arriving: reading data that has not arrived yet waits until it is pushed, and
+// grid images are decoded row by row of tiles, reporting each row through the progress
+// callback. Do such decodes with heif_decode_async(), or from another thread than the one
+// pushing the data. Check heif_image_data_available() before decoding in the pushing thread.
+//
+// The data may also be fetched with byte range requests and pushed out of order with
+// heif_push_parser_push_data_at(). heif_push_parser_get_fetch_ranges() then tells which
+// ranges are needed to reach the 'meta' box, and heif_get_fetch_ranges() which ranges are
+// needed for an image.
+struct heif_push_parser;
+
+struct heif_byte_range
+{
+  uint64_t offset;
+  uint64_t length;
+};
+
+LIBHEIF_API
+struct heif_push_parser* heif_push_parser_alloc(void);
+
+// Handles reading from the parser stay valid. Reads of data that has not been pushed
+// fail from then on.
+LIBHEIF_API
+void heif_push_parser_free(struct heif_push_parser* parser);
+
+// Append the next chunk of the file. The data is copied.
+LIBHEIF_API
+struct heif_error heif_push_parser_push_data(struct heif_push_parser* parser,
+                                             const void* data, size_t size);
+
+// Add a chunk of data from file position 'offset'. Data that has been pushed before is kept.
+LIBHEIF_API
+struct heif_error heif_push_parser_push_data_at(struct heif_push_parser* parser, uint64_t offset,
+                                                const void* data, size_t size);
+
+// Byte ranges needed next to complete the 'ftyp' and 'meta' boxes: the rest of these boxes
+// when their headers have arrived, otherwise the header of the next top-level box.
+// Fetch and push them, then ask again until heif_push_parser_has_meta() returns 1.
+// At most 'max_ranges' ranges are written, '*out_num_ranges' is set to the total number.
+LIBHEIF_API
+void heif_push_parser_get_fetch_ranges(const struct heif_push_parser* parser,
+                                       struct heif_byte_range* out_ranges, int max_ranges,
+                                       int* out_num_ranges);
+
+// No more data will be pushed, because the file is complete or the transfer failed.
+// Waiting reads of missing data fail.
+LIBHEIF_API
+void heif_push_parser_end_of_data(struct heif_push_parser* parser);
+
+LIBHEIF_API
+int heif_push_parser_has_ftyp(const struct heif_push_parser* parser);
+
+LIBHEIF_API
+int heif_push_parser_has_meta(const struct heif_push_parser* parser);
+
+// Read the file from the parser. Fails if the 'meta' box has not arrived yet.
+LIBHEIF_API
+struct heif_error heif_read_from_push_parser(heif_handle h, struct heif_push_parser* parser);
+
+// Whether all data needed to decode the image has arrived, including its grid tiles and
+// its alpha image. Always 1 for files that were not read from a push parser.
+LIBHEIF_API
+int heif_image_data_available(heif_handle h, int image_idx);
+
+// Whether the data of the image's first thumbnail has arrived. 0 if there is no thumbnail.
+LIBHEIF_API
+int heif_thumbnail_data_available(heif_handle h, int image_idx);
+
+// Number of rows of grid tiles, from the top, whose data has arrived. An image that is
+// not a grid counts as one row.
+LIBHEIF_API
+int heif_get_available_tile_rows(heif_handle h, int image_idx);
+
+
+// --- planning byte range requests
+
+enum heif_fetch_target
+{
+  // the 'ftyp' and 'meta' boxes, and the headers of the top-level boxes in front of 'meta'
+  heif_fetch_target_probe = 0,
+
+  // the first thumbnail of the image
+  heif_fetch_target_thumbnail = 1,
+
+  // the image, with all its tiles and its alpha image
+  heif_fetch_target_image = 2,
+
+  // the tiles of a grid image that overlap a region, and those of its alpha image
+  heif_fetch_target_region = 3
+};
+
+// Region in the coordinates of the full image, before 'clap', 'irot' and 'imir'.
+struct heif_fetch_region
+{
+  int x, y;
+  int width, height;
+};
+
+// Compute the byte ranges of the file that are needed for 'target' of the image, from the
+// item locations and box positions. 'region' is only used with heif_fetch_target_region.
+// For a handle read from a push parser, only the data that has not arrived yet is returned,
+// so an empty list means the target can be decoded. Otherwise all needed ranges are returned.
+// The ranges are sorted. Ranges less than 'merge_gap' bytes apart are merged into one,
+// trading a few unneeded bytes for fewer requests.
+// At most 'max_ranges' ranges are written, '*out_num_ranges' is set to the total number.
+LIBHEIF_API
+struct heif_error heif_get_fetch_ranges(heif_handle h, int image_idx,
+                                        enum heif_fetch_target target,
+                                        const struct heif_fetch_region* region,
+                                        uint64_t merge_gap,
+                                        struct heif_byte_range* out_ranges, int max_ranges,
+                                        int* out_num_ranges);
+
+
+// --- resource limits
+
+// Limits protecting a handle against hostile or oversized files. A value of 0 means
+// no limit. Files exceeding a limit fail with heif_suberror_Security_limit_exceeded.
+struct heif_resource_limits
+{
+  // version of this struct, set by heif_get_default_resource_limits()
+  uint8_t version;
+
+  // version 1 limits
+
+  // Bytes held by the handle at the same time: compressed data read for decoding,
+  // decoded frames while they are copied out, and decoded images.
+  uint64_t max_memory_bytes;
+
+  // Size of a single image or grid canvas, width * height.
+  uint64_t max_image_pixels;
+
+  // Tiles of a single grid image.
+  uint32_t max_tiles;
+
+  // Items in the file.
+  uint32_t max_items;
+
+  // Child boxes of a single box.
+  uint32_t max_children_per_box;
+
+  // Extents of a single item in the 'iloc' box.
+  uint32_t max_extents_per_item;
+
+  // Coded data of a single item.
+  uint64_t max_item_data_size;
+};
+
+// Fill 'limits' with the limits of a new handle.
+LIBHEIF_API
+void heif_get_default_resource_limits(struct heif_resource_limits* limits);
+
+// Set the limits before reading a file. The memory limit applies from the next allocation.
+LIBHEIF_API
+struct heif_error heif_set_resource_limits(heif_handle h, const struct heif_resource_limits* limits);
+
+LIBHEIF_API
+void heif_get_resource_limits(heif_handle h, struct heif_resource_limits* limits);
+
+struct heif_memory_usage
+{
+  // bytes currently charged to the handle
+  uint64_t current_bytes;
+
+  // highest value of current_bytes since the handle was created or the peak was reset
+  uint64_t peak_bytes;
+
+  // allocations rejected because of max_memory_bytes
+  uint64_t rejected_allocations;
+};
+
+// Memory charged to the handle. Decoded images are charged while the handle's heif_image
+// buffers hold them. Images in the decoded image cache are charged to the cache, and to
+// each handle while it holds them.
+LIBHEIF_API
+void heif_get_memory_usage(heif_handle h, struct heif_memory_usage* usage);
+
+// Set peak_bytes to current_bytes, e.g. before each request served with the same handle.
+LIBHEIF_API
+void heif_reset_peak_memory_usage(heif_handle h);
+
+
+// --- custom allocators
+
+// Allocator for the large buffers of a handle: compressed data read for decoding, the frame
+// buffers of the decoder, decoded images and the buffers of heif_image. Small structures,
+// like the parsed boxes, use the global heap.
+struct heif_allocator
+{
+  // Allocate 'size' bytes. Returns NULL on failure.
+  void* (*alloc)(void* user_data, size_t size);
+
+  // Release memory from alloc() or aligned_alloc().
+  void (*free)(void* user_data, void* ptr);
+
+  // Optional, may be NULL. Allocate 'size' bytes aligned to 'alignment' (a power of two).
+  // Without it, aligned buffers are cut out of larger blocks from alloc().
+  void* (*aligned_alloc)(void* user_data, size_t size, size_t alignment);
+
+  void* user_data;
+};
+
+// Use 'allocator' for the buffers of the handle, or malloc() and free() if it is NULL.
+// Has to be called before reading a file. The hooks are copied. They may be called from
+// the decoding threads, and after the handle was freed, for decoded images that are still
+// used (e.g. from the decoded image cache).
+LIBHEIF_API
+struct heif_error heif_set_allocator(heif_handle h, const struct heif_allocator* allocator);
+
+// Released buffers of decoded images and compressed data are kept for reuse by the handle,
+// so that decoding further images does not allocate. They are kept up to 'max_bytes'
+// (64 MB by default), 0 frees them right away. Kept buffers are not counted in
+// heif_get_memory_usage().
+LIBHEIF_API
+void heif_set_buffer_pool_size(heif_handle h, uint64_t max_bytes);
+
+
+// --- decoded image cache
+
+// Decoded images are kept in a process-wide cache, keyed by the input file,
+// the image and the decoding options. The cache is disabled by default (budget 0).
+// Cached images do not count towards the max_memory_bytes of the handle that decoded
+// them, only while a handle holds one in a heif_image. Decoding a cached image fails
+// if that exceeds the limit.
+
+struct heif_image_cache_stats
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+
+  size_t num_images;
+  size_t bytes_used;
+  size_t bytes_budget;
+};
+
+// Set the maximum memory used by cached images. Images exceeding the budget
+// are evicted, least recently used first.
+LIBHEIF_API
+void heif_image_cache_set_budget(size_t bytes);
+
+LIBHEIF_API
+void heif_image_cache_get_stats(struct heif_image_cache_stats* stats);
+
+LIBHEIF_API
+void heif_image_cache_clear(void);
+
+
+// --- parsed file cache
+
+// The parsed structure of recently opened files (boxes, item tables, image
+// references) is kept in a process-wide cache, keyed by (device, inode, size, mtime)
+// for files and by a SHA-256 of the content for memory input. Handles opening a cached file
+// share the parsed structure. The cache is disabled by default (capacity 0).
+
+struct heif_parsed_file_cache_stats
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+
+  size_t num_files;
+  size_t capacity;
+};
+
+// Set the maximum number of files in the cache. Files exceeding the capacity
+// are evicted, least recently used first.
+LIBHEIF_API
+void heif_parsed_file_cache_set_capacity(size_t max_files);
+
+LIBHEIF_API
+void heif_parsed_file_cache_get_stats(struct heif_parsed_file_cache_stats* stats);
+
+LIBHEIF_API
+void heif_parsed_file_cache_clear(void);
+
+
+// --- colour transform cache
+
+// Transforms from ICC profiles to sRGB (heif_decoding_options.convert_to_srgb) are kept
+// in a process-wide cache, keyed by a SHA-256 of the profile. The default capacity is 16.
+
+// Whether the library was built with colour management (lcms2).
+LIBHEIF_API
+int heif_have_color_management(void);
+
+LIBHEIF_API
+void heif_color_transform_cache_set_capacity(size_t max_transforms);
+
+LIBHEIF_API
+void heif_color_transform_cache_clear(void);
 
 
 
@@ -486,6 +1120,24 @@ enum heif_channel {
 };
 
 
+// --- decoder plugins (see heif_plugin.h)
+
+// Register a decoder plugin. For each compression format, the registered plugin with the highest
+// priority is used, the most recently registered one among plugins with the same priority.
+// The libde265 HEVC decoder is registered by default.
+LIBHEIF_API
+struct heif_error heif_register_decoder_plugin(const struct heif_decoder_plugin* plugin);
+
+// Fill 'out_plugins' with up to 'count' registered plugins that decode 'format', highest
+// priority first. Returns the total number of such plugins.
+LIBHEIF_API
+int heif_get_decoder_plugins(enum heif_compression_format format,
+                             const struct heif_decoder_plugin** out_plugins, int count);
+
+LIBHEIF_API
+const char* heif_decoder_plugin_get_name(const struct heif_decoder_plugin* plugin);
+
+
 
 
 
@@ -0,0 +1,347 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_allocator.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+using namespace heif;
+
+
+Allocator::Allocator()
+{
+  memset(&m_hooks, 0, sizeof(m_hooks));
+}
+
+
+Allocator::Allocator(const heif_allocator& hooks)
+  : m_hooks(hooks)
+{
+}
+
+
+const std::shared_ptr<const Allocator>& Allocator::get_default()
+{
+  static const std::shared_ptr<const Allocator> allocator = std::make_shared<Allocator>();
+  return allocator;
+}
+
+
+// Without an aligned_alloc hook, every block is over-allocated and the pointer returned by
+// alloc() is stored in front of the aligned memory, so that release() can find it.
+static const size_t MIN_ALIGNMENT = 16;
+
+
+void* Allocator::allocate(size_t size, size_t alignment) const
+{
+  if (size == 0) {
+    size = 1;
+  }
+
+  if (is_default()) {
+    if (alignment <= MIN_ALIGNMENT) {
+      return malloc(size);
+    }
+
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+      return nullptr;
+    }
+
+    return ptr;
+  }
+
+  if (m_hooks.aligned_alloc) {
+    return m_hooks.aligned_alloc(m_hooks.user_data, size,
+                                 alignment < MIN_ALIGNMENT ? MIN_ALIGNMENT : alignment);
+  }
+
+  if (alignment < MIN_ALIGNMENT) {
+    alignment = MIN_ALIGNMENT;
+  }
+
+  if (size > SIZE_MAX - alignment - sizeof(void*)) {
+    return nullptr;
+  }
+
+  uint8_t* block = static_cast<uint8_t*>(m_hooks.alloc(m_hooks.user_data,
+                                                       size + alignment + sizeof(void*)));
+  if (!block) {
+    return nullptr;
+  }
+
+  uintptr_t start = reinterpret_cast<uintptr_t>(block) + sizeof(void*);
+  uint8_t* ptr = block + ((start + alignment - 1) & ~(uintptr_t)(alignment - 1)) -
+                 reinterpret_cast<uintptr_t>(block);
+
+  memcpy(ptr - sizeof(void*), &block, sizeof(void*));
+
+  return ptr;
+}
+
+
+void Allocator::release(void* ptr) const
+{
+  if (!ptr) {
+    return;
+  }
+
+  if (is_default()) {
+    free(ptr);
+  }
+  else if (m_hooks.aligned_alloc) {
+    m_hooks.free(m_hooks.user_data, ptr);
+  }
+  else {
+    void* block;
+    memcpy(&block, static_cast<uint8_t*>(ptr) - sizeof(void*), sizeof(void*));
+    m_hooks.free(m_hooks.user_data, block);
+  }
+}
+
+
+heif_decoder_allocator Allocator::get_decoder_allocator() const
+{
+  heif_decoder_allocator hooks;
+
+  hooks.alloc = [](void* user_data, size_t size, size_t alignment) -> void* {
+    return static_cast<const Allocator*>(user_data)->allocate(size, alignment);
+  };
+
+  hooks.free = [](void* user_data, void* ptr) {
+    static_cast<const Allocator*>(user_data)->release(ptr);
+  };
+
+  hooks.user_data = const_cast<Allocator*>(this);
+
+  return hooks;
+}
+
+
+// --- BufferPool
+
+// Number of blocks a pool keeps track of. Blocks allocated while all entries are in use
+// bypass the pool.
+static const size_t MAX_POOL_BLOCKS = 64;
+
+
+BufferPool::BufferPool(const std::shared_ptr<const Allocator>& allocator,
+                       uint64_t max_retained_bytes)
+  : m_allocator(allocator ? allocator : Allocator::get_default()),
+    m_max_retained_bytes(max_retained_bytes)
+{
+  m_blocks.reserve(MAX_POOL_BLOCKS);
+}
+
+
+BufferPool::~BufferPool()
+{
+  // blocks still in use keep the pool alive (see PoolAllocator, AllocatedBuffer)
+  trim();
+}
+
+
+void BufferPool::set_max_retained_bytes(uint64_t max_bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_max_retained_bytes = max_bytes;
+  free_unused_blocks(max_bytes);
+}
+
+
+uint64_t BufferPool::get_max_retained_bytes() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_max_retained_bytes;
+}
+
+
+void* BufferPool::allocate(size_t size, size_t alignment)
+{
+  if (size == 0) {
+    size = 1;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The smallest free block that fits. Blocks of more than twice the size are not used,
+    // so that small requests do not hold on to the buffers of large images.
+    Block* best = nullptr;
+    for (Block& block : m_blocks) {
+      if (!block.in_use &&
+          block.capacity >= size && block.capacity / 2 <= size &&
+          block.alignment >= alignment &&
+          (!best || block.capacity < best->capacity)) {
+        best = &block;
+      }
+    }
+
+    if (best) {
+      best->in_use = true;
+      m_retained_bytes -= best->capacity;
+      return best->ptr;
+    }
+  }
+
+  void* ptr = m_allocator->allocate(size, alignment);
+  if (!ptr) {
+    // retry after giving the retained memory back
+    trim();
+    ptr = m_allocator->allocate(size, alignment);
+    if (!ptr) {
+      return nullptr;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_blocks.size() < MAX_POOL_BLOCKS) {
+    m_blocks.push_back(Block{ptr, size, alignment, true});
+  }
+
+  return ptr;
+}
+
+
+void BufferPool::release(void* ptr)
+{
+  if (!ptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  for (Block& block : m_blocks) {
+    if (block.ptr == ptr) {
+      block.in_use = false;
+      m_retained_bytes += block.capacity;
+
+      free_unused_blocks(m_max_retained_bytes);
+      return;
+    }
+  }
+
+  // allocated while the pool was full
+  m_allocator->release(ptr);
+}
+
+
+void BufferPool::trim()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  free_unused_blocks(0);
+}
+
+
+uint64_t BufferPool::get_retained_bytes() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_retained_bytes;
+}
+
+
+void BufferPool::free_unused_blocks(uint64_t max_retained_bytes)
+{
+  // free the largest blocks first, they are the least likely to be reused
+  while (m_retained_bytes > max_retained_bytes) {
+    size_t largest = m_blocks.size();
+    for (size_t i = 0; i < m_blocks.size(); i++) {
+      if (!m_blocks[i].in_use &&
+          (largest == m_blocks.size() || m_blocks[i].capacity > m_blocks[largest].capacity)) {
+        largest = i;
+      }
+    }
+
+    m_allocator->release(m_blocks[largest].ptr);
+    m_retained_bytes -= m_blocks[largest].capacity;
+
+    m_blocks[largest] = m_blocks.back();
+    m_blocks.pop_back();
+  }
+}
+
+
+// --- AllocatedBuffer
+
+bool AllocatedBuffer::allocate(const std::shared_ptr<const Allocator>& allocator, size_t size,
+                               size_t alignment)
+{
+  release();
+
+  const std::shared_ptr<const Allocator>& from = allocator ? allocator : Allocator::get_default();
+
+  m_data = static_cast<uint8_t*>(from->allocate(size, alignment));
+  if (!m_data) {
+    return false;
+  }
+
+  m_allocator = from;
+  m_size = size;
+
+  return true;
+}
+
+
+bool AllocatedBuffer::allocate(const std::shared_ptr<BufferPool>& pool, size_t size,
+                               size_t alignment)
+{
+  if (!pool) {
+    return allocate(std::shared_ptr<const Allocator>(), size, alignment);
+  }
+
+  release();
+
+  m_data = static_cast<uint8_t*>(pool->allocate(size, alignment));
+  if (!m_data) {
+    return false;
+  }
+
+  m_pool = pool;
+  m_size = size;
+
+  return true;
+}
+
+
+void AllocatedBuffer::release()
+{
+  if (m_data) {
+    if (m_pool) {
+      m_pool->release(m_data);
+      m_pool.reset();
+    }
+    else {
+      m_allocator->release(m_data);
+      m_allocator.reset();
+    }
+
+    m_data = nullptr;
+  }
+
+  m_size = 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_ALLOCATOR_H
+#define LIBHEIF_HEIF_ALLOCATOR_H
+
+#include "heif_plugin.h"
+
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+
+namespace heif {
+
+  // Allocation of large buffers (compressed data, frames, decoded images) through the
+  // hooks of a heif_allocator, or through malloc() and free().
+  class Allocator {
+  public:
+    // malloc() and free()
+    Allocator();
+
+    explicit Allocator(const heif_allocator& hooks);
+
+    Allocator(const Allocator&) = delete;
+    Allocator& operator=(const Allocator&) = delete;
+
+    static const std::shared_ptr<const Allocator>& get_default();
+
+    bool is_default() const { return m_hooks.alloc == nullptr; }
+
+    // Allocate 'size' bytes aligned to 'alignment' (0 or a power of two). Returns nullptr on
+    // failure. The memory has to be released with release() of the same allocator.
+    void* allocate(size_t size, size_t alignment = 0) const;
+
+    void release(void* ptr) const;
+
+    // Hooks for the frame buffers of a decoder plugin, allocating from this allocator.
+    // The allocator has to exist as long as the decoder.
+    heif_decoder_allocator get_decoder_allocator() const;
+
+  private:
+    heif_allocator m_hooks;
+  };
+
+
+  // Keeps released blocks of an Allocator and hands them out again for requests of a
+  // similar size, so that decoding images one after another does not allocate once the
+  // pool is warm. Released blocks are kept up to 'max_retained_bytes', the others are
+  // freed. Thread-safe.
+  class BufferPool {
+  public:
+    BufferPool(const std::shared_ptr<const Allocator>& allocator, uint64_t max_retained_bytes);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    const std::shared_ptr<const Allocator>& get_allocator() const { return m_allocator; }
+
+    void set_max_retained_bytes(uint64_t max_bytes);
+
+    uint64_t get_max_retained_bytes() const;
+
+    // Like Allocator::allocate(). The memory has to be released with release() of this pool.
+    void* allocate(size_t size, size_t alignment = 0);
+
+    void release(void* ptr);
+
+    // Free all retained blocks.
+    void trim();
+
+    uint64_t get_retained_bytes() const;
+
+  private:
+    struct Block {
+      void* ptr;
+      size_t capacity;
+      size_t alignment;
+      bool in_use;
+    };
+
+    std::shared_ptr<const Allocator> m_allocator;
+
+    mutable std::mutex m_mutex;
+    std::vector<Block> m_blocks;  // capacity reserved up front, never grows
+    uint64_t m_retained_bytes = 0;
+    uint64_t m_max_retained_bytes;
+
+    void free_unused_blocks(uint64_t max_retained_bytes);
+  };
+
+
+  // Standard allocator taking its memory from a BufferPool, e.g. for std::allocate_shared().
+  template <class T> class PoolAllocator {
+  public:
+    typedef T value_type;
+
+    explicit PoolAllocator(const std::shared_ptr<BufferPool>& pool) : m_pool(pool) {}
+
+    template <class U> PoolAllocator(const PoolAllocator<U>& other) : m_pool(other.get_pool()) {}
+
+    T* allocate(size_t n)
+    {
+      void* ptr = m_pool->allocate(n * sizeof(T), alignof(T));
+      if (!ptr) {
+        throw std::bad_alloc();
+      }
+
+      return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t) { m_pool->release(ptr); }
+
+    const std::shared_ptr<BufferPool>& get_pool() const { return m_pool; }
+
+    template <class U> bool operator==(const PoolAllocator<U>& other) const { return m_pool == other.get_pool(); }
+    template <class U> bool operator!=(const PoolAllocator<U>& other) const { return m_pool != other.get_pool(); }
+
+  private:
+    std::shared_ptr<BufferPool> m_pool;
+  };
+
+
+  // Buffer allocated from an Allocator or a BufferPool, released when the buffer is destroyed.
+  class AllocatedBuffer {
+  public:
+    AllocatedBuffer() = default;
+    ~AllocatedBuffer() { release(); }
+
+    AllocatedBuffer(const AllocatedBuffer&) = delete;
+    AllocatedBuffer& operator=(const AllocatedBuffer&) = delete;
+
+    // Replace the buffer with 'size' new bytes. Returns false if the allocation failed.
+    bool allocate(const std::shared_ptr<const Allocator>& allocator, size_t size,
+                  size_t alignment = 0);
+
+    bool allocate(const std::shared_ptr<BufferPool>& pool, size_t size, size_t alignment = 0);
+
+    void release();
+
+    uint8_t* data() { return m_data; }
+    const uint8_t* data() const { return m_data; }
+
+    size_t size() const { return m_size; }
+
+  private:
+    std::shared_ptr<const Allocator> m_allocator;
+    std::shared_ptr<BufferPool> m_pool;
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+  };
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_async.h"
+
+#include <utility>
+
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+using namespace heif;
+
+
+CompletionQueue::CompletionQueue()
+{
+  m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+
+CompletionQueue::~CompletionQueue()
+{
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+
+void CompletionQueue::post(std::function<void()> completion)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_completions.push_back(std::move(completion));
+  }
+
+  if (m_fd >= 0) {
+    uint64_t one = 1;
+    ssize_t n = write(m_fd, &one, sizeof(one));
+    (void)n;
+  }
+}
+
+
+int CompletionQueue::dispatch()
+{
+  // Reset the eventfd before taking the completions. Completions posted after
+  // this point signal the fd again.
+
+  if (m_fd >= 0) {
+    uint64_t count;
+    ssize_t n = read(m_fd, &count, sizeof(count));
+    (void)n;
+  }
+
+  std::deque<std::function<void()>> completions;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    completions.swap(m_completions);
+  }
+
+  for (auto& completion : completions) {
+    completion();
+  }
+
+  return (int)completions.size();
+}
@@ -0,0 +1,58 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_ASYNC_H
+#define LIBHEIF_HEIF_ASYNC_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+
+
+namespace heif {
+
+  // Completions of asynchronous operations. They are posted from worker threads
+  // and run in the thread calling dispatch(). An eventfd becomes readable while
+  // completions are pending, so the queue can be polled from an event loop.
+  class CompletionQueue {
+  public:
+    CompletionQueue();
+    ~CompletionQueue();
+
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    int get_fd() const { return m_fd; }
+
+    void post(std::function<void()> completion);
+
+    // Run all pending completions, without blocking. Returns their number.
+    int dispatch();
+
+  private:
+    int m_fd;
+
+    std::mutex m_mutex;
+    std::deque<std::function<void()>> m_completions;
+  };
+
+}
+
+#endif
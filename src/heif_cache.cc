@@ -0,0 +1,383 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_cache.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+
+using namespace heif;
+
+
+FileIdentity FileIdentity::from_file(const char* filename)
+{
+  FileIdentity id;
+
+  struct stat st;
+  if (stat(filename, &st) != 0) {
+    return id;
+  }
+
+  id.m_device = st.st_dev;
+  id.m_inode = st.st_ino;
+  id.m_size = st.st_size;
+  id.m_mtime_sec = st.st_mtim.tv_sec;
+  id.m_mtime_nsec = st.st_mtim.tv_nsec;
+  id.m_valid = true;
+
+  return id;
+}
+
+
+// SHA-256 (FIPS 180-4). Memory input may come from untrusted users and the identity
+// is shared by the process-wide caches, so the hash has to be collision resistant.
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t x, int n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(uint32_t state[8], const uint8_t* block)
+{
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[4*i] << 24) | ((uint32_t)block[4*i+1] << 16) |
+           ((uint32_t)block[4*i+2] << 8) | block[4*i+3];
+  }
+
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = rotr32(w[i-15], 7) ^ rotr32(w[i-15], 18) ^ (w[i-15] >> 3);
+    uint32_t s1 = rotr32(w[i-2], 17) ^ rotr32(w[i-2], 19) ^ (w[i-2] >> 10);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) +
+                  sha256_k[i] + w[i];
+    uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void sha256(const uint8_t* data, size_t size, uint8_t digest[32])
+{
+  uint32_t state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    sha256_block(state, data + i);
+  }
+
+  // last block(s): remaining bytes, 0x80, zero padding and the length in bits
+  uint8_t tail[128] = { 0 };
+  size_t rest = size - i;
+  memcpy(tail, data + i, rest);
+  tail[rest] = 0x80;
+
+  size_t tail_size = (rest < 56 ? 64 : 128);
+  uint64_t bits = (uint64_t)size * 8;
+  for (int b = 0; b < 8; b++) {
+    tail[tail_size - 1 - b] = (uint8_t)(bits >> (8 * b));
+  }
+
+  for (size_t t = 0; t < tail_size; t += 64) {
+    sha256_block(state, tail + t);
+  }
+
+  for (int k = 0; k < 8; k++) {
+    digest[4*k]   = (uint8_t)(state[k] >> 24);
+    digest[4*k+1] = (uint8_t)(state[k] >> 16);
+    digest[4*k+2] = (uint8_t)(state[k] >> 8);
+    digest[4*k+3] = (uint8_t)state[k];
+  }
+}
+
+
+FileIdentity FileIdentity::from_memory(const void* data, size_t size)
+{
+  FileIdentity id;
+  id.m_size = size;
+  sha256(static_cast<const uint8_t*>(data), size, id.m_content_hash);
+  id.m_valid = true;
+
+  return id;
+}
+
+
+bool FileIdentity::operator<(const FileIdentity& other) const
+{
+  if (m_device != other.m_device) return m_device < other.m_device;
+  if (m_inode != other.m_inode) return m_inode < other.m_inode;
+  if (m_size != other.m_size) return m_size < other.m_size;
+  if (m_mtime_sec != other.m_mtime_sec) return m_mtime_sec < other.m_mtime_sec;
+  if (m_mtime_nsec != other.m_mtime_nsec) return m_mtime_nsec < other.m_mtime_nsec;
+  return memcmp(m_content_hash, other.m_content_hash, sizeof(m_content_hash)) < 0;
+}
+
+
+bool FileIdentity::operator==(const FileIdentity& other) const
+{
+  return !(*this < other) && !(other < *this);
+}
+
+
+bool ImageCache::Key::operator<(const Key& other) const
+{
+  if (image_id != other.image_id) return image_id < other.image_id;
+  if (options != other.options) return options < other.options;
+  return file < other.file;
+}
+
+
+ImageCache::ImageCache()
+  : m_account(std::make_shared<MemoryAccount>())
+{
+}
+
+
+ImageCache& ImageCache::get_instance()
+{
+  static ImageCache cache;
+  return cache;
+}
+
+
+bool ImageCache::lookup(const Key& key, std::shared_ptr<const HeifPixelImage>* out_image)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto iter = m_entries.find(key);
+  if (iter == m_entries.end()) {
+    m_misses++;
+    return false;
+  }
+
+  // move to front of LRU list
+  m_lru.splice(m_lru.begin(), m_lru, iter->second);
+
+  *out_image = iter->second->image;
+  m_hits++;
+
+  return true;
+}
+
+
+void ImageCache::insert(const Key& key, const std::shared_ptr<const HeifPixelImage>& image)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  size_t size = image->get_memory_size();
+  if (size > m_budget || m_entries.find(key) != m_entries.end()) {
+    return;
+  }
+
+  // The image has just been decoded and is not shared yet, or it is in the cache already
+  // under another key (e.g. passed through by an identity image).
+  if (image->move_memory_charge(m_account)) {
+    return;
+  }
+
+  evict_to_budget(m_budget - size);
+
+  Entry entry;
+  entry.key = key;
+  entry.image = image;
+  entry.size = size;
+
+  m_lru.push_front(entry);
+  m_entries[key] = m_lru.begin();
+  m_bytes_used += size;
+}
+
+
+void ImageCache::evict_to_budget(size_t budget)
+{
+  while (m_bytes_used > budget && !m_lru.empty()) {
+    const Entry& entry = m_lru.back();
+
+    m_bytes_used -= entry.size;
+    m_entries.erase(entry.key);
+    m_lru.pop_back();
+
+    m_evictions++;
+  }
+}
+
+
+void ImageCache::set_budget(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_budget = bytes;
+  evict_to_budget(m_budget);
+}
+
+
+size_t ImageCache::get_budget() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_budget;
+}
+
+
+void ImageCache::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_lru.clear();
+  m_entries.clear();
+  m_bytes_used = 0;
+}
+
+
+void ImageCache::get_stats(struct heif_image_cache_stats* stats) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  stats->hits = m_hits;
+  stats->misses = m_misses;
+  stats->evictions = m_evictions;
+  stats->num_images = m_entries.size();
+  stats->bytes_used = m_bytes_used;
+  stats->bytes_budget = m_budget;
+}
+
+
+
+ParsedFileCache& ParsedFileCache::get_instance()
+{
+  static ParsedFileCache cache;
+  return cache;
+}
+
+
+std::shared_ptr<const ParsedFile> ParsedFileCache::lookup(const FileIdentity& file)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto iter = m_entries.find(file);
+  if (iter == m_entries.end()) {
+    m_misses++;
+    return nullptr;
+  }
+
+  // move to front of LRU list
+  m_lru.splice(m_lru.begin(), m_lru, iter->second);
+
+  m_hits++;
+
+  return iter->second->parsed;
+}
+
+
+void ParsedFileCache::insert(const FileIdentity& file, const std::shared_ptr<const ParsedFile>& parsed)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_capacity == 0 || m_entries.find(file) != m_entries.end()) {
+    return;
+  }
+
+  evict_to_capacity(m_capacity - 1);
+
+  Entry entry;
+  entry.file = file;
+  entry.parsed = parsed;
+
+  m_lru.push_front(entry);
+  m_entries[file] = m_lru.begin();
+}
+
+
+void ParsedFileCache::evict_to_capacity(size_t capacity)
+{
+  while (m_entries.size() > capacity) {
+    m_entries.erase(m_lru.back().file);
+    m_lru.pop_back();
+
+    m_evictions++;
+  }
+}
+
+
+void ParsedFileCache::set_capacity(size_t max_files)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_capacity = max_files;
+  evict_to_capacity(m_capacity);
+}
+
+
+size_t ParsedFileCache::get_capacity() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_capacity;
+}
+
+
+void ParsedFileCache::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_lru.clear();
+  m_entries.clear();
+}
+
+
+void ParsedFileCache::get_stats(struct heif_parsed_file_cache_stats* stats) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  stats->hits = m_hits;
+  stats->misses = m_misses;
+  stats->evictions = m_evictions;
+  stats->num_files = m_entries.size();
+  stats->capacity = m_capacity;
+}
@@ -0,0 +1,171 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_CACHE_H
+#define LIBHEIF_HEIF_CACHE_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "heif.h"
+#include "heif_image.h"
+
+
+namespace heif {
+
+  // Identifies the content of an input file, so that data derived from it
+  // can be shared between contexts reading the same file.
+  class FileIdentity {
+  public:
+    // (device, inode, size, mtime) of a file on disk
+    static FileIdentity from_file(const char* filename);
+
+    // SHA-256 over the content of a memory block
+    static FileIdentity from_memory(const void* data, size_t size);
+
+    bool is_valid() const { return m_valid; }
+
+    uint64_t get_size() const { return m_size; }
+    int64_t get_mtime_sec() const { return m_mtime_sec; }
+    int64_t get_mtime_nsec() const { return m_mtime_nsec; }
+
+    bool operator<(const FileIdentity& other) const;
+    bool operator==(const FileIdentity& other) const;
+
+  private:
+    bool m_valid = false;
+
+    uint64_t m_device = 0;
+    uint64_t m_inode = 0;
+    uint64_t m_size = 0;
+    int64_t  m_mtime_sec = 0;
+    int64_t  m_mtime_nsec = 0;
+    uint8_t  m_content_hash[32] = { 0 };
+  };
+
+
+  // Process-wide LRU cache of decoded images, limited by a memory budget.
+  // Cached images are immutable and shared with all users by reference count,
+  // evicting an image only drops the cache's own reference. The memory of inserted
+  // images is charged to the cache's own account instead of the decoding handle's.
+  // Handles charge it to themselves while they hold a cached image (see
+  // HeifContext::attach_decoded_image()).
+  class ImageCache {
+  public:
+    struct Key {
+      FileIdentity file;
+      heif_image_id image_id;
+      uint64_t options; // decoding options that change the decoded pixels
+
+      bool operator<(const Key& other) const;
+    };
+
+    static ImageCache& get_instance();
+
+    bool lookup(const Key& key, std::shared_ptr<const HeifPixelImage>* out_image);
+
+    void insert(const Key& key, const std::shared_ptr<const HeifPixelImage>& image);
+
+    void set_budget(size_t bytes);
+
+    size_t get_budget() const;
+
+    void clear();
+
+    void get_stats(struct heif_image_cache_stats* stats) const;
+
+  private:
+    ImageCache();
+
+    struct Entry {
+      Key key;
+      std::shared_ptr<const HeifPixelImage> image;
+      size_t size;
+    };
+
+    mutable std::mutex m_mutex;
+
+    // without limit, the budget is enforced by eviction
+    std::shared_ptr<MemoryAccount> m_account;
+
+    // most recently used image at the front
+    std::list<Entry> m_lru;
+    std::map<Key, std::list<Entry>::iterator> m_entries;
+
+    size_t m_budget = 0;
+    size_t m_bytes_used = 0;
+
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_evictions = 0;
+
+    void evict_to_budget(size_t budget);
+  };
+
+
+  struct ParsedFile;  // defined in heif_context.h
+
+  // Process-wide LRU cache of parsed file structures, limited by the number of files.
+  // Opening a file that is in the cache attaches to the shared ParsedFile instead
+  // of parsing the boxes and interpreting the image structure again.
+  class ParsedFileCache {
+  public:
+    static ParsedFileCache& get_instance();
+
+    std::shared_ptr<const ParsedFile> lookup(const FileIdentity& file);
+
+    void insert(const FileIdentity& file, const std::shared_ptr<const ParsedFile>& parsed);
+
+    void set_capacity(size_t max_files);
+
+    size_t get_capacity() const;
+
+    void clear();
+
+    void get_stats(struct heif_parsed_file_cache_stats* stats) const;
+
+  private:
+    ParsedFileCache() { }
+
+    struct Entry {
+      FileIdentity file;
+      std::shared_ptr<const ParsedFile> parsed;
+    };
+
+    mutable std::mutex m_mutex;
+
+    // most recently used file at the front
+    std::list<Entry> m_lru;
+    std::map<FileIdentity, std::list<Entry>::iterator> m_entries;
+
+    size_t m_capacity = 0;
+
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_evictions = 0;
+
+    void evict_to_capacity(size_t capacity);
+  };
+
+}
+
+#endif
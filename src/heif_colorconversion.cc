@@ -0,0 +1,409 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_colorconversion.h"
+#include "heif_colormanagement.h"
+#include "heif_threads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+using namespace heif;
+
+
+static inline uint8_t clip_to_uint8(int v)
+{
+  return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+
+// --- premultiplication
+
+// c * a / 255, rounded, without a division: with t = c*a + 128, (t + (t >> 8)) >> 8
+
+#if defined(__SSE2__)
+// two RGBA pixels, one component per 16-bit lane
+static inline __m128i premultiply_2_pixels(__m128i px, __m128i round, __m128i alpha_lanes)
+{
+  __m128i a = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3,3,3,3));
+  a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3,3,3,3));
+
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), round);
+  t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+  // keep the alpha component itself
+  return _mm_or_si128(_mm_andnot_si128(alpha_lanes, t),
+                      _mm_and_si128(alpha_lanes, px));
+}
+#endif
+
+
+void heif::premultiply_alpha_rgba(uint8_t* rgba, int num_pixels)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi16(128);
+  const __m128i alpha_lanes = _mm_set_epi16(-1,0,0,0, -1,0,0,0);
+
+  for (; i + 4 <= num_pixels; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(rgba + 4*i));
+
+    __m128i lo = premultiply_2_pixels(_mm_unpacklo_epi8(v, zero), round, alpha_lanes);
+    __m128i hi = premultiply_2_pixels(_mm_unpackhi_epi8(v, zero), round, alpha_lanes);
+
+    _mm_storeu_si128((__m128i*)(rgba + 4*i), _mm_packus_epi16(lo, hi));
+  }
+#endif
+
+  for (; i < num_pixels; i++) {
+    uint8_t* p = rgba + 4*i;
+    int a = p[3];
+
+    for (int c=0;c<3;c++) {
+      int t = p[c] * a + 128;
+      p[c] = (uint8_t)((t + (t >> 8)) >> 8);
+    }
+  }
+}
+
+
+// --- YCbCr to RGB
+
+namespace {
+  // fixed point conversion factors, 16 fractional bits
+  struct RGBCoefficients {
+    int luma_offset;
+    int luma_scale;
+    int cr_to_r;
+    int cb_to_g;
+    int cr_to_g;
+    int cb_to_b;
+  };
+}
+
+
+static RGBCoefficients get_rgb_coefficients(const YCbCrCoding& coding)
+{
+  double kr, kb;
+
+  switch (coding.matrix_coefficients) {
+  case 1:  // BT.709
+    kr = 0.2126; kb = 0.0722;
+    break;
+  case 4:  // FCC
+    kr = 0.30; kb = 0.11;
+    break;
+  case 7:  // SMPTE 240M
+    kr = 0.212; kb = 0.087;
+    break;
+  case 9:  // BT.2020, the constant luminance variant is approximated
+  case 10:
+    kr = 0.2627; kb = 0.0593;
+    break;
+  default:  // BT.601
+    kr = 0.299; kb = 0.114;
+    break;
+  }
+
+  double kg = 1.0 - kr - kb;
+
+  // limited range: luma in [16,235], chroma in [16,240]
+  double luma_scale = coding.full_range ? 1.0 : 255.0 / 219.0;
+  double chroma_scale = coding.full_range ? 1.0 : 255.0 / 224.0;
+
+  RGBCoefficients c;
+  c.luma_offset = coding.full_range ? 0 : 16;
+  c.luma_scale = (int)lround(65536 * luma_scale);
+  c.cr_to_r = (int)lround(65536 * chroma_scale * 2 * (1 - kr));
+  c.cb_to_g = (int)lround(65536 * chroma_scale * 2 * kb * (1 - kb) / kg);
+  c.cr_to_g = (int)lround(65536 * chroma_scale * 2 * kr * (1 - kr) / kg);
+  c.cb_to_b = (int)lround(65536 * chroma_scale * 2 * (1 - kb));
+  return c;
+}
+
+
+namespace {
+  // State of one conversion to RGB(A), shared by the threads converting its bands.
+  struct RGBConversion {
+    int width;
+    int height;
+    int bpp;
+
+    uint8_t* out;
+    int out_stride;
+
+    const uint8_t* plane_y;
+    const uint8_t* plane_cb;
+    const uint8_t* plane_cr;
+    int stride_y;
+    int stride_cb;
+    int stride_cr;
+
+    bool monochrome;
+    int shift_x;
+    int shift_y;
+
+    const HeifPixelImage* alpha;
+    const uint8_t* plane_a;
+    int stride_a;
+    bool premultiply_alpha;
+
+    bool full_range;
+    bool identity;  // matrix 0: the planes are G, B, R
+    RGBCoefficients c;
+
+    const ColorTransform* transform;
+
+    int band_height;
+    int num_bands;
+    std::atomic<int> next_band;
+
+    void convert_row(int y);
+
+    void convert_band(int band);
+
+    // convert bands until none are left
+    void run_bands();
+  };
+}
+
+
+void RGBConversion::convert_row(int y)
+{
+  const int luma_offset = c.luma_offset;
+  const int luma_scale = c.luma_scale;
+  const int cr_to_r = c.cr_to_r;
+  const int cb_to_g = c.cb_to_g;
+  const int cr_to_g = c.cr_to_g;
+  const int cb_to_b = c.cb_to_b;
+
+  const uint8_t* row_y = plane_y + y*stride_y;
+  uint8_t* row_out = out + y*out_stride;
+
+  if (monochrome) {
+    if (full_range) {
+      for (int x=0;x<width;x++) {
+        row_out[x*bpp+0] = row_out[x*bpp+1] = row_out[x*bpp+2] = row_y[x];
+      }
+    }
+    else {
+      for (int x=0;x<width;x++) {
+        uint8_t v = clip_to_uint8(((row_y[x] - luma_offset) * luma_scale + (1 << 15)) >> 16);
+        row_out[x*bpp+0] = row_out[x*bpp+1] = row_out[x*bpp+2] = v;
+      }
+    }
+  }
+  else if (identity) {
+    const uint8_t* row_cb = plane_cb + (y >> shift_y)*stride_cb;
+    const uint8_t* row_cr = plane_cr + (y >> shift_y)*stride_cr;
+
+    for (int x=0;x<width;x++) {
+      row_out[x*bpp+0] = clip_to_uint8(((row_cr[x >> shift_x] - luma_offset) * luma_scale + (1 << 15)) >> 16);
+      row_out[x*bpp+1] = clip_to_uint8(((row_y[x] - luma_offset) * luma_scale + (1 << 15)) >> 16);
+      row_out[x*bpp+2] = clip_to_uint8(((row_cb[x >> shift_x] - luma_offset) * luma_scale + (1 << 15)) >> 16);
+    }
+  }
+  else {
+    const uint8_t* row_cb = plane_cb + (y >> shift_y)*stride_cb;
+    const uint8_t* row_cr = plane_cr + (y >> shift_y)*stride_cr;
+
+    for (int x=0;x<width;x++) {
+      int luma = (row_y[x] - luma_offset) * luma_scale + (1 << 15);
+      int cb = row_cb[x >> shift_x] - 128;
+      int cr = row_cr[x >> shift_x] - 128;
+
+      row_out[x*bpp+0] = clip_to_uint8((luma + cr_to_r * cr) >> 16);
+      row_out[x*bpp+1] = clip_to_uint8((luma - cb_to_g * cb - cr_to_g * cr) >> 16);
+      row_out[x*bpp+2] = clip_to_uint8((luma + cb_to_b * cb) >> 16);
+    }
+  }
+
+  if (bpp == 4) {
+    if (plane_a) {
+      int ay = (int)((int64_t)y * alpha->get_height() / height);
+      const uint8_t* row_a = plane_a + ay*stride_a;
+
+      if (alpha->get_width() == width) {
+        for (int x=0;x<width;x++) {
+          row_out[x*4+3] = row_a[x];
+        }
+      }
+      else {
+        // alpha column x * alpha_width / width, stepped incrementally
+        int alpha_width = alpha->get_width();
+        int ax = 0, remainder = 0;
+
+        for (int x=0;x<width;x++) {
+          row_out[x*4+3] = row_a[ax];
+
+          remainder += alpha_width;
+          while (remainder >= width) {
+            remainder -= width;
+            ax++;
+          }
+        }
+      }
+    }
+    else {
+      for (int x=0;x<width;x++) {
+        row_out[x*4+3] = 0xFF;
+      }
+    }
+  }
+}
+
+
+void RGBConversion::convert_band(int band)
+{
+  int y0 = band * band_height;
+  int y1 = std::min(y0 + band_height, height);
+
+  // The colour transform and premultiplication run while the band is still in the cache.
+  // Premultiplication comes last, the transform needs the unassociated colour.
+  bool premultiply = (premultiply_alpha && plane_a);
+
+  for (int y=y0;y<y1;y++) {
+    convert_row(y);
+
+    if (premultiply && !transform) {
+      premultiply_alpha_rgba(out + y*out_stride, width);
+    }
+  }
+
+  if (transform) {
+    transform->apply(out + y0*out_stride, width, y1 - y0, out_stride);
+
+    if (premultiply) {
+      for (int y=y0;y<y1;y++) {
+        premultiply_alpha_rgba(out + y*out_stride, width);
+      }
+    }
+  }
+}
+
+
+void RGBConversion::run_bands()
+{
+  for (;;) {
+    int band = next_band.fetch_add(1);
+    if (band >= num_bands) {
+      return;
+    }
+
+    convert_band(band);
+  }
+}
+
+
+// Bands of about this many output bytes stay in the L2 cache between the passes over them.
+static const int kBandBytes = 128 * 1024;
+
+
+Error heif::convert_to_rgb(const HeifPixelImage& ycbcr, const HeifPixelImage* alpha,
+                           heif_chroma output_chroma, bool premultiply_alpha,
+                           std::shared_ptr<HeifPixelImage>* out_img,
+                           const std::shared_ptr<MemoryAccount>& account,
+                           const PlaneLayout& layout,
+                           const YCbCrCoding& coding,
+                           const ColorTransform* transform)
+{
+  heif_chroma chroma = ycbcr.get_chroma_format();
+
+  if ((output_chroma != heif_chroma_interleaved_24bit &&
+       output_chroma != heif_chroma_interleaved_32bit) ||
+      HeifPixelImage::get_bytes_per_pixel(chroma) != 1) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion);
+  }
+
+  int width = ycbcr.get_width();
+  int height = ycbcr.get_height();
+  int bpp = HeifPixelImage::get_bytes_per_pixel(output_chroma);
+
+  auto img = HeifPixelImage::new_image(account);
+  Error err = img->create(width, height, output_chroma, account, layout);
+  if (err) {
+    return err;
+  }
+
+  RGBConversion conv;
+  conv.width = width;
+  conv.height = height;
+  conv.bpp = bpp;
+  conv.out = img->get_plane(0, &conv.out_stride);
+
+  conv.plane_y = ycbcr.get_plane(0, &conv.stride_y);
+  conv.plane_cb = nullptr;
+  conv.plane_cr = nullptr;
+  conv.stride_cb = conv.stride_cr = 0;
+
+  conv.monochrome = (chroma == heif_chroma_monochrome);
+  conv.shift_x = conv.shift_y = 0;
+  if (!conv.monochrome) {
+    conv.plane_cb = ycbcr.get_plane(1, &conv.stride_cb);
+    conv.plane_cr = ycbcr.get_plane(2, &conv.stride_cr);
+    HeifPixelImage::get_subsampling(chroma, 1, &conv.shift_x, &conv.shift_y);
+  }
+
+  conv.alpha = alpha;
+  conv.plane_a = nullptr;
+  conv.stride_a = 0;
+  if (alpha && bpp == 4) {
+    conv.plane_a = alpha->get_plane(0, &conv.stride_a);
+  }
+  conv.premultiply_alpha = premultiply_alpha;
+
+  conv.full_range = coding.full_range;
+  conv.identity = (coding.matrix_coefficients == 0);
+  conv.c = get_rgb_coefficients(coding);
+
+  conv.transform = transform;
+
+  conv.band_height = std::max(1, kBandBytes / std::max(1, width * bpp));
+  conv.num_bands = (height + conv.band_height - 1) / conv.band_height;
+  conv.next_band = 0;
+
+  if (conv.num_bands > 1) {
+    ThreadPool& pool = ThreadPool::get_instance();
+    int num_tasks = std::min(pool.get_num_threads(), conv.num_bands - 1);
+
+    TaskGroup tasks(pool);
+    for (int i=0;i<num_tasks;i++) {
+      tasks.add_task([&conv]() { conv.run_bands(); });
+    }
+
+    conv.run_bands();
+    tasks.wait();
+  }
+  else {
+    conv.run_bands();
+  }
+
+  *out_img = img;
+  return Error::Ok;
+}
@@ -0,0 +1,61 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_COLORCONVERSION_H
+#define LIBHEIF_HEIF_COLORCONVERSION_H
+
+#include "heif_image.h"
+
+#include <memory>
+
+
+namespace heif {
+
+  class ColorTransform;
+
+  // How the YCbCr samples are coded: the matrix coefficients (ISO/IEC 23091-2 code,
+  // from 'nclx' or the HEVC VUI) and whether they use the full range of 8 bits.
+  struct YCbCrCoding {
+    uint16_t matrix_coefficients = 6;  // BT.601
+    bool full_range = true;
+  };
+
+  // Convert a planar YCbCr or monochrome image to interleaved RGB or RGBA
+  // (heif_chroma_interleaved_24bit / heif_chroma_interleaved_32bit) with the given coding.
+  // Matrices without fixed coefficients (unspecified, chromaticity derived) use BT.601.
+  // The first plane of 'alpha' (may be NULL) becomes the alpha channel of RGBA output.
+  // It is scaled with nearest neighbour sampling if its size differs from the image.
+  // Without alpha, RGBA output is opaque. The output is charged to 'account', if given,
+  // and stored with the given plane layout. 'transform' (may be NULL) is applied to the
+  // RGB values. Large images are converted in bands of rows on the library's thread pool.
+  Error convert_to_rgb(const HeifPixelImage& ycbcr, const HeifPixelImage* alpha,
+                       heif_chroma output_chroma, bool premultiply_alpha,
+                       std::shared_ptr<HeifPixelImage>* out_img,
+                       const std::shared_ptr<MemoryAccount>& account = nullptr,
+                       const PlaneLayout& layout = PlaneLayout(),
+                       const YCbCrCoding& coding = YCbCrCoding(),
+                       const ColorTransform* transform = nullptr);
+
+  // Multiply the colour components of 'num_pixels' RGBA pixels with their alpha value.
+  void premultiply_alpha_rgba(uint8_t* rgba, int num_pixels);
+
+}
+
+#endif
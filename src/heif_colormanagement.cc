@@ -0,0 +1,218 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_colormanagement.h"
+
+#if HAVE_LCMS2
+#include <lcms2.h>
+#endif
+
+
+using namespace heif;
+
+
+#if HAVE_LCMS2
+
+ColorTransform::~ColorTransform()
+{
+  if (m_transform) {
+    cmsDeleteTransform((cmsHTRANSFORM)m_transform);
+  }
+}
+
+
+void ColorTransform::apply(uint8_t* pixels, int width, int num_rows, int stride) const
+{
+  cmsDoTransformLineStride((cmsHTRANSFORM)m_transform, pixels, pixels,
+                           width, num_rows, stride, stride, 0, 0);
+}
+
+
+bool heif::is_color_management_available()
+{
+  return true;
+}
+
+
+static Error create_transform(const std::vector<uint8_t>& icc_profile, heif_chroma chroma,
+                              void** out_transform)
+{
+  cmsHPROFILE input = cmsOpenProfileFromMem(icc_profile.data(),
+                                            (cmsUInt32Number)icc_profile.size());
+  if (!input) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_Unsupported_color_conversion,
+                 "Invalid ICC profile");
+  }
+
+  if (cmsGetColorSpace(input) != cmsSigRgbData) {
+    cmsCloseProfile(input);
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion,
+                 "ICC profile is not an RGB profile");
+  }
+
+  cmsHPROFILE srgb = cmsCreate_sRGBProfile();
+
+  // Without the pixel cache, the transform can be used from several threads.
+  cmsUInt32Number format = (chroma == heif_chroma_interleaved_32bit ? TYPE_RGBA_8 : TYPE_RGB_8);
+  cmsUInt32Number flags = cmsFLAGS_NOCACHE;
+  if (chroma == heif_chroma_interleaved_32bit) {
+    flags |= cmsFLAGS_COPY_ALPHA;
+  }
+
+  cmsHTRANSFORM transform = cmsCreateTransform(input, format, srgb, format,
+                                               INTENT_PERCEPTUAL, flags);
+
+  cmsCloseProfile(srgb);
+  cmsCloseProfile(input);
+
+  if (!transform) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion,
+                 "Cannot create a transform for the ICC profile");
+  }
+
+  *out_transform = transform;
+  return Error::Ok;
+}
+
+#else
+
+ColorTransform::~ColorTransform()
+{
+}
+
+
+void ColorTransform::apply(uint8_t*, int, int, int) const
+{
+}
+
+
+bool heif::is_color_management_available()
+{
+  return false;
+}
+
+
+static Error create_transform(const std::vector<uint8_t>&, heif_chroma, void**)
+{
+  return Error(heif_error_Unsupported_feature,
+               heif_suberror_Unsupported_color_conversion,
+               "Built without colour management (lcms2)");
+}
+
+#endif
+
+
+bool ColorTransformCache::Key::operator<(const Key& other) const
+{
+  if (chroma != other.chroma) return chroma < other.chroma;
+  return profile < other.profile;
+}
+
+
+ColorTransformCache& ColorTransformCache::get_instance()
+{
+  static ColorTransformCache cache;
+  return cache;
+}
+
+
+Error ColorTransformCache::get_transform(const std::vector<uint8_t>& icc_profile, heif_chroma chroma,
+                                         std::shared_ptr<const ColorTransform>* out_transform)
+{
+  if (chroma != heif_chroma_interleaved_24bit &&
+      chroma != heif_chroma_interleaved_32bit) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unsupported_color_conversion);
+  }
+
+  Key key;
+  key.profile = FileIdentity::from_memory(icc_profile.data(), icc_profile.size());
+  key.chroma = chroma;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto iter = m_entries.find(key);
+    if (iter != m_entries.end()) {
+      // move to front of LRU list
+      m_lru.splice(m_lru.begin(), m_lru, iter->second);
+
+      *out_transform = iter->second->transform;
+      return Error::Ok;
+    }
+  }
+
+  // Create the transform without holding the lock. If two threads miss at the
+  // same time, both create it and the second one is not inserted.
+  std::shared_ptr<ColorTransform> transform(new ColorTransform);
+
+  Error err = create_transform(icc_profile, chroma, &transform->m_transform);
+  if (err) {
+    return err;
+  }
+
+  *out_transform = transform;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_capacity == 0 || m_entries.find(key) != m_entries.end()) {
+    return Error::Ok;
+  }
+
+  evict_to_capacity(m_capacity - 1);
+
+  Entry entry;
+  entry.key = key;
+  entry.transform = transform;
+
+  m_lru.push_front(entry);
+  m_entries[key] = m_lru.begin();
+
+  return Error::Ok;
+}
+
+
+void ColorTransformCache::evict_to_capacity(size_t capacity)
+{
+  while (m_entries.size() > capacity) {
+    m_entries.erase(m_lru.back().key);
+    m_lru.pop_back();
+  }
+}
+
+
+void ColorTransformCache::set_capacity(size_t max_transforms)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_capacity = max_transforms;
+  evict_to_capacity(m_capacity);
+}
+
+
+void ColorTransformCache::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  evict_to_capacity(0);
+}
@@ -0,0 +1,104 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_COLORMANAGEMENT_H
+#define LIBHEIF_HEIF_COLORMANAGEMENT_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "error.h"
+#include "heif.h"
+#include "heif_cache.h"
+
+
+namespace heif {
+
+  // Transform of interleaved 8-bit RGB or RGBA pixels from an ICC profile to sRGB.
+  // Alpha is copied unchanged. It may be applied from several threads at the same time.
+  class ColorTransform {
+  public:
+    ~ColorTransform();
+
+    // Transform 'num_rows' rows of 'width' pixels in place.
+    void apply(uint8_t* pixels, int width, int num_rows, int stride) const;
+
+  private:
+    friend class ColorTransformCache;
+
+    ColorTransform() { }
+
+    void* m_transform = nullptr;  // cmsHTRANSFORM
+  };
+
+
+  // Whether the library was built with colour management (lcms2).
+  bool is_color_management_available();
+
+
+  // Process-wide LRU cache of ICC to sRGB transforms, keyed by a hash of the profile
+  // and the pixel format. Creating a transform is expensive compared to applying it
+  // to a typical image, files from the same camera share it.
+  class ColorTransformCache {
+  public:
+    static ColorTransformCache& get_instance();
+
+    // Transform from 'icc_profile' to sRGB for heif_chroma_interleaved_24bit or
+    // heif_chroma_interleaved_32bit pixels. Fails without lcms2 or for profiles
+    // that are not RGB.
+    Error get_transform(const std::vector<uint8_t>& icc_profile, heif_chroma chroma,
+                        std::shared_ptr<const ColorTransform>* out_transform);
+
+    void set_capacity(size_t max_transforms);
+
+    void clear();
+
+  private:
+    ColorTransformCache() { }
+
+    struct Key {
+      FileIdentity profile;
+      heif_chroma chroma;
+
+      bool operator<(const Key& other) const;
+    };
+
+    struct Entry {
+      Key key;
+      std::shared_ptr<const ColorTransform> transform;
+    };
+
+    std::mutex m_mutex;
+
+    // most recently used transform at the front
+    std::list<Entry> m_lru;
+    std::map<Key, std::list<Entry>::iterator> m_entries;
+
+    size_t m_capacity = 16;
+
+    void evict_to_capacity(size_t capacity);
+  };
+
+}
+
+#endif
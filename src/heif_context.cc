@@ -19,8 +19,21 @@
  */
 
 #include "heif_context.h"
+#include "heif_colorconversion.h"
+#include "heif_colormanagement.h"
+#include "heif_depth.h"
+#include "heif_index.h"
+#include "heif_plugin_registry.h"
+#include "heif_push_parser.h"
+#include "heif_remux.h"
+#include "heif_threads.h"
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <new>
+#include <set>
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 
@@ -66,7 +79,12 @@ static uint32_t readvec(const std::vector<uint8_t>& data,int& ptr,int len)
 class ImageGrid
 {
 public:
-  Error parse(const std::vector<uint8_t>& data);
+  Error parse(const std::vector<uint8_t>& data) { return parse(data.data(), data.size()); }
+
+  Error parse(const uint8_t* data, size_t size);
+
+  // Read and parse the data of the grid item 'ID', without allocating in the usual case.
+  Error read(const HeifFile& file, heif_image_id ID);
 
   std::string dump() const;
 
@@ -83,9 +101,9 @@ private:
 };
 
 
-Error ImageGrid::parse(const std::vector<uint8_t>& data)
+Error ImageGrid::parse(const uint8_t* data, size_t size)
 {
-  if (data.size() < 8) {
+  if (size < 8) {
     return Error(heif_error_Invalid_input,
                  heif_suberror_Invalid_grid_data,
                  "Less than 8 bytes of data");
@@ -101,7 +119,7 @@ Error ImageGrid::parse(const std::vector<uint8_t>& data)
   m_columns = static_cast<uint16_t>(data[3] +1);
 
   if (field_size == 32) {
-    if (data.size() < 12) {
+    if (size < 12) {
       return Error(heif_error_Invalid_input,
                    heif_suberror_Invalid_grid_data,
                    "Grid image data incomplete");
@@ -129,6 +147,36 @@ Error ImageGrid::parse(const std::vector<uint8_t>& data)
 }
 
 
+Error ImageGrid::read(const HeifFile& file, heif_image_id ID)
+{
+  // the grid data has 8 or 12 bytes
+  uint8_t data[32];
+
+  uint64_t size;
+  Error err = file.get_compressed_image_data_size(ID, &size);
+  if (err) {
+    return err;
+  }
+
+  if (size > sizeof(data)) {
+    std::vector<uint8_t> grid_data;
+    err = file.get_compressed_image_data(ID, &grid_data);
+    if (err) {
+      return err;
+    }
+
+    return parse(grid_data);
+  }
+
+  err = file.read_compressed_image_data(ID, data);
+  if (err) {
+    return err;
+  }
+
+  return parse(data, (size_t)size);
+}
+
+
 std::string ImageGrid::dump() const
 {
   std::ostringstream sstr;
@@ -265,6 +313,8 @@ void ImageOverlay::get_offset(size_t image_index, int32_t* x, int32_t* y) const
 
 
 HeifContext::HeifContext()
+  : m_limits(get_default_resource_limits()),
+    m_memory_account(std::make_shared<MemoryAccount>())
 {
 }
 
@@ -274,26 +324,454 @@ HeifContext::~HeifContext()
 
 Error HeifContext::read_from_file(const char* input_filename)
 {
+  m_file_identity = FileIdentity::from_file(input_filename);
+
+  if (attach_parsed_file()) {
+    return Error::Ok;
+  }
+
   m_heif_file = std::make_shared<HeifFile>();
+  m_heif_file->set_limits(m_limits);
   Error err = m_heif_file->read_from_file(input_filename);
   if (err) {
     return err;
   }
 
-  return interpret_heif_file();
+  err = interpret_heif_file();
+  if (err) {
+    return err;
+  }
+
+  store_parsed_file();
+
+  return Error::Ok;
+}
+
+Error HeifContext::read_from_file_with_index(const char* input_filename, const char* index_filename)
+{
+  m_file_identity = FileIdentity::from_file(input_filename);
+  if (!m_file_identity.is_valid()) {
+    return Error(heif_error_Input_does_not_exist,
+                 heif_suberror_Unspecified);
+  }
+
+  if (attach_parsed_file()) {
+    return Error::Ok;
+  }
+
+  m_heif_file = std::make_shared<HeifFile>();
+  m_heif_file->set_limits(m_limits);
+
+  heif_image_id primary_ID;
+  std::map<heif_image_id, HeifFile::Item> items;
+
+  Error err = read_index_file(index_filename, m_file_identity, &primary_ID, &items);
+  if (!err) {
+    err = m_heif_file->read_from_file(input_filename, primary_ID, std::move(items));
+  }
+  else {
+    err = m_heif_file->read_from_file(input_filename);
+    if (!err) {
+      // The index only speeds up the next open, failing to write it is not an error.
+      write_index_file(index_filename, m_file_identity, *m_heif_file);
+    }
+  }
+
+  if (err) {
+    return err;
+  }
+
+  err = interpret_heif_file();
+  if (err) {
+    return err;
+  }
+
+  store_parsed_file();
+
+  return Error::Ok;
 }
 
+
 Error HeifContext::read_from_memory(const void* data, size_t size)
 {
+  // Hashing the content is only worth it when one of the caches is enabled.
+  if (ImageCache::get_instance().get_budget() > 0 ||
+      ParsedFileCache::get_instance().get_capacity() > 0) {
+    m_file_identity = FileIdentity::from_memory(data, size);
+  }
+  else {
+    m_file_identity = FileIdentity();
+  }
+
+  if (attach_parsed_file()) {
+    return Error::Ok;
+  }
+
   m_heif_file = std::make_shared<HeifFile>();
+  m_heif_file->set_limits(m_limits);
   Error err = m_heif_file->read_from_memory(data,size);
   if (err) {
     return err;
   }
 
+  err = interpret_heif_file();
+  if (err) {
+    return err;
+  }
+
+  store_parsed_file();
+
+  return Error::Ok;
+}
+
+
+Error HeifContext::read_from_push_parser(const HeifPushParser& parser)
+{
+  if (!parser.has_ftyp() || !parser.has_meta()) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "The ftyp and meta boxes have not been received yet");
+  }
+
+  // The content is not known yet, the file cannot be shared through the caches.
+  m_file_identity = FileIdentity();
+
+  m_heif_file = std::make_shared<HeifFile>();
+  m_heif_file->set_limits(m_limits);
+  Error err = m_heif_file->read_from_push_input(parser.get_input(), parser.get_meta_end());
+  if (err) {
+    return err;
+  }
+
   return interpret_heif_file();
 }
 
+
+bool HeifContext::is_image_data_available(heif_image_id ID) const
+{
+  std::set<heif_image_id> visited;
+
+  std::function<bool(heif_image_id)> is_available = [&](heif_image_id ID) -> bool {
+    if (!visited.insert(ID).second) {
+      return true;
+    }
+
+    if (!m_heif_file->is_item_data_available(ID)) {
+      return false;
+    }
+
+    const HeifFile::Item* item = m_heif_file->get_item(ID);
+    if (item && item->reference_type == fourcc("dimg")) {
+      for (heif_image_id ref : item->references) {
+        if (!is_available(ref)) {
+          return false;
+        }
+      }
+    }
+
+    return true;
+  };
+
+  if (!is_available(ID)) {
+    return false;
+  }
+
+  auto image = m_all_images.find(ID);
+  if (image != m_all_images.end() && image->second->get_alpha_channel()) {
+    return is_available(image->second->get_alpha_channel()->get_id());
+  }
+
+  return true;
+}
+
+
+int HeifContext::get_available_tile_rows(heif_image_id ID) const
+{
+  const HeifFile::Item* item = m_heif_file->get_item(ID);
+  if (!item) {
+    return 0;
+  }
+
+  if (item->item_type != "grid") {
+    return is_image_data_available(ID) ? 1 : 0;
+  }
+
+  ImageGrid grid;
+  if (!m_heif_file->is_item_data_available(ID) ||
+      grid.read(*m_heif_file, ID) ||
+      grid.get_columns() == 0) {
+    return 0;
+  }
+
+  size_t num_tiles = std::min(item->references.size(),
+                              (size_t)grid.get_rows() * grid.get_columns());
+
+  size_t available = 0;
+  while (available < num_tiles && m_heif_file->is_item_data_available(item->references[available])) {
+    available++;
+  }
+
+  return (int)(available / grid.get_columns());
+}
+
+
+Error HeifContext::get_fetch_ranges(heif_image_id ID, heif_fetch_target target,
+                                    const heif_fetch_region* region, uint64_t merge_gap,
+                                    std::vector<heif_byte_range>* ranges) const
+{
+  if (!m_heif_file) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "No file has been read");
+  }
+
+  std::vector<heif_byte_range> needed;
+
+  if (target == heif_fetch_target_probe) {
+    // 'ftyp' and 'meta' in full, and the headers of the boxes in between that are skipped
+
+    uint64_t pos = 0;
+    for (const auto& box : m_heif_file->get_top_level_boxes()) {
+      uint32_t type = box->get_short_type();
+      if (type == fourcc("ftyp") || type == fourcc("meta")) {
+        m_heif_file->get_ranges_to_fetch(pos, box->get_box_size(), &needed);
+      }
+      else {
+        m_heif_file->get_ranges_to_fetch(pos, box->get_header_size(), &needed);
+      }
+
+      if (type == fourcc("meta")) {
+        break;
+      }
+
+      pos += box->get_box_size();
+    }
+  }
+  else {
+    auto image = m_all_images.find(ID);
+    if (image == m_all_images.end()) {
+      return Error(heif_error_Usage_error,
+                   heif_suberror_Nonexisting_image_referenced);
+    }
+
+    std::shared_ptr<Image> img = image->second;
+    if (target == heif_fetch_target_thumbnail) {
+      if (img->get_thumbnails().empty()) {
+        return Error(heif_error_Usage_error,
+                     heif_suberror_Nonexisting_image_referenced,
+                     "Image has no thumbnail");
+      }
+
+      img = img->get_thumbnails()[0];
+    }
+
+    heif_fetch_region full_region;
+    const heif_fetch_region* clip = nullptr;
+
+    if (target == heif_fetch_target_region) {
+      if (!region || region->width <= 0 || region->height <= 0) {
+        return Error(heif_error_Usage_error,
+                     heif_suberror_Unspecified,
+                     "Invalid fetch region");
+      }
+
+      clip = region;
+    }
+
+    std::set<heif_image_id> visited;
+
+    // Collect the ranges of an item and of the items it is derived from. Only the grid tiles
+    // overlapping 'item_clip' are needed, if it is set.
+    std::function<void(heif_image_id, const heif_fetch_region*)> add_item =
+      [&](heif_image_id itemID, const heif_fetch_region* item_clip) {
+      if (!visited.insert(itemID).second) {
+        return;
+      }
+
+      const HeifFile::Item* item = m_heif_file->get_item(itemID);
+      if (!item) {
+        return;
+      }
+
+      for (const auto& extent : item->extents) {
+        m_heif_file->get_ranges_to_fetch(extent.offset, extent.length, &needed);
+      }
+
+      if (item->reference_type != fourcc("dimg")) {
+        return;
+      }
+
+      ImageGrid grid;
+      if (item->item_type == "grid" && item_clip &&
+          m_heif_file->is_item_data_available(itemID) &&
+          !grid.read(*m_heif_file, itemID) &&
+          grid.get_columns() > 0 && grid.get_rows() > 0) {
+        const HeifFile::Item* first_tile = m_heif_file->get_item(item->references[0]);
+
+        uint32_t tile_width = (grid.get_width() + grid.get_columns() - 1) / grid.get_columns();
+        uint32_t tile_height = (grid.get_height() + grid.get_rows() - 1) / grid.get_rows();
+        if (first_tile && first_tile->has_ispe &&
+            first_tile->ispe_width > 0 && first_tile->ispe_height > 0) {
+          tile_width = first_tile->ispe_width;
+          tile_height = first_tile->ispe_height;
+        }
+
+        int64_t x0 = std::max<int64_t>(item_clip->x, 0);
+        int64_t y0 = std::max<int64_t>(item_clip->y, 0);
+        int64_t x1 = std::min<int64_t>((int64_t)item_clip->x + item_clip->width, grid.get_width());
+        int64_t y1 = std::min<int64_t>((int64_t)item_clip->y + item_clip->height, grid.get_height());
+
+        for (int64_t y = 0; y < grid.get_rows(); y++) {
+          for (int64_t x = 0; x < grid.get_columns(); x++) {
+            size_t idx = (size_t)(y * grid.get_columns() + x);
+            if (idx >= item->references.size()) {
+              break;
+            }
+
+            if (x * tile_width < x1 && (x + 1) * tile_width > x0 &&
+                y * tile_height < y1 && (y + 1) * tile_height > y0) {
+              add_item(item->references[idx], nullptr);
+            }
+          }
+        }
+      }
+      else {
+        // Overlays need all their inputs. Identity transforms take the region of their input,
+        // as do grids whose description has not arrived yet.
+        bool pass_clip = (item->item_type == "iden");
+        for (heif_image_id ref : item->references) {
+          add_item(ref, pass_clip ? item_clip : nullptr);
+        }
+      }
+    };
+
+    add_item(img->get_id(), clip);
+
+    if (img->get_alpha_channel()) {
+      // The alpha image may have a different resolution, scale the region to it.
+      const HeifFile::Item* item = m_heif_file->get_item(img->get_id());
+      const HeifFile::Item* alpha = m_heif_file->get_item(img->get_alpha_channel()->get_id());
+
+      if (clip && item && alpha && item->has_ispe && alpha->has_ispe &&
+          item->ispe_width > 0 && item->ispe_height > 0 &&
+          (item->ispe_width != alpha->ispe_width || item->ispe_height != alpha->ispe_height)) {
+        full_region.x = (int)((int64_t)clip->x * alpha->ispe_width / item->ispe_width);
+        full_region.y = (int)((int64_t)clip->y * alpha->ispe_height / item->ispe_height);
+        int64_t x1 = (((int64_t)clip->x + clip->width) * alpha->ispe_width +
+                      item->ispe_width - 1) / item->ispe_width;
+        int64_t y1 = (((int64_t)clip->y + clip->height) * alpha->ispe_height +
+                      item->ispe_height - 1) / item->ispe_height;
+        full_region.width = std::max(1, (int)(x1 - full_region.x));
+        full_region.height = std::max(1, (int)(y1 - full_region.y));
+        clip = &full_region;
+      }
+
+      add_item(img->get_alpha_channel()->get_id(), clip);
+    }
+  }
+
+  std::sort(needed.begin(), needed.end(),
+            [](const heif_byte_range& a, const heif_byte_range& b) { return a.offset < b.offset; });
+
+  ranges->clear();
+  for (const auto& range : needed) {
+    if (range.length == 0) {
+      continue;
+    }
+
+    if (!ranges->empty()) {
+      heif_byte_range& last = ranges->back();
+      uint64_t last_end = last.offset + last.length;
+      if (range.offset <= last_end || range.offset - last_end < merge_gap) {
+        last.length = std::max(last_end, range.offset + range.length) - last.offset;
+        continue;
+      }
+    }
+
+    ranges->push_back(range);
+  }
+
+  return Error::Ok;
+}
+
+
+Error HeifContext::write_fast_start_file(const char* output_filename, bool decoding_order) const
+{
+  if (!m_heif_file) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "No file has been read");
+  }
+
+  return heif::write_fast_start_file(*m_heif_file, output_filename, decoding_order);
+}
+
+
+Error HeifContext::set_allocator(const std::shared_ptr<const Allocator>& allocator)
+{
+  if (m_heif_file) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "The allocator has to be set before reading a file");
+  }
+
+  m_memory_account->set_allocator(allocator ? allocator : Allocator::get_default());
+  return Error::Ok;
+}
+
+
+void HeifContext::set_limits(const heif_resource_limits& limits)
+{
+  m_limits = limits;
+  m_memory_account->set_limit(limits.max_memory_bytes);
+}
+
+
+bool HeifContext::attach_parsed_file()
+{
+  if (!m_file_identity.is_valid()) {
+    return false;
+  }
+
+  ParsedFileCache& cache = ParsedFileCache::get_instance();
+  if (cache.get_capacity() == 0) {
+    return false;
+  }
+
+  std::shared_ptr<const ParsedFile> parsed = cache.lookup(m_file_identity);
+  if (!parsed || !have_same_file_limits(parsed->heif_file->get_limits(), m_limits)) {
+    return false;
+  }
+
+  m_heif_file = parsed->heif_file;
+  m_all_images = parsed->all_images;
+  m_top_level_images = parsed->top_level_images;
+  m_primary_image = parsed->primary_image;
+
+  return true;
+}
+
+
+void HeifContext::store_parsed_file()
+{
+  if (!m_file_identity.is_valid()) {
+    return;
+  }
+
+  ParsedFileCache& cache = ParsedFileCache::get_instance();
+  if (cache.get_capacity() == 0) {
+    return;
+  }
+
+  auto parsed = std::make_shared<ParsedFile>();
+  parsed->heif_file = m_heif_file;
+  parsed->all_images = m_all_images;
+  parsed->top_level_images = m_top_level_images;
+  parsed->primary_image = m_primary_image;
+
+  cache.insert(m_file_identity, parsed);
+}
+
 std::string HeifContext::debug_dump_boxes() const
 {
   return m_heif_file->debug_dump_boxes();
@@ -303,6 +781,7 @@ std::string HeifContext::debug_dump_boxes() const
 static bool item_type_is_image(const std::string& item_type)
 {
   return (item_type=="hvc1" ||
+          item_type=="jpeg" ||
           item_type=="grid" ||
           item_type=="iden" ||
           item_type=="iovl");
@@ -491,24 +970,19 @@ Error HeifContext::interpret_heif_file()
 
   // --- reference all non-hidden images
 
-  std::vector<heif_image_id> image_IDs = m_heif_file->get_item_IDs();
+  const auto& items = m_heif_file->get_items();
 
-  for (heif_image_id id : image_IDs) {
-    auto infe_box = m_heif_file->get_infe_box(id);
-
-    
-    if (!infe_box) {
-      // TODO(farindk): Should we return an error instead of skipping the invalid id?
-      continue;
-    }
+  for (const auto& pair : items) {
+    const HeifFile::Item& item = pair.second;
+    heif_image_id id = item.id;
 
     // std::cout << "image id = " << id << " size = " << m_all_images.size() << std::endl;
-    
-    if (item_type_is_image(infe_box->get_item_type())) {
-      auto image = std::make_shared<Image>(this, id);
+
+    if (item_type_is_image(item.item_type)) {
+      auto image = std::make_shared<Image>(id);
       m_all_images.insert(std::make_pair(id, image));
 
-      if (!infe_box->is_hidden_item()) {
+      if (!item.hidden) {
         if (id==m_heif_file->get_primary_image_ID()) {
           image->set_primary(true);
           m_primary_image = image;
@@ -530,218 +1004,225 @@ Error HeifContext::interpret_heif_file()
 
   // --- remove thumbnails from top-level images and assign to their respective image
 
-  auto iref_box = m_heif_file->get_iref_box();
-  if (iref_box) {
-    // m_top_level_images.clear();
-
-    for (auto& pair : m_all_images) {
-      auto& image = pair.second;
-
-      uint32_t type = iref_box->get_reference_type(image->get_id());
-
-      if (type==fourcc("thmb")) {
-        // --- this is a thumbnail image, attach to the main image
+  for (auto& pair : m_all_images) {
+    auto& image = pair.second;
+    const HeifFile::Item* item = m_heif_file->get_item(image->get_id());
 
-        std::vector<heif_image_id> refs = iref_box->get_references(image->get_id());
-        if (refs.size() != 1) {
-          return Error(heif_error_Invalid_input,
-                       heif_suberror_Unspecified,
-                       "Too many thumbnail references");
-        }
+    uint32_t type = item->reference_type;
 
-        image->set_is_thumbnail_of(refs[0]);
+    if (type==fourcc("thmb")) {
+      // --- this is a thumbnail image, attach to the main image
 
-        auto master_iter = m_all_images.find(refs[0]);
-        if (master_iter == m_all_images.end()) {
-          return Error(heif_error_Invalid_input,
-                       heif_suberror_Nonexisting_image_referenced,
-                       "Thumbnail references a non-existing image");
-        }
+      const std::vector<heif_image_id>& refs = item->references;
+      if (refs.size() != 1) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Unspecified,
+                     "Too many thumbnail references");
+      }
 
-        if (master_iter->second->is_thumbnail()) {
-          return Error(heif_error_Invalid_input,
-                       heif_suberror_Nonexisting_image_referenced,
-                       "Thumbnail references another thumbnail");
-        }
+      image->set_is_thumbnail_of(refs[0]);
 
-        master_iter->second->add_thumbnail(image);
+      auto master_iter = m_all_images.find(refs[0]);
+      if (master_iter == m_all_images.end()) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Nonexisting_image_referenced,
+                     "Thumbnail references a non-existing image");
+      }
 
-        remove_top_level_image(image);
+      if (master_iter->second->is_thumbnail()) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Nonexisting_image_referenced,
+                     "Thumbnail references another thumbnail");
       }
-      else if (type==fourcc("auxl")) {
 
-        // --- this is an auxiliary image
-        //     check whether it is an alpha channel and attach to the main image if yes
+      master_iter->second->add_thumbnail(image);
 
-        std::vector<Box_ipco::Property> properties;
-        Error err = m_heif_file->get_properties(image->get_id(), properties);
-        if (err) {
-          return err;
-        }
+      remove_top_level_image(image);
+    }
+    else if (type==fourcc("auxl")) {
 
-        std::shared_ptr<Box_auxC> auxC_property;
-        for (const auto& property : properties) {
-          auto auxC = std::dynamic_pointer_cast<Box_auxC>(property.property);
-          if (auxC) {
-            auxC_property = auxC;
-          }
-        }
+      // --- this is an auxiliary image
+      //     check whether it is an alpha channel and attach to the main image if yes
 
-        if (!auxC_property) {
-          std::stringstream sstr;
-          sstr << "No auxC property for image " << image->get_id();
-          return Error(heif_error_Invalid_input,
-                       heif_suberror_Auxiliary_image_type_unspecified,
-                       sstr.str());
-        }
+      if (!item->has_auxC) {
+        std::stringstream sstr;
+        sstr << "No auxC property for image " << image->get_id();
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Auxiliary_image_type_unspecified,
+                     sstr.str());
+      }
 
-        std::vector<heif_image_id> refs = iref_box->get_references(image->get_id());
-        if (refs.size() != 1) {
-          return Error(heif_error_Invalid_input,
-                       heif_suberror_Unspecified,
-                       "Too many auxiliary image references");
-        }
+      const std::vector<heif_image_id>& refs = item->references;
+      if (refs.size() != 1) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Unspecified,
+                     "Too many auxiliary image references");
+      }
 
+      auto master_iter = m_all_images.find(refs[0]);
+      if (master_iter == m_all_images.end()) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Nonexisting_image_referenced,
+                     "Auxiliary image references a non-existing image");
+      }
 
-        // alpha channel
 
-        if (auxC_property->get_aux_type() == "urn:mpeg:avc:2015:auxid:1" ||
-            auxC_property->get_aux_type() == "urn:mpeg:hevc:2015:auxid:1") {
-          image->set_is_alpha_channel_of(refs[0]);
+      // alpha channel
 
-          auto master_iter = m_all_images.find(refs[0]);
-          master_iter->second->set_alpha_channel(image);
-        }
+      if (item->aux_type == "urn:mpeg:avc:2015:auxid:1" ||
+          item->aux_type == "urn:mpeg:hevc:2015:auxid:1") {
+        image->set_is_alpha_channel_of(refs[0]);
+        master_iter->second->set_alpha_channel(image);
+      }
 
 
-        // depth channel
+      // depth channel
 
-        if (auxC_property->get_aux_type() == "urn:mpeg:hevc:2015:auxid:2") {
-          image->set_is_depth_channel_of(refs[0]);
+      if (item->aux_type == "urn:mpeg:hevc:2015:auxid:2") {
+        image->set_is_depth_channel_of(refs[0]);
+        master_iter->second->set_depth_channel(image);
 
-          auto master_iter = m_all_images.find(refs[0]);
-          master_iter->second->set_depth_channel(image);
+        std::vector<std::shared_ptr<SEIMessage>> sei_messages;
+        Error err = decode_hevc_aux_sei_messages(item->aux_subtypes, sei_messages);
 
-          auto subtypes = auxC_property->get_subtypes();
-
-          std::vector<std::shared_ptr<SEIMessage>> sei_messages;
-          Error err = decode_hevc_aux_sei_messages(subtypes, sei_messages);
-
-          for (auto& msg : sei_messages) {
-            auto depth_msg = std::dynamic_pointer_cast<SEIMessage_depth_representation_info>(msg);
-            if (depth_msg) {
-              image->set_depth_representation_info(*depth_msg);
-            }
+        for (auto& msg : sei_messages) {
+          auto depth_msg = std::dynamic_pointer_cast<SEIMessage_depth_representation_info>(msg);
+          if (depth_msg) {
+            image->set_depth_representation_info(*depth_msg);
           }
         }
-
-        remove_top_level_image(image);
-      }
-      else {
-        // 'image' is a normal image, keep it as a top-level image
       }
+
+      remove_top_level_image(image);
+    }
+    else {
+      // 'image' is a normal image, keep it as a top-level image
     }
   }
 
 
-  // --- read through properties for each image and extract image resolutions
+  // --- extract image resolutions from the item properties
 
   for (auto& pair : m_all_images) {
     auto& image = pair.second;
+    const HeifFile::Item* item = m_heif_file->get_item(pair.first);
 
-    std::vector<Box_ipco::Property> properties;
+    if (!item->has_ispe) {
+      continue;
+    }
 
-    Error err = m_heif_file->get_properties(pair.first, properties);
-    if (err) {
-      return err;
+    uint32_t width = item->ispe_width;
+    uint32_t height = item->ispe_height;
+
+
+    // --- check whether the image size is "too large"
+
+    if (width  >= static_cast<uint32_t>(std::numeric_limits<int>::max()) ||
+        height >= static_cast<uint32_t>(std::numeric_limits<int>::max())) {
+      std::stringstream sstr;
+      sstr << "Image size " << width << "x" << height << " exceeds the maximum image size "
+           << std::numeric_limits<int>::max() << "x"
+           << std::numeric_limits<int>::max() << "\n";
+
+      return Error(heif_error_Memory_allocation_error,
+                   heif_suberror_Security_limit_exceeded,
+                   sstr.str());
     }
 
-    bool ispe_read = false;
-    for (const auto& prop : properties) {
-      auto ispe = std::dynamic_pointer_cast<Box_ispe>(prop.property);
-      if (ispe) {
-        uint32_t width = ispe->get_width();
-        uint32_t height = ispe->get_height();
+    image->set_resolution(width, height);
 
+    if (item->has_clap) {
+      image->set_resolution( item->clap_width,
+                             item->clap_height );
+    }
 
-        // --- check whether the image size is "too large"
+    if (item->rotation==90 ||
+        item->rotation==270) {
+      // swap width and height
+      image->set_resolution( image->get_height(),
+                             image->get_width() );
+    }
+  }
 
-        if (width  >= static_cast<uint32_t>(std::numeric_limits<int>::max()) ||
-            height >= static_cast<uint32_t>(std::numeric_limits<int>::max())) {
-          std::stringstream sstr;
-          sstr << "Image size " << width << "x" << height << " exceeds the maximum image size "
-               << std::numeric_limits<int>::max() << "x"
-               << std::numeric_limits<int>::max() << "\n";
 
-          return Error(heif_error_Memory_allocation_error,
-                       heif_suberror_Security_limit_exceeded,
-                       sstr.str());
-        }
+  // --- identity images without 'ispe' take the size of their source image
 
-        image->set_resolution(width, height);
-        ispe_read = true;
-      }
+  for (auto& pair : m_all_images) {
+    auto& image = pair.second;
+    const HeifFile::Item* item = m_heif_file->get_item(pair.first);
 
-      if (ispe_read) {
-        auto clap = std::dynamic_pointer_cast<Box_clap>(prop.property);
-        if (clap) {
-          image->set_resolution( clap->get_width_rounded(),
-                                 clap->get_height_rounded() );
-        }
+    if (item->item_type != "iden" || item->has_ispe || item->references.size() != 1) {
+      continue;
+    }
 
-        auto irot = std::dynamic_pointer_cast<Box_irot>(prop.property);
-        if (irot) {
-          if (irot->get_rotation()==90 ||
-              irot->get_rotation()==270) {
-            // swap width and height
-            image->set_resolution( image->get_height(),
-                                   image->get_width() );
-          }
-        }
-      }
+    auto source_iter = m_all_images.find(item->references[0]);
+    if (source_iter == m_all_images.end()) {
+      continue;
+    }
+
+    if (item->rotation==90 ||
+        item->rotation==270) {
+      image->set_resolution( source_iter->second->get_height(),
+                             source_iter->second->get_width() );
+    }
+    else {
+      image->set_resolution( source_iter->second->get_width(),
+                             source_iter->second->get_height() );
     }
   }
 
 
+  // --- read the HEVC parameter sets, for the coded size and sample format before decoding.
+  //     Parameter sets that cannot be read are left to the decoder.
 
-  // --- read metadata and assign to image
+  for (auto& pair : m_all_images) {
+    const HeifFile::Item* item = m_heif_file->get_item(pair.first);
 
-  for (uint32_t id : image_IDs) {
-    std::string item_type = m_heif_file->get_item_type(id);
-    if (item_type == "Exif") {
-      std::shared_ptr<ImageMetadata> metadata = std::make_shared<ImageMetadata>();
-      metadata->item_type = item_type;
+    if (item->item_type != "hvc1" || item->codec_headers.empty()) {
+      continue;
+    }
 
-      Error err = m_heif_file->get_compressed_image_data(id, &(metadata->m_data));
-      if (err) {
-        return err;
-      }
+    HEVCStreamInfo info;
+    Error err = parse_hevc_headers(item->codec_headers.data(), item->codec_headers.size(),
+                                   item->nal_length_size, &info);
+    if (!err) {
+      pair.second->set_hevc_info(info);
+    }
+  }
 
-      //std::cerr.write((const char*)data.data(), data.size());
 
+  // --- read metadata and assign to image
 
-      // --- assign metadata to the image
+  for (const auto& pair : items) {
+    const HeifFile::Item& item = pair.second;
+    heif_image_id id = item.id;
 
-      if (iref_box) {
-        uint32_t type = iref_box->get_reference_type(id);
-        if (type == fourcc("cdsc")) {
-          std::vector<uint32_t> refs = iref_box->get_references(id);
-          if (refs.size() != 1) {
-            return Error(heif_error_Invalid_input,
-                         heif_suberror_Unspecified,
-                         "Exif data not correctly assigned to image");
-          }
+    if (item.item_type == "Exif") {
+      // the data itself is read when it is first accessed
+      std::shared_ptr<ImageMetadata> metadata = std::make_shared<ImageMetadata>();
+      metadata->item_type = item.item_type;
+      metadata->item_id = id;
 
-          uint32_t exif_image_id = refs[0];
-          auto img_iter = m_all_images.find(exif_image_id);
-          if (img_iter == m_all_images.end()) {
-            return Error(heif_error_Invalid_input,
-                         heif_suberror_Nonexisting_image_referenced,
-                         "Exif data assigned to non-existing image");
-          }
 
-          img_iter->second->add_metadata(metadata);
+      // --- assign metadata to the image
+
+      if (item.reference_type == fourcc("cdsc")) {
+        const std::vector<heif_image_id>& refs = item.references;
+        if (refs.size() != 1) {
+          return Error(heif_error_Invalid_input,
+                       heif_suberror_Unspecified,
+                       "Exif data not correctly assigned to image");
+        }
+
+        uint32_t exif_image_id = refs[0];
+        auto img_iter = m_all_images.find(exif_image_id);
+        if (img_iter == m_all_images.end()) {
+          return Error(heif_error_Invalid_input,
+                       heif_suberror_Nonexisting_image_referenced,
+                       "Exif data assigned to non-existing image");
         }
+
+        img_iter->second->add_metadata(metadata);
       }
     }
   }
@@ -750,9 +1231,8 @@ Error HeifContext::interpret_heif_file()
 }
 
 
-HeifContext::Image::Image(HeifContext* context, heif_image_id id)
-  : m_heif_context(context),
-    m_id(id)
+HeifContext::Image::Image(heif_image_id id)
+  : m_id(id)
 {
 }
 
@@ -819,7 +1299,10 @@ int HeifContext::destory_heif_image_buffer(heif_image* img)
 
   img->image_type = HEIF_IMAGE_TYPE_UNKNOW;
 
-  if(img->yuv_image) {
+  if(img->decoded_image) {
+    release_decoded_image(img);
+  }
+  else if(img->yuv_image) {
     delete [] img->yuv_image;
     img->yuv_image = nullptr;
   }
@@ -967,7 +1450,7 @@ void HeifContext::destroy_grid_image_buffer(grid_image **grid_img)
 void HeifContext::destory_base_image_buffer(base_image *base) 
 {
   if(base->buf) {
-    delete [] base->buf;
+    m_memory_account->get_allocator()->release(base->buf);
     base->buf = 0;
   }
 
@@ -977,24 +1460,46 @@ void HeifContext::destory_base_image_buffer(base_image *base)
   return;
 }
 
-int HeifContext::base_image_add_data(uint8_t *data, int data_len, base_image *base)
+bool HeifContext::base_image_reserve(base_image *base, size_t size)
 {
-  // printf("base_image_add_data() data_len = %d\n", data_len);
-#define BASE_IMAGE_BUF_SIZE (2 << 20)
-  if(!base->buf) {
-    base->buf = new uint8_t[BASE_IMAGE_BUF_SIZE];
-    base->buf_size = BASE_IMAGE_BUF_SIZE;
+  if(size > (size_t)INT_MAX) {
+    return false;
+  }
+
+  if((int)size <= base->buf_size) {
+    // the buffer of the previous image is large enough, reuse it
+    return true;
   }
 
-  if(data_len > base->buf_size - base->data_len) {
-    // not enought buffer, realloc
-    int len = data_len > BASE_IMAGE_BUF_SIZE ? data_len : BASE_IMAGE_BUF_SIZE;
-    len += base->buf_size;
-    uint8_t *tmp = new uint8_t[len];
+  const Allocator& allocator = *m_memory_account->get_allocator();
+
+  uint8_t *tmp = static_cast<uint8_t*>(allocator.allocate(size));
+  if(!tmp) {
+    return false;
+  }
+
+  if(base->buf) {
     memcpy(tmp, base->buf, base->data_len);
-    base->buf_size = len;
-    delete [] base->buf;
-    base->buf = tmp;
+    allocator.release(base->buf);
+  }
+
+  base->buf = tmp;
+  base->buf_size = (int)size;
+
+  return true;
+}
+
+int HeifContext::base_image_add_data(uint8_t *data, int data_len, base_image *base)
+{
+  // printf("base_image_add_data() data_len = %d\n", data_len);
+  size_t needed = (size_t)base->data_len + data_len;
+
+  if((int)needed > base->buf_size) {
+    // not enought buffer, grow geometrically so that appending stays linear
+    size_t len = std::max(needed, (size_t)base->buf_size * 2);
+    if(!base_image_reserve(base, len) && !base_image_reserve(base, needed)) {
+      return -1;
+    }
   }
 
   memcpy(base->buf+base->data_len, data, data_len);
@@ -1003,12 +1508,49 @@ int HeifContext::base_image_add_data(uint8_t *data, int data_len, base_image *ba
   return base->data_len;
 }
 
+Error HeifContext::base_image_read_items(const heif_image_id* IDs, size_t num, base_image *base)
+{
+  // sizes are known from the iloc extents and hvcC headers: allocate once, then fill in place
+  std::vector<uint64_t> sizes(num);
+  uint64_t total = base->data_len;
+
+  for(size_t i = 0; i < num; i++) {
+    Error err = m_heif_file->get_compressed_image_data_size(IDs[i], &sizes[i]);
+    if(err) {
+      return err;
+    }
+
+    total += sizes[i];
+  }
+
+  if(total > (uint64_t)INT_MAX || !base_image_reserve(base, (size_t)total)) {
+    return Error(heif_error_Memory_allocation_error,
+                 heif_suberror_Unspecified,
+                 "Cannot allocate buffer for compressed image data");
+  }
+
+  for(size_t i = 0; i < num; i++) {
+    Error err = m_heif_file->read_compressed_image_data(IDs[i], base->buf + base->data_len);
+    if(err) {
+      return err;
+    }
+
+    base->data_len += (int)sizes[i];
+  }
+
+  return Error::Ok;
+}
+
 int HeifContext::add_heif_sub_image(uint8_t *data, int data_len, heif_image *img)
 {
   if(HEIF_IMAGE_TYPE_HVC1 == img->image_type){
     // hvc1
     base_image_add_data(data, data_len, &img->_image);
 
+  } else if(HEIF_IMAGE_TYPE_JPEG == img->image_type){
+    // complete JPEG stream
+    base_image_add_data(data, data_len, &img->_image);
+
   } else if(HEIF_IMAGE_TYPE_GRID == img->image_type){
     // grid image
 
@@ -1038,6 +1580,7 @@ void HeifContext::reset_heif_image_buffer(heif_image *img)
   img->codec_type = 0;
   img->image_type = HEIF_IMAGE_TYPE_UNKNOW;
   img->_image.data_len = 0;
+  img->nal_length_size = 0;
 
   img->thumb.data_len = 0;
   img->thumb_width = 0;
@@ -1067,31 +1610,51 @@ Error HeifContext::get_heif_image_data(heif_image_id ID, heif_image* out_data)
   reset_heif_image_buffer(out_data);
 
   if(image_type == "hvc1") {
-    std::vector<uint8_t> data;
-    err = m_heif_file->get_compressed_image_data(ID, &data);
-
     out_data->image_type = HEIF_IMAGE_TYPE_HVC1;
 
     // info
     const std::shared_ptr<Image> hvc1 = m_all_images.find(ID)->second;
     out_data->width       = hvc1->get_width();
     out_data->height      = hvc1->get_height();
-    // out_data->bit_depth   = ;
-    // out_data->chroma      = ;
     // out_data->codec_type  = ;
 
-    add_heif_sub_image(data.data(), data.size(), out_data);
+    const HEVCStreamInfo* hevc_info = get_hevc_info(ID);
+    if (hevc_info) {
+      out_data->bit_depth = hevc_info->bit_depth_luma;
+      out_data->chroma    = hevc_info->get_chroma();
+    }
+
+    out_data->nal_length_size = m_heif_file->get_item(ID)->nal_length_size;
+
+    err = base_image_read_items(&ID, 1, &out_data->_image);
+  }
+  else if(image_type == "jpeg") {
+    out_data->image_type = HEIF_IMAGE_TYPE_JPEG;
+
+    const std::shared_ptr<Image> jpeg = m_all_images.find(ID)->second;
+    out_data->width       = jpeg->get_width();
+    out_data->height      = jpeg->get_height();
+
+    err = base_image_read_items(&ID, 1, &out_data->_image);
   }
   else if(image_type == "grid") {
     std::cout << "grid id: " << ID << std::endl;
     out_data->image_type = HEIF_IMAGE_TYPE_GRID;
     err = get_grid_image_data(ID, out_data);    
   }
+  else if(image_type == "iden") {
+    // derived image without own data, the pixels are available through heif_decode_image()
+    out_data->image_type = HEIF_IMAGE_TYPE_IDEN;
+
+    const std::shared_ptr<Image> iden = m_all_images.find(ID)->second;
+    out_data->width       = iden->get_width();
+    out_data->height      = iden->get_height();
+  }
   else {
     out_data->image_type = HEIF_IMAGE_TYPE_UNKNOW;
   }
 
-  return Error::Ok;
+  return err;
 }
 
 
@@ -1107,15 +1670,15 @@ Error HeifContext::get_grid_image_data(heif_image_id ID, heif_image* out_data)
 
   std::cout << grid.dump();
 
-  auto iref_box = m_heif_file->get_iref_box();
+  const HeifFile::Item* item = m_heif_file->get_item(ID);
 
-  if (!iref_box) {
+  if (item->reference_type != fourcc("dimg")) {
   return Error(heif_error_Invalid_input,
                 heif_suberror_No_iref_box,
                 "No iref box available, but needed for grid image");
   }
 
-  std::vector<uint32_t> image_references = iref_box->get_references(ID);
+  std::vector<uint32_t> image_references = item->references;
 
   if ((int)image_references.size() != grid.get_rows() * grid.get_columns()) {
     std::stringstream sstr;
@@ -1132,10 +1695,14 @@ Error HeifContext::get_grid_image_data(heif_image_id ID, heif_image* out_data)
   out_data->image_type  = HEIF_IMAGE_TYPE_GRID;
   out_data->width       = grid.get_width();
   out_data->height      = grid.get_height();
-  // out_data->bit_depth   = ;
-  // out_data->chroma      = ;
   // out_data->codec_type  = ;
 
+  const HEVCStreamInfo* hevc_info = get_hevc_info(ID);
+  if (hevc_info) {
+    out_data->bit_depth = hevc_info->bit_depth_luma;
+    out_data->chroma    = hevc_info->get_chroma();
+  }
+
   bool first_time = true;
   
   heif_image_id tileID = 0;
@@ -1150,11 +1717,17 @@ Error HeifContext::get_grid_image_data(heif_image_id ID, heif_image* out_data)
       int src_width = tileImg->get_width();
       int src_height = tileImg->get_height();
 
-      std::vector<uint8_t> tile_data;
-      // std::cout << "tile id: " << tileID << std::endl;
-      err = m_heif_file->get_compressed_image_data(tileID, &tile_data);
-      if(err) {
-        std::cout << " get compressed image data error " << err.message << std::endl;
+      // all tiles are fed to the decoder as one stream, so they have to share the NAL length size
+      int tile_nal_length_size = m_heif_file->get_item(tileID)->nal_length_size;
+      if (tile_nal_length_size) {
+        if (out_data->nal_length_size == 0) {
+          out_data->nal_length_size = tile_nal_length_size;
+        }
+        else if (out_data->nal_length_size != tile_nal_length_size) {
+          return Error(heif_error_Unsupported_feature,
+                       heif_suberror_Unsupported_data_version,
+                       "Grid tiles with different NAL length sizes");
+        }
       }
 
       if(first_time) {
@@ -1167,13 +1740,1217 @@ Error HeifContext::get_grid_image_data(heif_image_id ID, heif_image* out_data)
         printf("grid image row[%d], col[%d], width[%d], height[%d]\n", grid.get_rows(), grid.get_columns(), src_width, src_height);
       }
 
-      // add grid image tiles
-      add_heif_sub_image(tile_data.data(), tile_data.size(), out_data);
-      
       reference_idx++;
     } // for (int x = 0; ...)
   } // for (int y = 0; ...)
 
+  // add all grid image tiles into one buffer of the exact size
+  return base_image_read_items(image_references.data(), image_references.size(), &out_data->_image);
+}
+
+
+
+// Reference of a heif_image to its decoded image (heif_image::decoded_image).
+struct DecodedImageRef
+{
+  std::shared_ptr<const HeifPixelImage> image;
+
+  // memory of an image that is not charged to the handle, e.g. from the image cache
+  MemoryCharge charge;
+};
+
+
+Error HeifContext::attach_decoded_image(heif_image* img, const std::shared_ptr<const HeifPixelImage>& decoded)
+{
+  // The reference to the previous image is replaced in place, so that decoding
+  // into the same heif_image again does not allocate.
+  auto holder = static_cast<DecodedImageRef*>(img->decoded_image);
+  if (!holder) {
+    holder = new DecodedImageRef;
+    img->decoded_image = holder;
+  }
+
+  // Images owned by the image cache are charged to each handle holding them, so that
+  // the memory limit of the handle covers them like its own decoded images.
+  uint64_t foreign_size = 0;
+  if (decoded->get_memory_account() != m_memory_account.get()) {
+    foreign_size = decoded->get_memory_size();
+  }
+
+  Error err = holder->charge.charge(m_memory_account, foreign_size, "Cached image");
+  if (err) {
+    release_decoded_image(img);
+    return err;
+  }
+
+  holder->image = decoded;
+
+  img->width      = decoded->get_width();
+  img->height     = decoded->get_height();
+  img->bit_depth  = decoded->get_bit_depth();
+  img->chroma     = decoded->get_chroma_format();
+
+  for (int c = 0; c < 3; c++) {
+    img->planes[c] = const_cast<uint8_t*>(decoded->get_plane(c, &img->strides[c]));
+    if (!img->planes[c]) {
+      img->strides[c] = 0;
+    }
+  }
+
+  // the planes are stored consecutively in one block, so the old yuv_image view stays valid.
+  // Its rows are only packed without padding with the default plane layout.
+  img->yuv_image = img->planes[0];
+  img->yuv_len = (int)decoded->get_memory_size();
+
+  return Error::Ok;
+}
+
+
+void HeifContext::release_decoded_image(heif_image* img)
+{
+  if (!img->decoded_image) {
+    return;
+  }
+
+  delete static_cast<DecodedImageRef*>(img->decoded_image);
+  img->decoded_image = nullptr;
+
+  for (int c = 0; c < 3; c++) {
+    img->planes[c] = nullptr;
+    img->strides[c] = 0;
+  }
+
+  img->yuv_image = nullptr;
+  img->yuv_len = 0;
+}
+
+
+static Error check_image_size(const heif_resource_limits& limits, uint64_t width, uint64_t height)
+{
+  if (limits.max_image_pixels && width * height > limits.max_image_pixels) {
+    return limit_exceeded_error("Number of image pixels", width * height, limits.max_image_pixels);
+  }
+
+  return Error::Ok;
+}
+
+
+// Frame size from the SOF marker of a JPEG stream. Returns false if there is no SOF
+// before the first scan. A height of 0 means that it is given by a DNL marker.
+static bool get_jpeg_frame_size(const uint8_t* data, size_t size,
+                                uint32_t* out_width, uint32_t* out_height)
+{
+  if (size < 2 || data[0] != 0xFF || data[1] != 0xD8) {
+    return false;
+  }
+
+  size_t pos = 2;
+  for (;;) {
+    // markers may be preceded by any number of 0xFF fill bytes
+    if (pos >= size || data[pos] != 0xFF) {
+      return false;
+    }
+
+    while (pos < size && data[pos] == 0xFF) {
+      pos++;
+    }
+
+    if (pos >= size) {
+      return false;
+    }
+
+    uint8_t marker = data[pos++];
+
+    // markers without a segment: TEM, RSTn
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      continue;
+    }
+
+    // start of scan or end of image before a frame header
+    if (marker == 0xDA || marker == 0xD9 || pos + 2 > size) {
+      return false;
+    }
+
+    size_t length = ((size_t)data[pos] << 8) | data[pos + 1];
+    if (length < 2 || pos + length > size) {
+      return false;
+    }
+
+    // SOF0..SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+    if (marker >= 0xC0 && marker <= 0xCF &&
+        marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      if (length < 7) {
+        return false;
+      }
+
+      *out_height = ((uint32_t)data[pos + 3] << 8) | data[pos + 4];
+      *out_width = ((uint32_t)data[pos + 5] << 8) | data[pos + 6];
+      return true;
+    }
+
+    pos += length;
+  }
+}
+
+
+// Read the compressed data of 'num_IDs' items, one after the other, into a buffer from the
+// allocator of 'account'. The buffer is charged to the account as long as 'charge' exists.
+static Error read_compressed_data(const HeifFile& file, const std::shared_ptr<MemoryAccount>& account,
+                                  const heif_image_id* IDs, size_t num_IDs,
+                                  AllocatedBuffer* data, MemoryCharge* charge)
+{
+  uint64_t total_size = 0;
+
+  for (size_t i = 0; i < num_IDs; i++) {
+    uint64_t size;
+    Error err = file.get_compressed_image_data_size(IDs[i], &size);
+    if (err) {
+      return err;
+    }
+
+    total_size += size;
+  }
+
+  Error err = charge->charge(account, total_size, "Compressed image data");
+  if (err) {
+    return err;
+  }
+
+  if (total_size > std::numeric_limits<size_t>::max() ||
+      !data->allocate(account->get_buffer_pool(), (size_t)total_size)) {
+    return Error(heif_error_Memory_allocation_error,
+                 heif_suberror_Unspecified);
+  }
+
+  uint8_t* dest = data->data();
+  for (size_t i = 0; i < num_IDs; i++) {
+    uint64_t size;
+    err = file.get_compressed_image_data_size(IDs[i], &size);
+    if (!err) {
+      err = file.read_compressed_image_data(IDs[i], dest);
+    }
+
+    if (err) {
+      return err;
+    }
+
+    dest += size;
+  }
+
+  return Error::Ok;
+}
+
+
+// Decoding options that change the decoded pixels and hence have to be part of the cache key.
+static uint64_t get_options_cache_key(const heif_decoding_options& options)
+{
+  // bypass_image_cache and the progress callback do not influence the image
+  uint64_t key = 0;
+  key |= (options.ignore_transformations ? 1 : 0);
+  key |= (options.premultiply_alpha ? 2 : 0);
+  key |= (options.convert_to_srgb ? 4 : 0);
+  key |= (uint64_t)(options.output_chroma & 0xFF) << 8;
+  key |= (uint64_t)(options.scale_denominator & 0xFF) << 16;
+
+  // the plane layout, as the returned image has to be stored in it
+  int alignment_bits = 0;
+  while (alignment_bits < 32 && (options.plane_alignment >> alignment_bits) > 1) {
+    alignment_bits++;
+  }
+
+  key |= (uint64_t)(options.plane_alignment ? alignment_bits + 1 : 0) << 24;
+  key |= (uint64_t)options.row_padding << 32;
+  return key;
+}
+
+
+static PlaneLayout get_plane_layout(const heif_decoding_options& options)
+{
+  PlaneLayout layout;
+  layout.alignment = options.plane_alignment;
+  layout.row_padding = options.row_padding;
+  return layout;
+}
+
+
+// Transformations of the item, for a decoded (untransformed) image of the given size.
+static ImageTransform get_item_transform(const HeifFile::Item& item, int width, int height,
+                                         const heif_decoding_options& options)
+{
+  ImageTransform transform(width, height);
+
+  if (options.ignore_transformations) {
+    return transform;
+  }
+
+  if (item.has_clap) {
+    if (item.has_ispe && item.ispe_width > 0 && item.ispe_height > 0 &&
+        (width != (int)item.ispe_width || height != (int)item.ispe_height)) {
+      // decoded at a reduced size, scale the crop window
+      transform.set_crop((int)((int64_t)item.clap_left * width / item.ispe_width),
+                         (int)((int64_t)item.clap_top * height / item.ispe_height),
+                         (int)((int64_t)item.clap_width * width / item.ispe_width),
+                         (int)((int64_t)item.clap_height * height / item.ispe_height));
+    }
+    else {
+      transform.set_crop(item.clap_left, item.clap_top, item.clap_width, item.clap_height);
+    }
+  }
+
+  transform.set_rotation(item.rotation);
+  transform.set_mirror(item.mirror_axis);
+
+  return transform;
+}
+
+
+// The plugin selected in the options if it supports the format, else the registered default.
+static Error get_decoder_plugin(heif_compression_format format,
+                                const heif_decoding_options& options,
+                                const heif_decoder_plugin** out_plugin)
+{
+  const heif_decoder_plugin* plugin = options.decoder_plugin;
+  if (plugin == nullptr || plugin->does_support_format(format) <= 0) {
+    plugin = get_decoder(format);
+  }
+
+  if (plugin == nullptr) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_codec,
+                 "No decoder plugin for the compression format");
+  }
+
+  *out_plugin = plugin;
   return Error::Ok;
 }
 
+
+// (x,y,w,h) is a region of the untransformed image, it is reported at its output position.
+static void report_decoded_region(const heif_decoding_options& options,
+                                  const HeifPixelImage& img,
+                                  const ImageTransform& transform,
+                                  int x, int y, int w, int h)
+{
+  if (!options.progress_callback) {
+    return;
+  }
+
+  // clipped to the crop window, tiles in the last row and column may extend beyond it
+  if (!transform.map_rect(x, y, w, h, &x, &y, &w, &h)) {
+    return;
+  }
+
+  heif_decoded_region region;
+  region.x = x;
+  region.y = y;
+  region.width = w;
+  region.height = h;
+  region.canvas_width = img.get_width();
+  region.canvas_height = img.get_height();
+  region.chroma = img.get_chroma_format();
+
+  for (int c = 0; c < 3; c++) {
+    region.planes[c] = img.get_plane(c, &region.strides[c]);
+    if (!region.planes[c]) {
+      region.strides[c] = 0;
+    }
+  }
+
+  options.progress_callback(&region, options.progress_user_data);
+}
+
+
+Error HeifContext::decode_image(heif_image_id ID, const heif_decoding_options& options,
+                                std::shared_ptr<const HeifPixelImage>* out_img)
+{
+  return decode_image(ID, options, nullptr, out_img);
+}
+
+
+Error HeifContext::decode_image(heif_image_id ID, const heif_decoding_options& options,
+                                const DerivationChain* chain,
+                                std::shared_ptr<const HeifPixelImage>* out_img)
+{
+  for (const DerivationChain* step = chain; step; step = step->parent) {
+    if (step->ID == ID) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_Unspecified,
+                   "Derived image references itself");
+    }
+  }
+
+  if ((options.plane_alignment & (options.plane_alignment - 1)) ||
+      options.plane_alignment > 65536 || options.row_padding > 65536) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "Plane alignment has to be a power of two up to 65536, row padding at most 65536 bytes");
+  }
+
+  ImageCache& cache = ImageCache::get_instance();
+
+  bool use_cache = (!options.bypass_image_cache &&
+                    m_file_identity.is_valid() &&
+                    cache.get_budget() > 0);
+
+  ImageCache::Key key;
+  key.file = m_file_identity;
+  key.image_id = ID;
+  key.options = get_options_cache_key(options);
+
+  if (use_cache && cache.lookup(key, out_img)) {
+    const HeifPixelImage& img = **out_img;
+    report_decoded_region(options, img, ImageTransform(img.get_width(), img.get_height()),
+                          0, 0, img.get_width(), img.get_height());
+    return Error::Ok;
+  }
+
+  if (m_all_images.find(ID) == m_all_images.end()) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Nonexisting_image_referenced);
+  }
+
+  // reject oversized images before reading any data
+  const HeifFile::Item* item = m_heif_file->get_item(ID);
+  if (item && item->has_ispe) {
+    Error err = check_image_size(m_limits, item->ispe_width, item->ispe_height);
+    if (err) {
+      return err;
+    }
+  }
+
+  std::string image_type = m_heif_file->get_item_type(ID);
+
+  std::shared_ptr<const HeifPixelImage> img;
+  Error err;
+
+  if (options.output_chroma != heif_chroma_undefined) {
+    err = decode_rgb_image(ID, options, chain, &img);
+  }
+  else if (image_type == "hvc1") {
+    err = decode_coded_image(ID, heif_compression_HEVC, options, &img);
+  }
+  else if (image_type == "jpeg") {
+    err = decode_coded_image(ID, heif_compression_JPEG, options, &img);
+  }
+  else if (image_type == "grid") {
+    err = decode_grid_image(ID, options, &img);
+  }
+  else if (image_type == "iden") {
+    err = decode_iden_image(ID, options, chain, &img);
+  }
+  else if (image_type == "iovl") {
+    err = decode_overlay_image(ID, options, chain, &img);
+  }
+  else {
+    err = Error(heif_error_Unsupported_feature,
+                heif_suberror_Unsupported_image_type);
+  }
+
+  if (err) {
+    return err;
+  }
+
+  // Images that are passed through or referenced (identity images, crop views) may not be
+  // stored in the requested layout yet.
+  PlaneLayout layout = get_plane_layout(options);
+  if (!img->has_layout(layout)) {
+    auto copy = HeifPixelImage::new_image(m_memory_account);
+    err = copy->create(img->get_width(), img->get_height(), img->get_chroma_format(),
+                       m_memory_account, layout);
+    if (err) {
+      return err;
+    }
+
+    err = img->copy_into(copy.get(), 0, 0);
+    if (err) {
+      return err;
+    }
+
+    img = copy;
+  }
+
+  *out_img = img;
+
+  if (use_cache) {
+    cache.insert(key, img);
+  }
+
+  return Error::Ok;
+}
+
+
+Error HeifContext::get_metadata_data(const std::shared_ptr<ImageMetadata>& metadata,
+                                     const uint8_t** out_data, size_t* out_size)
+{
+  if (m_heif_file->get_item_data_span(metadata->item_id, out_data, out_size)) {
+    return Error::Ok;
+  }
+
+  std::lock_guard<std::mutex> lock(metadata->m_mutex);
+
+  if (!metadata->m_loaded) {
+    Error err = m_heif_file->get_compressed_image_data(metadata->item_id, &metadata->m_data);
+    if (err) {
+      metadata->m_data.clear();
+      return err;
+    }
+
+    metadata->m_loaded = true;
+  }
+
+  *out_data = metadata->m_data.data();
+  *out_size = metadata->m_data.size();
+  return Error::Ok;
+}
+
+
+const HEVCStreamInfo* HeifContext::get_hevc_info(heif_image_id ID) const
+{
+  const HeifFile::Item* item = m_heif_file->get_item(ID);
+  if (item && item->item_type == "grid" && !item->references.empty()) {
+    ID = item->references[0];
+  }
+
+  auto iter = m_all_images.find(ID);
+  if (iter == m_all_images.end() || !iter->second->get_hevc_info().has_sps) {
+    return nullptr;
+  }
+
+  return &iter->second->get_hevc_info();
+}
+
+
+// Item with the 'colr' properties of image 'ID': derived images without their own take
+// them from the first image they reference.
+static const HeifFile::Item* find_colour_item(const HeifFile& file, heif_image_id ID, bool icc)
+{
+  const HeifFile::Item* item = file.get_item(ID);
+
+  // a chain longer than the number of items contains a cycle
+  for (int i = 0; item && i < file.get_num_images(); i++) {
+    if (icc ? !item->icc_profile.empty() : item->has_nclx) {
+      return item;
+    }
+
+    if ((item->item_type != "grid" && item->item_type != "iden") || item->references.empty()) {
+      return nullptr;
+    }
+
+    item = file.get_item(item->references[0]);
+  }
+
+  return nullptr;
+}
+
+
+HeifContext::NclxColour HeifContext::get_nclx_colour(heif_image_id ID) const
+{
+  NclxColour colour;
+
+  const HeifFile::Item* item = find_colour_item(*m_heif_file, ID, false);
+  if (item) {
+    colour.source = heif_colour_source_colr;
+    colour.colour_primaries = item->colour_primaries;
+    colour.transfer_characteristics = item->transfer_characteristics;
+    colour.matrix_coefficients = item->matrix_coefficients;
+    colour.full_range = item->full_range;
+    return colour;
+  }
+
+  item = m_heif_file->get_item(ID);
+  for (int i = 0; item && item->item_type == "iden" && !item->references.empty() &&
+         i < m_heif_file->get_num_images(); i++) {
+    ID = item->references[0];
+    item = m_heif_file->get_item(ID);
+  }
+
+  const HEVCStreamInfo* info = get_hevc_info(ID);
+  if (info && (info->has_colour_description || info->has_video_signal_type)) {
+    colour.source = heif_colour_source_vui;
+    colour.colour_primaries = info->colour_primaries;
+    colour.transfer_characteristics = info->transfer_characteristics;
+    colour.matrix_coefficients = info->matrix_coefficients;
+    colour.full_range = info->full_range;
+  }
+
+  return colour;
+}
+
+
+const std::vector<uint8_t>* HeifContext::get_icc_profile(heif_image_id ID) const
+{
+  const HeifFile::Item* item = find_colour_item(*m_heif_file, ID, true);
+  return item ? &item->icc_profile : nullptr;
+}
+
+
+std::shared_ptr<ImageMetadata> HeifContext::get_exif_metadata(heif_image_id ID) const
+{
+  auto iter = m_all_images.find(ID);
+  if (iter == m_all_images.end()) {
+    return nullptr;
+  }
+
+  for (const auto& metadata : iter->second->get_metadata()) {
+    if (metadata->item_type == "Exif") {
+      return metadata;
+    }
+  }
+
+  return nullptr;
+}
+
+
+Error HeifContext::decode_depth_map(heif_image_id ID, const heif_decoding_options& options,
+                                    heif_depth_format format, heif_depth_map* out_map)
+{
+  auto iter = m_all_images.find(ID);
+  if (iter == m_all_images.end()) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Nonexisting_image_referenced);
+  }
+
+  std::shared_ptr<Image> depth_image = iter->second->get_depth_channel();
+  if (!depth_image) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Nonexisting_image_referenced,
+                 "Image has no depth channel");
+  }
+
+  if (!depth_image->has_depth_representation_info()) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_Unspecified,
+                 "Depth channel has no depth representation info");
+  }
+
+  // the depth image is decoded as coded, and thus shares the image cache with other users
+
+  heif_decoding_options depth_options = options;
+  depth_options.output_chroma = heif_chroma_undefined;
+  depth_options.premultiply_alpha = false;
+  depth_options.progress_callback = nullptr;
+  depth_options.progress_user_data = nullptr;
+  depth_options.progress_granularity = heif_progress_granularity_tile;
+  depth_options.plane_alignment = 0;
+  depth_options.row_padding = 0;
+  depth_options.convert_to_srgb = false;
+
+  std::shared_ptr<const HeifPixelImage> depth;
+  Error err = decode_image(depth_image->get_id(), depth_options, &depth);
+  if (err) {
+    return err;
+  }
+
+  int bytes_per_value = (format == heif_depth_format_uint16 ? 2 : 4);
+  int stride = depth->get_width() * bytes_per_value;
+
+  uint64_t size = static_cast<uint64_t>(stride) * depth->get_height();
+
+  std::unique_ptr<DepthMapBuffer> buffer(new (std::nothrow) DepthMapBuffer);
+  if (!buffer) {
+    return Error(heif_error_Memory_allocation_error,
+                 heif_suberror_Unspecified);
+  }
+
+  err = buffer->charge.charge(m_memory_account, size, "Depth map");
+  if (err) {
+    return err;
+  }
+
+  if (size > std::numeric_limits<size_t>::max() ||
+      !buffer->data.allocate(m_memory_account->get_buffer_pool(), (size_t)size)) {
+    return Error(heif_error_Memory_allocation_error,
+                 heif_suberror_Unspecified);
+  }
+
+  err = convert_depth_map(*depth, depth_image->get_depth_representation_info(), format,
+                          buffer->data.data(), stride);
+  if (err) {
+    return err;
+  }
+
+  out_map->width = depth->get_width();
+  out_map->height = depth->get_height();
+  out_map->format = format;
+  out_map->stride = stride;
+  out_map->data = buffer->data.data();
+  out_map->buffer = buffer.release();
+
+  return Error::Ok;
+}
+
+
+Error HeifContext::decode_rgb_image(heif_image_id ID, const heif_decoding_options& options,
+                                    const DerivationChain* chain,
+                                    std::shared_ptr<const HeifPixelImage>* out_img)
+{
+  if (options.output_chroma != heif_chroma_interleaved_24bit &&
+      options.output_chroma != heif_chroma_interleaved_32bit) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unsupported_color_conversion,
+                 "Unsupported output chroma format");
+  }
+
+  // look up the colour transform before decoding, it may not be available
+  std::shared_ptr<const ColorTransform> transform;
+  const std::vector<uint8_t>* icc_profile = options.convert_to_srgb ? get_icc_profile(ID) : nullptr;
+  if (icc_profile) {
+    Error err = ColorTransformCache::get_instance().get_transform(*icc_profile,
+                                                                  (heif_chroma)options.output_chroma,
+                                                                  &transform);
+    if (err) {
+      return err;
+    }
+  }
+
+  // The coded images are cached on their own, other output formats reuse them.
+  heif_decoding_options coded_options = options;
+  coded_options.output_chroma = heif_chroma_undefined;
+  coded_options.premultiply_alpha = false;
+  coded_options.progress_callback = nullptr;
+  coded_options.plane_alignment = 0;
+  coded_options.row_padding = 0;
+  coded_options.convert_to_srgb = false;
+
+  std::shared_ptr<Image> alpha_image;
+  if (options.output_chroma == heif_chroma_interleaved_32bit) {
+    alpha_image = m_all_images.find(ID)->second->get_alpha_channel();
+  }
+
+  std::shared_ptr<const HeifPixelImage> colour;
+  Error colour_err;
+
+  // The task only references this, so that it is queued without allocating.
+  struct {
+    heif_image_id ID;
+    const heif_decoding_options* options;
+    const DerivationChain* chain;
+    std::shared_ptr<const HeifPixelImage> img;
+    Error err;
+  } alpha;
+
+  {
+    TaskGroup tasks(ThreadPool::get_instance());
+
+    if (alpha_image) {
+      alpha.ID = alpha_image->get_id();
+      alpha.options = &coded_options;
+      alpha.chain = chain;
+      tasks.add_task([this, &alpha]() {
+          alpha.err = decode_image(alpha.ID, *alpha.options, alpha.chain, &alpha.img);
+        });
+    }
+
+    colour_err = decode_image(ID, coded_options, chain, &colour);
+
+    tasks.wait();
+  }
+
+  if (colour_err) {
+    return colour_err;
+  }
+
+  if (alpha.err) {
+    return alpha.err;
+  }
+
+  NclxColour nclx = get_nclx_colour(ID);
+
+  YCbCrCoding coding;
+  if (nclx.source != heif_colour_source_default) {
+    coding.matrix_coefficients = nclx.matrix_coefficients;
+    coding.full_range = nclx.full_range;
+  }
+
+  std::shared_ptr<HeifPixelImage> img;
+  Error err = convert_to_rgb(*colour, alpha.img.get(), (heif_chroma)options.output_chroma,
+                             options.premultiply_alpha != 0, &img, m_memory_account,
+                             get_plane_layout(options), coding, transform.get());
+  if (err) {
+    return err;
+  }
+
+  report_decoded_region(options, *img, ImageTransform(img->get_width(), img->get_height()),
+                        0, 0, img->get_width(), img->get_height());
+
+  *out_img = img;
+  return Error::Ok;
+}
+
+
+Error HeifContext::decode_coded_image(heif_image_id ID, heif_compression_format format,
+                                      const heif_decoding_options& options,
+                                      std::shared_ptr<const HeifPixelImage>* out_img)
+{
+  const HeifFile::Item* item = m_heif_file->get_item(ID);
+
+  // The decoder allocates its frames with the coded size, which may be larger than 'ispe'.
+  const HEVCStreamInfo* hevc_info = get_hevc_info(ID);
+  if (format == heif_compression_HEVC && hevc_info) {
+    Error err = check_image_size(m_limits, hevc_info->coded_width, hevc_info->coded_height);
+    if (err) {
+      return err;
+    }
+  }
+
+  AllocatedBuffer data;
+  MemoryCharge data_charge;
+  Error err = read_compressed_data(*m_heif_file, m_memory_account, &ID, 1, &data, &data_charge);
+  if (err) {
+    return err;
+  }
+
+  // Likewise, the JPEG decoder allocates its output with the (scaled) size of the frame header.
+  uint32_t jpeg_width, jpeg_height;
+  if (format == heif_compression_JPEG &&
+      get_jpeg_frame_size(data.data(), data.size(), &jpeg_width, &jpeg_height)) {
+    int denominator = std::max((int)options.scale_denominator, 1);
+    err = check_image_size(m_limits,
+                           (jpeg_width + denominator - 1) / denominator,
+                           (jpeg_height + denominator - 1) / denominator);
+    if (err) {
+      return err;
+    }
+  }
+
+  const heif_decoder_plugin* decoder = nullptr;
+  err = get_decoder_plugin(format, options, &decoder);
+  if (err) {
+    return err;
+  }
+
+  std::shared_ptr<HeifPixelImage> img;
+  ImageTransform transform;
+
+  err = decode_stream(decoder, data.data(), data.size(), item->nal_length_size,
+                      options.scale_denominator, m_memory_account,
+                      [&](const HeifPixelImage& picture) -> Error {
+                        if (img) {
+                          // only the first picture is used
+                          return Error::Ok;
+                        }
+
+                        transform = get_item_transform(*item,
+                                                       picture.get_width(), picture.get_height(),
+                                                       options);
+
+                        img = HeifPixelImage::new_image(m_memory_account);
+                        Error err = img->create(transform.get_output_width(),
+                                                transform.get_output_height(),
+                                                picture.get_chroma_format(),
+                                                m_memory_account,
+                                                get_plane_layout(options));
+                        if (err) {
+                          return err;
+                        }
+
+                        return picture.copy_into_transformed(img.get(), 0, 0, transform);
+                      });
+  if (err) {
+    return err;
+  }
+
+  if (!img) {
+    return Error(heif_error_Decoder_plugin_error,
+                 heif_suberror_Unspecified,
+                 "No image decoded");
+  }
+
+  report_decoded_region(options, *img, transform,
+                        0, 0, transform.get_source_width(), transform.get_source_height());
+
+  *out_img = img;
+  return Error::Ok;
+}
+
+
+Error HeifContext::decode_grid_image(heif_image_id ID, const heif_decoding_options& options,
+                                     std::shared_ptr<const HeifPixelImage>* out_img)
+{
+  ImageGrid grid;
+  Error err = grid.read(*m_heif_file, ID);
+  if (err) {
+    return err;
+  }
+
+  const HeifFile::Item* item = m_heif_file->get_item(ID);
+  if (item->reference_type != fourcc("dimg")) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_No_iref_box,
+                 "No iref box available, but needed for grid image");
+  }
+
+  const std::vector<heif_image_id>& image_references = item->references;
+
+  err = check_image_size(m_limits, grid.get_width(), grid.get_height());
+  if (err) {
+    return err;
+  }
+
+  uint32_t num_tiles = (uint32_t)grid.get_rows() * grid.get_columns();
+  if (m_limits.max_tiles && num_tiles > m_limits.max_tiles) {
+    return limit_exceeded_error("Number of grid tiles", num_tiles, m_limits.max_tiles);
+  }
+
+  if ((int)image_references.size() != grid.get_rows() * grid.get_columns()) {
+    std::stringstream sstr;
+    sstr << "Tiled image with " << grid.get_rows() << "x" <<  grid.get_columns() << "="
+         << (grid.get_rows() * grid.get_columns()) << " tiles, but only "
+         << image_references.size() << " tile images in file";
+
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_Missing_grid_images,
+                 sstr.str());
+  }
+
+
+  // --- check that the tiles can be decoded as one stream
+
+  int nal_length_size = 0;
+  bool all_tiles_available = true;
+  const HEVCStreamInfo* first_tile_info = nullptr;
+
+  for (heif_image_id tileID : image_references) {
+    const HeifFile::Item* tile = m_heif_file->get_item(tileID);
+    if (!tile) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_Missing_grid_images);
+    }
+
+    if (tile->nal_length_size == 0) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_No_hvcC_box);
+    }
+
+    if (nal_length_size == 0) {
+      nal_length_size = tile->nal_length_size;
+    }
+    else if (nal_length_size != tile->nal_length_size) {
+      return Error(heif_error_Unsupported_feature,
+                   heif_suberror_Unsupported_data_version,
+                   "Grid tiles with different NAL length sizes");
+    }
+
+    // Tiles are placed assuming they all have the size of the first one.
+    const HEVCStreamInfo* tile_info = get_hevc_info(tileID);
+    if (tile_info) {
+      err = check_image_size(m_limits, tile_info->coded_width, tile_info->coded_height);
+      if (err) {
+        return err;
+      }
+
+      if (!first_tile_info) {
+        first_tile_info = tile_info;
+      }
+      else if (tile_info->get_cropped_width() != first_tile_info->get_cropped_width() ||
+               tile_info->get_cropped_height() != first_tile_info->get_cropped_height() ||
+               tile_info->chroma_format_idc != first_tile_info->chroma_format_idc) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Invalid_grid_data,
+                     "Grid tiles with different sizes or chroma formats");
+      }
+    }
+
+    all_tiles_available &= m_heif_file->is_item_data_available(tileID);
+  }
+
+
+  // --- decode tiles and place them into the output image, already cropped, rotated and mirrored
+
+  ImageTransform transform = get_item_transform(*item, grid.get_width(), grid.get_height(), options);
+
+  std::shared_ptr<HeifPixelImage> img;
+  size_t tile_idx = 0;
+  int tile_width = 0, tile_height = 0;
+
+  const heif_decoder_plugin* decoder = nullptr;
+  err = get_decoder_plugin(heif_compression_HEVC, options, &decoder);
+  if (err) {
+    return err;
+  }
+
+  // All tiles are decoded as one stream. While the file is still arriving (see HeifPushParser),
+  // each row of tiles is decoded as soon as its data is complete.
+  size_t batch_size = image_references.size();
+  if (!all_tiles_available) {
+    batch_size = grid.get_columns();
+  }
+
+  for (size_t batch_start = 0; batch_start < image_references.size(); batch_start += batch_size) {
+    size_t batch_end = std::min(batch_start + batch_size, image_references.size());
+
+    AllocatedBuffer data;
+    MemoryCharge data_charge;
+    err = read_compressed_data(*m_heif_file, m_memory_account,
+                               &image_references[batch_start], batch_end - batch_start,
+                               &data, &data_charge);
+    if (err) {
+      return err;
+    }
+
+    err = decode_stream(decoder, data.data(), data.size(), nal_length_size, 1, m_memory_account,
+                        [&](const HeifPixelImage& tile) -> Error {
+                          if (tile_idx == batch_end) {
+                            return Error::Ok;
+                          }
+
+                          if (!img) {
+                            img = HeifPixelImage::new_image(m_memory_account);
+                            Error err = img->create(transform.get_output_width(),
+                                                    transform.get_output_height(),
+                                                    tile.get_chroma_format(),
+                                                    m_memory_account,
+                                                    get_plane_layout(options));
+                            if (err) {
+                              return err;
+                            }
+
+                            tile_width = tile.get_width();
+                            tile_height = tile.get_height();
+                          }
+
+                          int column = (int)(tile_idx % grid.get_columns());
+                          int x0 = column * tile_width;
+                          int y0 = (int)(tile_idx / grid.get_columns()) * tile_height;
+
+                          tile_idx++;
+
+                          // tiles in the last row and column are cropped at the image border
+                          Error err = tile.copy_into_transformed(img.get(), x0, y0, transform);
+                          if (err) {
+                            return err;
+                          }
+
+                          if (options.progress_granularity == heif_progress_granularity_tile_row) {
+                            if (column == grid.get_columns() - 1) {
+                              report_decoded_region(options, *img, transform,
+                                                    0, y0, grid.get_width(), tile_height);
+                            }
+                          }
+                          else {
+                            report_decoded_region(options, *img, transform,
+                                                  x0, y0, tile_width, tile_height);
+                          }
+
+                          return Error::Ok;
+                        });
+    if (err) {
+      return err;
+    }
+
+    if (tile_idx != batch_end) {
+      break;
+    }
+  }
+
+  if (tile_idx != image_references.size()) {
+    return Error(heif_error_Decoder_plugin_error,
+                 heif_suberror_Missing_grid_images,
+                 "Decoder did not output all tiles of the grid image");
+  }
+
+  *out_img = img;
+  return Error::Ok;
+}
+
+
+Error HeifContext::decode_iden_image(heif_image_id ID, const heif_decoding_options& options,
+                                     const DerivationChain* chain,
+                                    std::shared_ptr<const HeifPixelImage>* out_img)
+{
+  const HeifFile::Item* item = m_heif_file->get_item(ID);
+  if (item->reference_type != fourcc("dimg") || item->references.size() != 1) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_No_iref_box,
+                 "Identity image needs exactly one 'dimg' reference");
+  }
+
+  heif_image_id source_ID = item->references[0];
+
+  // --- the source goes through decode_image() and the image cache, so that a source
+  //     that is also displayed on its own, or shared by several identity images, is
+  //     decoded only once
+
+  heif_decoding_options source_options = options;
+  source_options.progress_callback = nullptr;
+
+  DerivationChain source_chain = { ID, chain };
+
+  std::shared_ptr<const HeifPixelImage> source;
+  Error err = decode_image(source_ID, source_options, &source_chain, &source);
+  if (err) {
+    return err;
+  }
+
+  ImageTransform transform = get_item_transform(*item, source->get_width(), source->get_height(),
+                                                options);
+
+  if (transform.is_identity()) {
+    *out_img = source;
+  }
+  else if (transform.is_crop_only()) {
+    *out_img = HeifPixelImage::create_view(source,
+                                           transform.get_crop_left(), transform.get_crop_top(),
+                                           transform.get_output_width(), transform.get_output_height(),
+                                           m_memory_account);
+  }
+  else {
+    auto img = HeifPixelImage::new_image(m_memory_account);
+    err = img->create(transform.get_output_width(), transform.get_output_height(),
+                      source->get_chroma_format(), m_memory_account,
+                      get_plane_layout(options));
+    if (err) {
+      return err;
+    }
+
+    err = source->copy_into_transformed(img.get(), 0, 0, transform);
+    if (err) {
+      return err;
+    }
+
+    *out_img = img;
+  }
+
+  const HeifPixelImage& img = **out_img;
+  report_decoded_region(options, img, ImageTransform(img.get_width(), img.get_height()),
+                        0, 0, img.get_width(), img.get_height());
+
+  return Error::Ok;
+}
+
+
+// Convert the 16-bit RGB background color of an overlay to YCbCr (full range BT.601).
+static void get_overlay_background_ycbcr(const uint16_t rgba[4], uint8_t ycbcr[3])
+{
+  float r = rgba[0] / 257.0f;
+  float g = rgba[1] / 257.0f;
+  float b = rgba[2] / 257.0f;
+
+  float y  =          0.299f    * r + 0.587f    * g + 0.114f    * b;
+  float cb = 128.0f - 0.168736f * r - 0.331264f * g + 0.5f      * b;
+  float cr = 128.0f + 0.5f      * r - 0.418688f * g - 0.081312f * b;
+
+  ycbcr[0] = (uint8_t)std::min(255.0f, std::max(0.0f, y  + 0.5f));
+  ycbcr[1] = (uint8_t)std::min(255.0f, std::max(0.0f, cb + 0.5f));
+  ycbcr[2] = (uint8_t)std::min(255.0f, std::max(0.0f, cr + 0.5f));
+}
+
+
+Error HeifContext::decode_overlay_image(heif_image_id ID, const heif_decoding_options& options,
+                                        const DerivationChain* chain,
+                                    std::shared_ptr<const HeifPixelImage>* out_img)
+{
+  std::vector<uint8_t> overlay_data;
+  Error err = m_heif_file->get_compressed_image_data(ID, &overlay_data);
+  if (err) {
+    return err;
+  }
+
+  const HeifFile::Item* item = m_heif_file->get_item(ID);
+  if (item->reference_type != fourcc("dimg")) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_No_iref_box,
+                 "No iref box available, but needed for overlay image");
+  }
+
+  const std::vector<heif_image_id>& image_references = item->references;
+
+  ImageOverlay overlay;
+  err = overlay.parse(image_references.size(), overlay_data);
+  if (err) {
+    return err;
+  }
+
+  if (overlay.get_canvas_width()  >= static_cast<uint32_t>(std::numeric_limits<int>::max()) ||
+      overlay.get_canvas_height() >= static_cast<uint32_t>(std::numeric_limits<int>::max())) {
+    return Error(heif_error_Memory_allocation_error,
+                 heif_suberror_Security_limit_exceeded,
+                 "Overlay canvas size exceeds the maximum image size");
+  }
+
+  err = check_image_size(m_limits, overlay.get_canvas_width(), overlay.get_canvas_height());
+  if (err) {
+    return err;
+  }
+
+  // --- decode all layers in parallel
+
+  // The layers are composed only once all of them are decoded,
+  // so there is no progress to report before.
+  heif_decoding_options layer_options = options;
+  layer_options.progress_callback = nullptr;
+  layer_options.plane_alignment = 0;
+  layer_options.row_padding = 0;
+
+  size_t num_layers = image_references.size();
+
+  DerivationChain layer_chain = { ID, chain };
+
+  std::vector<std::shared_ptr<const HeifPixelImage>> layers(num_layers);
+  std::vector<Error> layer_errors(num_layers);
+
+  {
+    TaskGroup tasks(ThreadPool::get_instance());
+
+    for (size_t i=0; i<num_layers; i++) {
+      tasks.add_task([&, i]() {
+          layer_errors[i] = decode_image(image_references[i], layer_options, &layer_chain, &layers[i]);
+        });
+    }
+
+    tasks.wait();
+  }
+
+  for (const Error& layer_err : layer_errors) {
+    if (layer_err) {
+      return layer_err;
+    }
+  }
+
+
+  // --- compose layers on the background in the order of the references,
+  //     each layer is placed at its transformed position
+
+  ImageTransform transform = get_item_transform(*item,
+                                                (int)overlay.get_canvas_width(),
+                                                (int)overlay.get_canvas_height(),
+                                                options);
+
+  auto img = HeifPixelImage::new_image(m_memory_account);
+
+  heif_chroma chroma = (num_layers > 0 ? layers[0]->get_chroma_format() : heif_chroma_420);
+
+  err = img->create(transform.get_output_width(), transform.get_output_height(), chroma,
+                    m_memory_account, get_plane_layout(options));
+  if (err) {
+    return err;
+  }
+
+  uint16_t background_rgba[4];
+  overlay.get_background_color(background_rgba);
+
+  uint8_t background[3];
+  get_overlay_background_ycbcr(background_rgba, background);
+  if (chroma == heif_chroma_monochrome) {
+    background[1] = background[2] = 128;
+  }
+
+  img->fill(background);
+
+  for (size_t i=0; i<num_layers; i++) {
+    int32_t x, y;
+    overlay.get_offset(i, &x, &y);
+
+    // only the part of the layer that is inside of the canvas is copied
+    err = layers[i]->copy_into_transformed(img.get(), x, y, transform);
+    if (err) {
+      return err;
+    }
+  }
+
+  report_decoded_region(options, *img, transform,
+                        0, 0, transform.get_source_width(), transform.get_source_height());
+
+  *out_img = img;
+  return Error::Ok;
+}
@@ -23,23 +23,47 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
 
 #include "error.h"
 
+#include "heif_cache.h"
 #include "heif_file.h"
+#include "heif_hevc.h"
+#include "heif_image.h"
+#include "heif_limits.h"
 #include "heif.h"
 
 namespace heif {
 
+  class HeifPushParser;
 
+
+  // Metadata item of an image. Its data is only read on first access, see
+  // HeifContext::get_metadata_data().
   class ImageMetadata
   {
   public:
     std::string item_type;  // e.g. "Exif"
-    std::vector<uint8_t> m_data;
+    heif_image_id item_id = 0;
+
+  private:
+    friend class HeifContext;
+
+    std::mutex m_mutex;
+    bool m_loaded = false;
+    std::vector<uint8_t> m_data;  // only used if the data cannot be referenced in the input
+  };
+
+
+  // Owner of the data of a heif_depth_map, deleted by heif_depth_map_release().
+  struct DepthMapBuffer
+  {
+    AllocatedBuffer data;
+    MemoryCharge charge;
   };
 
 
@@ -54,18 +78,102 @@ namespace heif {
     Error read_from_file(const char* input_filename);
     Error read_from_memory(const void* data, size_t size);
 
+    // Like read_from_file(), but take the item table from the index file if it matches
+    // the input file. Otherwise the file is parsed and the index file is (re)written.
+    Error read_from_file_with_index(const char* input_filename, const char* index_filename);
+
+    // Limits for reading and decoding files (see heif_resource_limits). The limits on the
+    // file structure apply to files read afterwards.
+    void set_limits(const heif_resource_limits& limits);
+
+    const heif_resource_limits& get_limits() const { return m_limits; }
+
+    // Allocator for the large buffers of this context. Only possible before reading a file.
+    Error set_allocator(const std::shared_ptr<const Allocator>& allocator);
+
+    // Memory held by decodes of this context: compressed data, decoder frames and
+    // decoded images.
+    const std::shared_ptr<MemoryAccount>& get_memory_account() const { return m_memory_account; }
+
+    // Read a file that is still arriving. The parser must have received the 'meta' box.
+    Error read_from_push_parser(const HeifPushParser& parser);
+
+    // Whether all data needed to decode image 'ID' has been received: its coded data, the
+    // images it is derived from (grid tiles, overlay and identity inputs) and its alpha image.
+    // Always true unless the file is read from a HeifPushParser.
+    bool is_image_data_available(heif_image_id ID) const;
+
+    // Number of leading rows of grid tiles whose data has been received. Images that are not
+    // grids count as one row.
+    int get_available_tile_rows(heif_image_id ID) const;
+
+    // Byte ranges of the input needed for 'target' of image 'ID', sorted, with ranges less
+    // than 'merge_gap' bytes apart merged. For a file read from a HeifPushParser only the
+    // missing data is returned. 'region' is used with heif_fetch_target_region.
+    Error get_fetch_ranges(heif_image_id ID, heif_fetch_target target,
+                           const heif_fetch_region* region, uint64_t merge_gap,
+                           std::vector<heif_byte_range>* ranges) const;
+
+    // Write the loaded file with 'meta' before the item data (see heif_remux.h).
+    Error write_fast_start_file(const char* output_filename, bool decoding_order) const;
+
     Error get_heif_image_data(heif_image_id ID, heif_image* out_data);
 
     heif_image* create_heif_image_buffer();
     // destory image compressed data buffer
     int destory_heif_image_buffer(heif_image* out_data);
 
+    Error decode_image(heif_image_id ID, const heif_decoding_options& options,
+                       std::shared_ptr<const HeifPixelImage>* out_img);
+
+    // Data of a metadata item. It references the input when that is held in memory,
+    // otherwise it is read once and kept. Valid as long as this context exists.
+    Error get_metadata_data(const std::shared_ptr<ImageMetadata>& metadata,
+                            const uint8_t** out_data, size_t* out_size);
+
+    // First Exif metadata item of image 'ID', or nullptr.
+    std::shared_ptr<ImageMetadata> get_exif_metadata(heif_image_id ID) const;
+
+    // Parameter sets of an HEVC coded image, or of the first tile of a grid image.
+    // nullptr if the image is not HEVC coded or its SPS could not be read.
+    const HEVCStreamInfo* get_hevc_info(heif_image_id ID) const;
+
+    // 'nclx' colour information of an image, ISO/IEC 23091-2 codes
+    struct NclxColour {
+      heif_colour_source source = heif_colour_source_default;
+      uint16_t colour_primaries = 2;
+      uint16_t transfer_characteristics = 2;
+      uint16_t matrix_coefficients = 2;
+      bool full_range = true;
+    };
+
+    // Colour information of image 'ID', from its 'colr' box, or for grid and identity images
+    // from the image they are derived from, or from the VUI of the HEVC stream. Without
+    // any of these, full range with unspecified codes (converted as BT.601).
+    NclxColour get_nclx_colour(heif_image_id ID) const;
+
+    // ICC profile of image 'ID' (or of the image it is derived from), nullptr if there is none.
+    // Valid as long as this context exists.
+    const std::vector<uint8_t>* get_icc_profile(heif_image_id ID) const;
+
+    // Decode the depth channel of image 'ID' and convert it to depth values.
+    // out_map->data is allocated from the buffer pool and charged to the memory account.
+    Error decode_depth_map(heif_image_id ID, const heif_decoding_options& options,
+                           heif_depth_format format, heif_depth_map* out_map);
+
+    // Let the planes of 'img' point to the decoded image, keeping a reference on it.
+    // Fails if the image is not charged to this handle yet and exceeds its memory limit.
+    Error attach_decoded_image(heif_image* img, const std::shared_ptr<const HeifPixelImage>& decoded);
+    void release_decoded_image(heif_image* img);
+
     heif_image_id image_index_to_id(int img_index);
     int image_id_to_index(heif_image_id ID);
 
     class Image : public ErrorBuffer {
     public:
-      Image(HeifContext* file, heif_image_id id);
+      // Images are shared between all contexts reading the same file (see ParsedFile),
+      // so they do not reference the context that created them.
+      Image(heif_image_id id);
       ~Image();
 
       void set_resolution(int w,int h) { m_width=w; m_height=h; }
@@ -128,9 +236,14 @@ namespace heif {
 
       std::vector<std::shared_ptr<ImageMetadata>> get_metadata() const { return m_metadata; }
 
-    private:
-      HeifContext* m_heif_context;
 
+      // --- HEVC parameter sets of coded images, read when the file is interpreted
+
+      void set_hevc_info(const HEVCStreamInfo& info) { m_hevc_info = info; }
+
+      const HEVCStreamInfo& get_hevc_info() const { return m_hevc_info; }
+
+    private:
       heif_image_id m_id;
       uint32_t m_width=0, m_height=0;
       bool     m_is_primary = false;
@@ -156,6 +269,8 @@ namespace heif {
       struct heif_depth_representation_info m_depth_representation_info;
 
       std::vector<std::shared_ptr<ImageMetadata>> m_metadata;
+
+      HEVCStreamInfo m_hevc_info;
     };
 
 
@@ -178,13 +293,59 @@ namespace heif {
 
     std::shared_ptr<HeifFile> m_heif_file;
 
+    // identity of the input, used as key into the image cache
+    FileIdentity m_file_identity;
+
+    heif_resource_limits m_limits;
+
+    std::shared_ptr<MemoryAccount> m_memory_account;
+
     Error interpret_heif_file();
 
+    // share the parsed structure with other contexts reading the same file
+    bool attach_parsed_file();
+    void store_parsed_file();
+
     void remove_top_level_image(std::shared_ptr<Image> image);
 
     Error get_grid_image_data(heif_image_id ID, heif_image* out_data);
 
+    // image coded as a single picture ('hvc1', 'jpeg')
+    Error decode_coded_image(heif_image_id ID, heif_compression_format format,
+                             const heif_decoding_options& options,
+                             std::shared_ptr<const HeifPixelImage>* out_img);
+    Error decode_grid_image(heif_image_id ID, const heif_decoding_options& options,
+                            std::shared_ptr<const HeifPixelImage>* out_img);
+    // Derived images ('iden', 'iovl') whose inputs are being decoded, innermost first.
+    // Kept on the stack of the decoding calls.
+    struct DerivationChain {
+      heif_image_id ID;
+      const DerivationChain* parent;
+    };
+
+    Error decode_iden_image(heif_image_id ID, const heif_decoding_options& options,
+                            const DerivationChain* chain,
+                            std::shared_ptr<const HeifPixelImage>* out_img);
+    Error decode_overlay_image(heif_image_id ID, const heif_decoding_options& options,
+                               const DerivationChain* chain,
+                               std::shared_ptr<const HeifPixelImage>* out_img);
+
+    // coded image and alpha decoded in parallel, then converted to RGB(A)
+    Error decode_rgb_image(heif_image_id ID, const heif_decoding_options& options,
+                           const DerivationChain* chain,
+                           std::shared_ptr<const HeifPixelImage>* out_img);
+
+    // decode_image() of an input of the derived images in 'chain' (may be null).
+    // An image that is already part of the chain references itself and is rejected.
+    Error decode_image(heif_image_id ID, const heif_decoding_options& options,
+                       const DerivationChain* chain,
+                       std::shared_ptr<const HeifPixelImage>* out_img);
+
+    // Make room for 'size' bytes, keeping the buffer when it is already large enough.
+    bool base_image_reserve(base_image *base, size_t size);
     int base_image_add_data(uint8_t *data, int data_len, base_image *base);
+    // Append the compressed data of the items, read in place into a buffer allocated once.
+    Error base_image_read_items(const heif_image_id* IDs, size_t num, base_image *base);
     void destory_base_image_buffer(base_image *base);
     int add_heif_sub_image(uint8_t *data, int data_len, heif_image *img);
 
@@ -192,6 +353,18 @@ namespace heif {
 
 
   };
+
+
+  // Parsed structure of a HEIF file: the box tree and the images derived from it.
+  // It is not modified after HeifContext::interpret_heif_file() and may be shared by
+  // all contexts reading the same file, also from different threads.
+  struct ParsedFile {
+    std::shared_ptr<HeifFile> heif_file;
+
+    std::map<heif_image_id, std::shared_ptr<HeifContext::Image>> all_images;
+    std::vector<std::shared_ptr<HeifContext::Image>> top_level_images;
+    std::shared_ptr<HeifContext::Image> primary_image;
+  };
 }
 
 #endif
@@ -0,0 +1,135 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_depth.h"
+
+#include <math.h>
+#include <string.h>
+
+
+using namespace heif;
+
+
+// Value represented by each of the 256 sample values. The samples are 8 bit,
+// so converting them is a table lookup instead of arithmetic per sample.
+static Error build_depth_table(const heif_depth_representation_info& info, float table[256])
+{
+  heif_depth_representation_type type = info.depth_representation_type;
+
+  if (type != heif_depth_representation_type_uniform_inverse_Z &&
+      type != heif_depth_representation_type_uniform_disparity &&
+      type != heif_depth_representation_type_uniform_Z) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unspecified,
+                 "Unsupported depth representation type");
+  }
+
+  bool has_parameters;
+  if (type == heif_depth_representation_type_uniform_disparity) {
+    has_parameters = (info.has_d_min && info.has_d_max);
+  }
+  else {
+    has_parameters = (info.has_z_near && info.has_z_far);
+  }
+
+  if (!has_parameters) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_Unspecified,
+                 "Depth representation info lacks the parameters of its representation type");
+  }
+
+  for (int i=0;i<256;i++) {
+    double v = i / 255.0;
+    double value;
+
+    if (type == heif_depth_representation_type_uniform_inverse_Z) {
+      // 0: 1/z_far, 255: 1/z_near
+      value = 1.0 / (1.0/info.z_far + v * (1.0/info.z_near - 1.0/info.z_far));
+    }
+    else if (type == heif_depth_representation_type_uniform_disparity) {
+      value = info.d_min + v * (info.d_max - info.d_min);
+    }
+    else {
+      // 0: z_near, 255: z_far
+      value = info.z_near + v * (info.z_far - info.z_near);
+    }
+
+    table[i] = (float)value;
+  }
+
+  return Error::Ok;
+}
+
+
+Error heif::convert_depth_map(const HeifPixelImage& depth,
+                              const heif_depth_representation_info& info,
+                              heif_depth_format format,
+                              uint8_t* out, int out_stride)
+{
+  float table[256];
+  Error err = build_depth_table(info, table);
+  if (err) {
+    return err;
+  }
+
+  int width = depth.get_width();
+  int height = depth.get_height();
+
+  int in_stride;
+  const uint8_t* in = depth.get_plane(0, &in_stride);
+  if (!in || HeifPixelImage::get_bytes_per_pixel(depth.get_chroma_format()) != 1) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion);
+  }
+
+  if (format == heif_depth_format_float32) {
+    for (int y=0;y<height;y++) {
+      const uint8_t* row_in = in + y*in_stride;
+      float* row_out = reinterpret_cast<float*>(out + y*out_stride);
+
+      for (int x=0;x<width;x++) {
+        row_out[x] = table[row_in[x]];
+      }
+    }
+  }
+  else if (format == heif_depth_format_uint16) {
+    uint16_t table16[256];
+    for (int i=0;i<256;i++) {
+      double v = floor(table[i] * 1000.0 + 0.5);
+      table16[i] = (uint16_t)(v < 0 ? 0 : (v > 65535 ? 65535 : v));
+    }
+
+    for (int y=0;y<height;y++) {
+      const uint8_t* row_in = in + y*in_stride;
+      uint16_t* row_out = reinterpret_cast<uint16_t*>(out + y*out_stride);
+
+      for (int x=0;x<width;x++) {
+        row_out[x] = table16[row_in[x]];
+      }
+    }
+  }
+  else {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "Unknown depth format");
+  }
+
+  return Error::Ok;
+}
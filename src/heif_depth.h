@@ -0,0 +1,39 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_DEPTH_H
+#define LIBHEIF_HEIF_DEPTH_H
+
+#include "heif_image.h"
+
+
+namespace heif {
+
+  // Convert the luma samples of a decoded depth image to depth values (or disparity,
+  // for disparity representations) as described by the depth representation info.
+  // 'out' holds depth->get_height() rows of depth->get_width() values of 'format'.
+  Error convert_depth_map(const HeifPixelImage& depth,
+                          const heif_depth_representation_info& info,
+                          heif_depth_format format,
+                          uint8_t* out, int out_stride);
+
+}
+
+#endif
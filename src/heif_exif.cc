@@ -0,0 +1,285 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_exif.h"
+
+#include <string.h>
+
+
+using namespace heif;
+
+
+namespace {
+
+  // TIFF tags
+  const uint16_t kTagOrientation      = 0x0112;
+  const uint16_t kTagDateTime         = 0x0132;
+  const uint16_t kTagExifIFD          = 0x8769;
+  const uint16_t kTagDateTimeOriginal = 0x9003;
+  const uint16_t kTagPixelXDimension  = 0xA002;
+  const uint16_t kTagPixelYDimension  = 0xA003;
+
+  // TIFF field types
+  const uint16_t kTypeASCII = 2;
+  const uint16_t kTypeShort = 3;
+  const uint16_t kTypeLong  = 4;
+
+  // Offsets are relative to the TIFF header.
+  class TiffReader
+  {
+  public:
+    TiffReader(const uint8_t* data, size_t size, bool big_endian)
+      : m_data(data), m_size(size), m_big_endian(big_endian) { }
+
+    bool read16(size_t pos, uint16_t* value) const {
+      if (pos > m_size || m_size - pos < 2) {
+        return false;
+      }
+
+      const uint8_t* p = m_data + pos;
+      *value = (uint16_t)(m_big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0]);
+      return true;
+    }
+
+    bool read32(size_t pos, uint32_t* value) const {
+      if (pos > m_size || m_size - pos < 4) {
+        return false;
+      }
+
+      const uint8_t* p = m_data + pos;
+      if (m_big_endian) {
+        *value = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+      }
+      else {
+        *value = ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+      }
+      return true;
+    }
+
+    bool read_string(size_t pos, size_t length, std::string* value) const {
+      if (pos > m_size || m_size - pos < length) {
+        return false;
+      }
+
+      const char* p = reinterpret_cast<const char*>(m_data + pos);
+      *value = std::string(p, strnlen(p, length));
+      return true;
+    }
+
+  private:
+    const uint8_t* m_data;
+    size_t m_size;
+    bool m_big_endian;
+  };
+
+
+  struct IFDEntry {
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    size_t value_pos;  // values of up to 4 bytes are stored in the entry itself
+  };
+
+
+  // Read an integer value (SHORT or LONG) of an entry.
+  bool read_integer(const TiffReader& reader, const IFDEntry& entry, uint32_t* value)
+  {
+    if (entry.count != 1) {
+      return false;
+    }
+
+    if (entry.type == kTypeShort) {
+      uint16_t v;
+      if (!reader.read16(entry.value_pos, &v)) {
+        return false;
+      }
+
+      *value = v;
+      return true;
+    }
+
+    if (entry.type == kTypeLong) {
+      return reader.read32(entry.value_pos, value);
+    }
+
+    return false;
+  }
+
+
+  template <class Visitor>
+  bool walk_ifd(const TiffReader& reader, uint32_t ifd_offset, Visitor visit)
+  {
+    uint16_t num_entries;
+    if (!reader.read16(ifd_offset, &num_entries)) {
+      return false;
+    }
+
+    for (uint16_t i=0; i<num_entries; i++) {
+      size_t pos = (size_t)ifd_offset + 2 + 12*(size_t)i;
+
+      IFDEntry entry;
+      if (!reader.read16(pos, &entry.tag) ||
+          !reader.read16(pos+2, &entry.type) ||
+          !reader.read32(pos+4, &entry.count)) {
+        return false;
+      }
+
+      size_t type_size = (entry.type == kTypeShort ? 2 : (entry.type == kTypeLong ? 4 : 1));
+      uint64_t value_size = (uint64_t)type_size * entry.count;
+
+      if (value_size <= 4) {
+        entry.value_pos = pos + 8;
+      }
+      else {
+        uint32_t value_offset;
+        if (!reader.read32(pos+8, &value_offset)) {
+          return false;
+        }
+
+        entry.value_pos = value_offset;
+      }
+
+      visit(entry);
+    }
+
+    return true;
+  }
+}
+
+
+Error heif::parse_exif_item(const uint8_t* data, size_t size, ExifInfo* out_info)
+{
+  *out_info = ExifInfo();
+
+  const Error invalid_exif(heif_error_Invalid_input,
+                           heif_suberror_Unspecified,
+                           "Invalid Exif data");
+
+  if (size < 4) {
+    return invalid_exif;
+  }
+
+  uint64_t tiff_start = 4 + (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                             ((uint32_t)data[2] << 8) | data[3]);
+
+  // some writers let the offset point to the "Exif\0\0" marker in front of the TIFF header
+  if (tiff_start + 6 <= size && memcmp(data + tiff_start, "Exif\0\0", 6) == 0) {
+    tiff_start += 6;
+  }
+
+  if (tiff_start + 8 > size) {
+    return invalid_exif;
+  }
+
+  const uint8_t* tiff = data + tiff_start;
+  size_t tiff_size = size - (size_t)tiff_start;
+
+  bool big_endian;
+  if (memcmp(tiff, "MM\0*", 4) == 0) {
+    big_endian = true;
+  }
+  else if (memcmp(tiff, "II*\0", 4) == 0) {
+    big_endian = false;
+  }
+  else {
+    return invalid_exif;
+  }
+
+  TiffReader reader(tiff, tiff_size, big_endian);
+
+  uint32_t ifd0_offset = 0;
+  reader.read32(4, &ifd0_offset);
+
+
+  // --- IFD0
+
+  uint32_t exif_ifd_offset = 0;
+  std::string date_time;
+
+  bool ok = walk_ifd(reader, ifd0_offset, [&](const IFDEntry& entry) {
+      uint32_t value;
+
+      switch (entry.tag) {
+      case kTagOrientation:
+        if (read_integer(reader, entry, &value) && value >= 1 && value <= 8) {
+          out_info->has_orientation = true;
+          out_info->orientation = (int)value;
+        }
+        break;
+
+      case kTagDateTime:
+        if (entry.type == kTypeASCII) {
+          reader.read_string(entry.value_pos, entry.count, &date_time);
+        }
+        break;
+
+      case kTagExifIFD:
+        if (read_integer(reader, entry, &value)) {
+          exif_ifd_offset = value;
+        }
+        break;
+      }
+    });
+
+  if (!ok) {
+    return invalid_exif;
+  }
+
+
+  // --- Exif IFD
+
+  uint32_t width = 0, height = 0;
+
+  if (exif_ifd_offset != 0) {
+    walk_ifd(reader, exif_ifd_offset, [&](const IFDEntry& entry) {
+        switch (entry.tag) {
+        case kTagDateTimeOriginal:
+          if (entry.type == kTypeASCII) {
+            std::string original;
+            if (reader.read_string(entry.value_pos, entry.count, &original) && !original.empty()) {
+              date_time = original;
+            }
+          }
+          break;
+
+        case kTagPixelXDimension:
+          read_integer(reader, entry, &width);
+          break;
+
+        case kTagPixelYDimension:
+          read_integer(reader, entry, &height);
+          break;
+        }
+      });
+  }
+
+  if (!date_time.empty()) {
+    out_info->has_capture_time = true;
+    out_info->capture_time = date_time;
+  }
+
+  if (width != 0 && height != 0) {
+    out_info->has_dimensions = true;
+    out_info->width = width;
+    out_info->height = height;
+  }
+
+  return Error::Ok;
+}
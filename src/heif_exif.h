@@ -0,0 +1,53 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_EXIF_H
+#define LIBHEIF_HEIF_EXIF_H
+
+#include "error.h"
+
+#include <stdint.h>
+#include <string>
+
+
+namespace heif {
+
+  // The few Exif fields needed when displaying an image, read without a full Exif library.
+  struct ExifInfo {
+    bool has_orientation = false;
+    int orientation = 1;  // 1..8, as defined by TIFF
+
+    // "YYYY:MM:DD HH:MM:SS", DateTimeOriginal, or DateTime if there is none
+    bool has_capture_time = false;
+    std::string capture_time;
+
+    // PixelXDimension / PixelYDimension
+    bool has_dimensions = false;
+    uint32_t width = 0;
+    uint32_t height = 0;
+  };
+
+  // Parse the content of an 'Exif' item: a 32 bit offset to the TIFF header, followed by
+  // the Exif data. Only IFD0 and the Exif IFD are walked, all reads are bounds checked.
+  Error parse_exif_item(const uint8_t* data, size_t size, ExifInfo* out_info);
+
+}
+
+#endif
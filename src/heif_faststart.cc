@@ -0,0 +1,64 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+// Rewrite a HEIF file so that 'meta' comes before the image data.
+
+int main(int argc, char **argv)
+{
+    int decoding_order = 0;
+    int arg = 1;
+
+    if(arg < argc && strcmp(argv[arg], "-d") == 0) {
+        decoding_order = 1;
+        arg++;
+    }
+
+    if(argc - arg != 2) {
+        printf("Usage: heif_faststart [-d] input_file output_file\n"
+               "  -d  store the image data in decoding order\n");
+        return 1;
+    }
+
+    heif_handle h = heif_hendle_alloc();
+
+    heif_error err = heif_read_from_file(h, argv[arg]);
+    if(0 != err.code) {
+        fprintf(stderr, "Can not read HEIF file: %s\n", err.message);
+        heif_handle_free(h);
+        return 1;
+    }
+
+    err = heif_write_fast_start_file(h, argv[arg+1], decoding_order);
+    if(0 != err.code) {
+        fprintf(stderr, "Can not write HEIF file: %s\n", err.message);
+        heif_handle_free(h);
+        return 1;
+    }
+
+    heif_handle_free(h);
+
+    return 0;
+}
@@ -19,25 +19,173 @@
  */
 
 #include "heif_file.h"
+#include "heif_limits.h"
+#include "heif_push_parser.h"
 
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <streambuf>
 #include <utility>
 #include <assert.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 using namespace heif;
 
 
+namespace {
+  // Seekable, read-only stream buffer on memory that is owned elsewhere.
+  // (std::stringbuf would need its own copy of the data.)
+  class MemoryStreamBuffer : public std::streambuf
+  {
+  public:
+    MemoryStreamBuffer(const uint8_t* data, uint64_t size) {
+      char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+      setg(begin, begin, begin + size);
+    }
+
+  protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override {
+      if (!(which & std::ios_base::in)) {
+        return pos_type(off_type(-1));
+      }
+
+      off_type base;
+      switch (dir) {
+      case std::ios_base::beg: base = 0; break;
+      case std::ios_base::cur: base = gptr() - eback(); break;
+      default: base = egptr() - eback(); break;
+      }
+
+      off_type pos = base + off;
+      if (pos < 0 || pos > egptr() - eback()) {
+        return pos_type(off_type(-1));
+      }
+
+      setg(eback(), eback() + pos, egptr());
+      return pos_type(pos);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+      return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+  };
+
+
+  // Read-only stream buffer on received data of a PushInput. Reading data that has not been
+  // received yet fails, seeking is always possible.
+  class PushInputStreamBuffer : public std::streambuf
+  {
+  public:
+    PushInputStreamBuffer(const PushInput* input) : m_input(input) { }
+
+  protected:
+    int_type underflow() override {
+      m_position += gptr() - eback();
+
+      size_t n = m_input->copy_available(m_position, sizeof(m_buffer), m_buffer);
+      char* begin = reinterpret_cast<char*>(m_buffer);
+      setg(begin, begin, begin + n);
+
+      return n == 0 ? traits_type::eof() : traits_type::to_int_type(*gptr());
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override {
+      if (!(which & std::ios_base::in) || dir == std::ios_base::end) {
+        return pos_type(off_type(-1));
+      }
+
+      off_type current = (off_type)m_position + (gptr() - eback());
+      off_type pos = (dir == std::ios_base::beg) ? off : current + off;
+      if (pos < 0) {
+        return pos_type(off_type(-1));
+      }
+
+      m_position = (uint64_t)pos;
+      setg(nullptr, nullptr, nullptr);
+      return pos_type(pos);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+      return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+  private:
+    const PushInput* m_input;
+    uint64_t m_position = 0;  // file position of eback()
+    uint8_t m_buffer[4096];
+  };
+
+}
+
+
 HeifFile::HeifFile()
+  : m_limits(get_default_resource_limits())
 {
 }
 
 
 HeifFile::~HeifFile()
 {
+  m_input_stream.reset();
+  m_input_buffer.reset();
+
+  if (m_mapped_file) {
+    munmap(m_mapped_file, m_mapped_size);
+  }
+}
+
+
+void HeifFile::set_input_memory(const uint8_t* data, uint64_t size)
+{
+  m_input_data = data;
+  m_input_size = size;
+
+  m_input_buffer = std::unique_ptr<std::streambuf>(new MemoryStreamBuffer(data, size));
+  m_input_stream = std::unique_ptr<std::istream>(new std::istream(m_input_buffer.get()));
+}
+
+
+Error HeifFile::open_input_file(const char* input_filename)
+{
+  int fd = open(input_filename, O_RDONLY);
+  if (fd < 0) {
+    return Error(heif_error_Input_does_not_exist,
+                 heif_suberror_Unspecified);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void* mem = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mem != MAP_FAILED) {
+      close(fd);
+
+      m_mapped_file = mem;
+      m_mapped_size = (size_t)st.st_size;
+      set_input_memory(static_cast<const uint8_t*>(mem), m_mapped_size);
+
+      return Error::Ok;
+    }
+  }
+
+  close(fd);
+
+  // not mappable (e.g. a pipe), read through a stream instead
+
+  m_input_stream = std::unique_ptr<std::istream>(new std::ifstream(input_filename));
+  if (!*m_input_stream) {
+    return Error(heif_error_Input_does_not_exist,
+                 heif_suberror_Unspecified);
+  }
+
+  return Error::Ok;
 }
 
 
@@ -45,8 +193,8 @@ std::vector<heif_image_id> HeifFile::get_item_IDs() const
 {
   std::vector<heif_image_id> IDs;
 
-  for (const auto& image : m_images) {
-    IDs.push_back(image.second.m_infe_box->get_item_ID());
+  for (const auto& item : m_items) {
+    IDs.push_back(item.first);
   }
 
   return IDs;
@@ -55,33 +203,77 @@ std::vector<heif_image_id> HeifFile::get_item_IDs() const
 
 Error HeifFile::read_from_file(const char* input_filename)
 {
-  m_input_stream = std::unique_ptr<std::istream>(new std::ifstream(input_filename));
+  Error error = open_input_file(input_filename);
+  if (error) {
+    return error;
+  }
 
   uint64_t maxSize = std::numeric_limits<uint64_t>::max();
   heif::BitstreamRange range(m_input_stream.get(), maxSize);
+  range.set_limits(&m_limits);
 
 
-  Error error = parse_heif_file(range);
+  error = parse_heif_file(range);
   return error;
 }
 
 
+Error HeifFile::read_from_file(const char* input_filename,
+                               heif_image_id primary_image_ID,
+                               std::map<heif_image_id, Item>&& items)
+{
+  Error error = open_input_file(input_filename);
+  if (error) {
+    return error;
+  }
+
+  if (m_limits.max_items && items.size() > m_limits.max_items) {
+    return limit_exceeded_error("Number of items", items.size(), m_limits.max_items);
+  }
+
+  m_primary_image_ID = primary_image_ID;
+  m_items = std::move(items);
+
+  return Error::Ok;
+}
+
+
 
 Error HeifFile::read_from_memory(const void* data, size_t size)
 {
-  // TODO: Work on passed memory directly instead of creating a copy here.
-  // Note: we cannot use basic_streambuf for this, because it does not support seeking
-  std::string s(static_cast<const char*>(data), size);
+  // The caller's memory may be released after this call, so keep one copy.
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  m_memory_input.assign(bytes, bytes + size);
 
-  m_input_stream = std::unique_ptr<std::istream>(new std::istringstream(std::move(s)));
+  set_input_memory(m_memory_input.data(), size);
 
   heif::BitstreamRange range(m_input_stream.get(), size);
+  range.set_limits(&m_limits);
 
   Error error = parse_heif_file(range);
   return error;
 }
 
 
+Error HeifFile::read_from_push_input(const std::shared_ptr<PushInput>& input, uint64_t header_size)
+{
+  // The boxes are parsed from the received data. Boxes before 'meta' are skipped,
+  // their content does not have to be there.
+  PushInputStreamBuffer buffer(input.get());
+  std::istream stream(&buffer);
+  heif::BitstreamRange range(&stream, header_size);
+  range.set_limits(&m_limits);
+
+  Error error = parse_heif_file(range);
+  if (error) {
+    return error;
+  }
+
+  m_push_input = input;
+  return Error::Ok;
+}
+
+
 std::string HeifFile::debug_dump_boxes() const
 {
   std::stringstream sstr;
@@ -113,7 +305,11 @@ Error HeifFile::parse_heif_file(BitstreamRange& range)
   for (;;) {
     std::shared_ptr<Box> box;
     Error error = Box::read(range, &box);
-    if (error != Error::Ok || range.error() || range.eof()) {
+    if (error.sub_error_code == heif_suberror_Security_limit_exceeded) {
+      return error;
+    }
+
+    if (error != Error::Ok || range.error()) {
       break;
     }
 
@@ -129,6 +325,11 @@ Error HeifFile::parse_heif_file(BitstreamRange& range)
     if (box->get_short_type() == fourcc("ftyp")) {
       m_ftyp_box = std::dynamic_pointer_cast<Box_ftyp>(box);
     }
+
+    // Test after storing the box: the last box of memory input ends exactly at the end.
+    if (range.eof()) {
+      break;
+    }
   }
 
 
@@ -140,10 +341,12 @@ Error HeifFile::parse_heif_file(BitstreamRange& range)
                  heif_suberror_No_ftyp_box);
   }
 
-  // heic/hevc for H.265/HEVC codec, avci for H.264 codec
-  if (!m_ftyp_box->has_compatible_brand(fourcc("heic"))) {
+  // heic/hevc for H.265/HEVC codec, avci for H.264 codec,
+  // mif1 for image files with other codecs (e.g. JPEG) or mixed codecs
+  if (!m_ftyp_box->has_compatible_brand(fourcc("heic")) &&
+      !m_ftyp_box->has_compatible_brand(fourcc("mif1"))) {
     std::stringstream sstr;
-    sstr << "File does not support the 'heic' brand.\n";
+    sstr << "File does not support the 'heic' or 'mif1' brand.\n";
 
     return Error(heif_error_Unsupported_filetype,
                  heif_suberror_Unspecified,
@@ -218,6 +421,14 @@ Error HeifFile::parse_heif_file(BitstreamRange& range)
 
   std::vector<std::shared_ptr<Box>> infe_boxes = iinf_box->get_child_boxes(fourcc("infe"));
 
+  return build_item_table(infe_boxes);
+}
+
+
+Error HeifFile::build_item_table(const std::vector<std::shared_ptr<Box>>& infe_boxes)
+{
+  m_items.clear();
+
   for (auto& box : infe_boxes) {
     std::shared_ptr<Box_infe> infe_box = std::dynamic_pointer_cast<Box_infe>(box);
     if (!infe_box) {
@@ -225,10 +436,137 @@ Error HeifFile::parse_heif_file(BitstreamRange& range)
                    heif_suberror_No_infe_box);
     }
 
-    Image img;
-    img.m_infe_box = infe_box;
+    Item item;
+    item.id = infe_box->get_item_ID();
+    item.item_type = infe_box->get_item_type();
+    item.hidden = infe_box->is_hidden_item();
+
+
+    // --- references
+
+    if (m_iref_box && m_iref_box->has_references(item.id)) {
+      item.reference_type = m_iref_box->get_reference_type(item.id);
+      item.references = m_iref_box->get_references(item.id);
+    }
+
+
+    // --- properties (items like Exif data have none)
+
+    std::vector<Box_ipco::Property> properties;
+    Error err = get_properties(item.id, properties);
+    if (err && err.sub_error_code != heif_suberror_No_properties_assigned_to_item) {
+      return err;
+    }
+
+    std::shared_ptr<Box_clap> clap;
+
+    for (const auto& prop : properties) {
+      auto ispe = std::dynamic_pointer_cast<Box_ispe>(prop.property);
+      if (ispe) {
+        item.has_ispe = true;
+        item.ispe_width = ispe->get_width();
+        item.ispe_height = ispe->get_height();
+      }
+
+      auto clap_prop = std::dynamic_pointer_cast<Box_clap>(prop.property);
+      if (clap_prop) {
+        clap = clap_prop;
+      }
+
+      auto irot = std::dynamic_pointer_cast<Box_irot>(prop.property);
+      if (irot) {
+        item.rotation = irot->get_rotation();
+      }
+
+      auto imir = std::dynamic_pointer_cast<Box_imir>(prop.property);
+      if (imir) {
+        item.mirror_axis = (int)imir->get_mirror_axis();
+      }
+
+      auto auxC = std::dynamic_pointer_cast<Box_auxC>(prop.property);
+      if (auxC) {
+        item.has_auxC = true;
+        item.aux_type = auxC->get_aux_type();
+        item.aux_subtypes = auxC->get_subtypes();
+      }
+
+      auto hvcC = std::dynamic_pointer_cast<Box_hvcC>(prop.property);
+      if (hvcC && item.nal_length_size == 0) {
+        if (!hvcC->get_headers(&item.codec_headers)) {
+          return Error(heif_error_Invalid_input,
+                       heif_suberror_No_item_data,
+                       "hvcC header NAL does not fit into the NAL length prefix");
+        }
 
-    m_images.insert( std::make_pair(infe_box->get_item_ID(), img) );
+        item.nal_length_size = hvcC->get_length_size();
+      }
+
+      auto colr = std::dynamic_pointer_cast<Box_colr>(prop.property);
+      if (colr && colr->get_colour_type() == fourcc("nclx") && !item.has_nclx) {
+        item.has_nclx = true;
+        item.colour_primaries = colr->get_colour_primaries();
+        item.transfer_characteristics = colr->get_transfer_characteristics();
+        item.matrix_coefficients = colr->get_matrix_coefficients();
+        item.full_range = colr->get_full_range_flag();
+      }
+      else if (colr && colr->is_icc_profile() && item.icc_profile.empty()) {
+        item.icc_profile = colr->get_icc_profile();
+      }
+    }
+
+
+    // the crop window is relative to the image size
+
+    if (clap && item.has_ispe) {
+      int width = (int)item.ispe_width;
+      int height = (int)item.ispe_height;
+
+      item.has_clap = true;
+      item.clap_left = clap->left_rounded(width);
+      item.clap_top = clap->top_rounded(height);
+      item.clap_width = clap->right_rounded(width) - item.clap_left + 1;
+      item.clap_height = clap->bottom_rounded(height) - item.clap_top + 1;
+    }
+
+
+    // --- data extents, resolved to absolute file positions
+
+    for (const auto& iloc_item : m_iloc_box->get_items()) {
+      if (iloc_item.item_ID != item.id) {
+        continue;
+      }
+
+      item.has_data = true;
+
+      uint64_t base;
+      if (iloc_item.construction_method == 0) {
+        base = iloc_item.base_offset;
+      }
+      else if (iloc_item.construction_method == 1) {
+        if (!m_idat_box) {
+          return Error(heif_error_Invalid_input,
+                       heif_suberror_No_idat_box,
+                       "idat box referenced in iref box is not present in file");
+        }
+
+        base = m_idat_box->get_data_start_pos() + iloc_item.base_offset;
+      }
+      else {
+        // item offset construction is not supported, the item has no data
+        break;
+      }
+
+      for (const auto& extent : iloc_item.extents) {
+        Item::Extent e;
+        e.offset = base + extent.offset;
+        e.length = extent.length;
+        item.extents.push_back(e);
+      }
+
+      break;
+    }
+
+    m_items.insert( std::make_pair(item.id, std::move(item)) );
   }
 
   return Error::Ok;
@@ -237,33 +575,29 @@ Error HeifFile::parse_heif_file(BitstreamRange& range)
 
 bool HeifFile::image_exists(heif_image_id ID) const
 {
-  auto image_iter = m_images.find(ID);
-  return image_iter != m_images.end();
+  return m_items.find(ID) != m_items.end();
 }
 
 
-bool HeifFile::get_image_info(heif_image_id ID, const HeifFile::Image** image) const
+const HeifFile::Item* HeifFile::get_item(heif_image_id ID) const
 {
-  // --- get the image from the list of all images
-
-  auto image_iter = m_images.find(ID);
-  if (image_iter == m_images.end()) {
-    return false;
+  auto iter = m_items.find(ID);
+  if (iter == m_items.end()) {
+    return nullptr;
   }
 
-  *image = &image_iter->second;
-  return true;
+  return &iter->second;
 }
 
 
 std::string HeifFile::get_item_type(heif_image_id ID) const
 {
-  const Image* img;
-  if (!get_image_info(ID, &img)) {
+  const Item* item = get_item(ID);
+  if (!item) {
     return "";
   }
 
-  return img->m_infe_box->get_item_type();
+  return item->item_type;
 }
 
 
@@ -283,37 +617,36 @@ Error HeifFile::get_properties(heif_image_id imageID,
 
 
 
-Error HeifFile::get_compressed_image_data(heif_image_id ID, std::vector<uint8_t>* data) const
+std::shared_ptr<Box_hvcC> HeifFile::get_hvcC_box(heif_image_id imageID) const
 {
-#if ENABLE_PARALLEL_TILE_DECODING
-  std::lock_guard<std::mutex> guard(m_read_mutex);
-#endif
-
-  if (!image_exists(ID)) {
-    return Error(heif_error_Usage_error,
-                 heif_suberror_Nonexisting_image_referenced);
+  std::vector<Box_ipco::Property> properties;
+  Error err = get_properties(imageID, properties);
+  if (err) {
+    return nullptr;
   }
 
-  const Image* image;
-  if (!get_image_info(ID, &image)) {
-    return Error(heif_error_Usage_error,
-                 heif_suberror_Nonexisting_image_referenced);
+  for (auto& prop : properties) {
+    if (prop.property->get_short_type() == fourcc("hvcC")) {
+      auto hvcC_box = std::dynamic_pointer_cast<Box_hvcC>(prop.property);
+      if (hvcC_box) {
+        return hvcC_box;
+      }
+    }
   }
 
+  return nullptr;
+}
 
-  std::string item_type = image->m_infe_box->get_item_type();
-
-  // --- get coded image data pointers
 
-  auto items = m_iloc_box->get_items();
-  const Box_iloc::Item* item = nullptr;
-  for (const auto& i : items) {
-    if (i.item_ID == ID) {
-      item = &i;
-      break;
-    }
-  }
+Error HeifFile::get_coded_item(heif_image_id ID, const Item** out_item) const
+{
+  const Item* item = get_item(ID);
   if (!item) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Nonexisting_image_referenced);
+  }
+
+  if (!item->has_data) {
     std::stringstream sstr;
     sstr << "Item with ID " << ID << " has no compressed data";
 
@@ -322,61 +655,288 @@ Error HeifFile::get_compressed_image_data(heif_image_id ID, std::vector<uint8_t>
                  sstr.str());
   }
 
-  Error error = Error(heif_error_Unsupported_feature,
-                      heif_suberror_Unsupported_codec);
-  if (item_type == "hvc1") {
-    // --- --- --- HEVC
+  if (item->item_type == "hvc1") {
+    // --- --- --- HEVC, the codec configuration is prepended
+
+    if (item->nal_length_size == 0) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_No_hvcC_box);
+    }
+  }
+  else if (item->item_type != "jpeg" &&
+           item->item_type != "grid" &&
+           item->item_type != "iovl" &&
+           item->item_type != "Exif") {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_codec);
+  }
+
+  *out_item = item;
+  return Error::Ok;
+}
+
 
-    // --- get properties for this image
+Error HeifFile::get_compressed_image_data(heif_image_id ID, std::vector<uint8_t>* data) const
+{
+  const Item* item = nullptr;
+  Error err = get_coded_item(ID, &item);
+  if (err) {
+    return err;
+  }
 
-    std::vector<Box_ipco::Property> properties;
-    Error err = m_ipco_box->get_properties_for_item_ID(ID, m_ipma_box, properties);
+  uint64_t size;
+  err = get_compressed_image_data_size(ID, &size);
+  if (err) {
+    return err;
+  }
+
+  data->reserve(data->size() + static_cast<size_t>(size));
+  data->insert(data->end(), item->codec_headers.begin(), item->codec_headers.end());
+
+  return read_item_data(*item, data);
+}
+
+
+Error HeifFile::get_compressed_image_data_size(heif_image_id ID, uint64_t* out_size) const
+{
+  const Item* item = nullptr;
+  Error err = get_coded_item(ID, &item);
+  if (err) {
+    return err;
+  }
+
+  uint64_t size = 0;
+  for (const auto& extent : item->extents) {
+    size += extent.length;
+  }
+
+  if (m_limits.max_item_data_size && size > m_limits.max_item_data_size) {
+    return limit_exceeded_error("Size of item data", size, m_limits.max_item_data_size);
+  }
+
+  *out_size = item->codec_headers.size() + size;
+  return Error::Ok;
+}
+
+
+Error HeifFile::read_compressed_image_data(heif_image_id ID, uint8_t* dest) const
+{
+  uint64_t size;
+  Error err = get_compressed_image_data_size(ID, &size);
+  if (err) {
+    return err;
+  }
+
+  const Item* item = get_item(ID);
+
+  if (!item->codec_headers.empty()) {
+    memcpy(dest, item->codec_headers.data(), item->codec_headers.size());
+    dest += item->codec_headers.size();
+  }
+
+  std::unique_lock<std::mutex> guard(m_read_mutex, std::defer_lock);
+  if (!m_input_data && !m_push_input) {
+    guard.lock();
+    m_input_stream->clear();
+  }
+
+  for (const auto& extent : item->extents) {
+    err = read_input(extent.offset, extent.length, dest);
     if (err) {
       return err;
     }
 
-    // --- get codec configuration
+    dest += extent.length;
+  }
 
-    std::shared_ptr<Box_hvcC> hvcC_box;
-    for (auto& prop : properties) {
-      if (prop.property->get_short_type() == fourcc("hvcC")) {
-        hvcC_box = std::dynamic_pointer_cast<Box_hvcC>(prop.property);
-        if (hvcC_box) {
-          break;
-        }
-      }
+  return Error::Ok;
+}
+
+
+bool HeifFile::get_item_data_span(heif_image_id ID, const uint8_t** out_data, size_t* out_size) const
+{
+  const Item* item = get_item(ID);
+  if (!item || (!m_input_data && !m_push_input) || item->extents.size() != 1) {
+    return false;
+  }
+
+  const Item::Extent& extent = item->extents[0];
+
+  if (m_push_input) {
+    if (!m_push_input->get_span(extent.offset, extent.length, out_data)) {
+      return false;
     }
 
-    if (!hvcC_box) {
-      return Error(heif_error_Invalid_input,
-                   heif_suberror_No_hvcC_box);
-    } else if (!hvcC_box->get_headers(data)) {
-      return Error(heif_error_Invalid_input,
-                   heif_suberror_No_item_data);
+    *out_size = static_cast<size_t>(extent.length);
+    return true;
+  }
+
+  if (extent.offset > m_input_size || extent.length > m_input_size - extent.offset) {
+    return false;
+  }
+
+  *out_data = m_input_data + extent.offset;
+  *out_size = static_cast<size_t>(extent.length);
+  return true;
+}
+
+
+bool HeifFile::is_item_data_available(heif_image_id ID) const
+{
+  const Item* item = get_item(ID);
+  if (!m_push_input || !item) {
+    return true;
+  }
+
+  for (const auto& extent : item->extents) {
+    if (!m_push_input->is_available(extent.offset, extent.length)) {
+      return false;
     }
+  }
 
-#if 0
-  uint8_t *p = data->data();
-  std::cout << "data size: " << data->size() << std::endl;
-  for(int m = 0; m < (int)data->size(); m++) {
-    printf("%02X ", *(p+m));
+  return true;
+}
+
+
+void HeifFile::get_ranges_to_fetch(uint64_t offset, uint64_t length,
+                                   std::vector<heif_byte_range>* ranges) const
+{
+  if (m_push_input) {
+    m_push_input->get_missing_ranges(offset, length, ranges);
   }
-#endif
+  else if (length > 0) {
+    ranges->push_back(heif_byte_range{offset, length});
+  }
+}
+
 
-    error = m_iloc_box->read_data(*item, *m_input_stream.get(), m_idat_box, data);
-  } else if (item_type == "grid" ||
-             item_type == "iovl" ||
-             item_type == "Exif") {
-    error = m_iloc_box->read_data(*item, *m_input_stream.get(), m_idat_box, data);
+Error HeifFile::read_item_data(const Item& item, std::vector<uint8_t>* data) const
+{
+  // Reads from the stream are serialized. Input held in memory is copied directly.
+  std::unique_lock<std::mutex> guard(m_read_mutex, std::defer_lock);
+  if (!m_input_data && !m_push_input) {
+    guard.lock();
+    m_input_stream->clear();
   }
 
-  if (error != Error::Ok) {
-    return error;
+  uint64_t max_size = m_limits.max_item_data_size;
+
+  uint64_t total = data->size();
+  for (const auto& extent : item.extents) {
+    total += extent.length;
+  }
+
+  if (max_size && total - data->size() > max_size) {
+    return limit_exceeded_error("Size of item data", total - data->size(), max_size);
+  }
+
+  data->reserve(static_cast<size_t>(total));
+
+  for (const auto& extent : item.extents) {
+    Error err = append_input_range(extent.offset, extent.length, data);
+    if (err) {
+      return err;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Error HeifFile::append_input_range(uint64_t offset, uint64_t length,
+                                   std::vector<uint8_t>* data) const
+{
+  size_t old_size = data->size();
+  data->resize(static_cast<size_t>(old_size + length));
+
+  Error err = read_input(offset, length, data->data() + old_size);
+  if (err) {
+    data->resize(old_size);
+  }
+
+  return err;
+}
+
+
+Error HeifFile::read_input(uint64_t offset, uint64_t length, uint8_t* dest) const
+{
+  bool in_bounds;
+
+  if (m_push_input) {
+    // waits until the data has arrived
+    in_bounds = m_push_input->wait_for_range(offset, length);
+    if (in_bounds) {
+      m_push_input->copy_range(offset, length, dest);
+    }
+  }
+  else if (m_input_data) {
+    in_bounds = (offset <= m_input_size &&
+                 length <= m_input_size - offset);
+    if (in_bounds) {
+      memcpy(dest, m_input_data + offset, static_cast<size_t>(length));
+    }
+  }
+  else {
+    std::istream& istr = *m_input_stream;
+    istr.seekg(offset, std::ios::beg);
+    istr.read((char*)dest, static_cast<size_t>(length));
+
+    in_bounds = (istr && istr.gcount() == static_cast<std::streamsize>(length));
+    if (!in_bounds) {
+      istr.clear();
+    }
+  }
+
+  if (!in_bounds) {
+    std::stringstream sstr;
+    sstr << "Extent in iloc box references data outside of file bounds "
+         << "(points to file position " << offset << ")\n";
+
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_End_of_data,
+                 sstr.str());
   }
 
   return Error::Ok;
 }
 
+
+Error HeifFile::read_input_range(uint64_t offset, uint64_t length,
+                                 std::vector<uint8_t>* data) const
+{
+  if (m_limits.max_item_data_size && length > m_limits.max_item_data_size) {
+    return limit_exceeded_error("Size of input range", length, m_limits.max_item_data_size);
+  }
+
+  std::unique_lock<std::mutex> guard(m_read_mutex, std::defer_lock);
+  if (!m_input_data && !m_push_input) {
+    guard.lock();
+    m_input_stream->clear();
+  }
+
+  data->clear();
+  return append_input_range(offset, length, data);
+}
+
+
+uint64_t HeifFile::get_input_size() const
+{
+  if (m_input_data) {
+    return m_input_size;
+  }
+
+  if (m_push_input) {
+    return m_push_input->get_received_end();
+  }
+
+  std::lock_guard<std::mutex> guard(m_read_mutex);
+  m_input_stream->clear();
+  m_input_stream->seekg(0, std::ios::end);
+
+  std::streamoff size = m_input_stream->tellg();
+  return size < 0 ? 0 : static_cast<uint64_t>(size);
+}
+
 #if 0
 Error HeifFile::get_image_data(uint32_t ID, heif_image* out_data)
 {
@@ -26,6 +26,7 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <map>
 #include <vector>
@@ -33,16 +34,97 @@
 
 namespace heif {
 
+  class PushInput;
+
 
   class HeifFile {
   public:
     HeifFile();
     ~HeifFile();
 
+    // Limits checked while parsing and reading item data. Set them before reading the file.
+    void set_limits(const heif_resource_limits& limits) { m_limits = limits; }
+
+    const heif_resource_limits& get_limits() const { return m_limits; }
+
     Error read_from_file(const char* input_filename);
     Error read_from_memory(const void* data, size_t size);
 
-    int get_num_images() const { return static_cast<int>(m_images.size()); }
+    // Read from data that is still arriving (see HeifPushParser). The first 'header_size'
+    // bytes, up to the end of the 'meta' box, must have been received. Item data that has not
+    // arrived yet is waited for when it is read.
+    Error read_from_push_input(const std::shared_ptr<PushInput>& input, uint64_t header_size);
+
+
+    // Flat description of an item. It is built from the boxes when parsing the file,
+    // or loaded from an index file (see heif_index.h). All information needed to
+    // interpret the file and to read the item data is contained here.
+    struct Item {
+      heif_image_id id = 0;
+      std::string item_type;
+      bool hidden = false;
+
+      // first 'iref' reference from this item
+      uint32_t reference_type = 0;
+      std::vector<heif_image_id> references;
+
+      // --- properties
+
+      bool has_ispe = false;
+      uint32_t ispe_width = 0;
+      uint32_t ispe_height = 0;
+
+      // 'clap' crop window, computed from the 'ispe' size
+      bool has_clap = false;
+      int clap_left = 0;
+      int clap_top = 0;
+      int clap_width = 0;
+      int clap_height = 0;
+
+      int rotation = 0;  // 'irot', counter-clockwise in degrees
+
+      int mirror_axis = -1;  // 'imir', -1 if there is none, else Box_imir::MirrorAxis
+
+      bool has_auxC = false;
+      std::string aux_type;
+      std::vector<uint8_t> aux_subtypes;
+
+      // 'hvcC': NAL length size (0 if there is no hvcC) and the VPS/SPS/PPS
+      // headers, already prefixed with their NAL lengths
+      int nal_length_size = 0;
+      std::vector<uint8_t> codec_headers;
+
+      // 'colr': nclx colour information (ISO/IEC 23091-2 codes) and an ICC profile,
+      // each of them optional
+      bool has_nclx = false;
+      uint16_t colour_primaries = 2;
+      uint16_t transfer_characteristics = 2;
+      uint16_t matrix_coefficients = 2;
+      bool full_range = false;
+
+      std::vector<uint8_t> icc_profile;
+
+      // --- compressed data, as absolute positions in the file
+
+      struct Extent {
+        uint64_t offset;
+        uint64_t length;
+      };
+
+      bool has_data = false;
+      std::vector<Extent> extents;
+    };
+
+    // Open the file, but use the given item table instead of parsing the boxes.
+    Error read_from_file(const char* input_filename,
+                         heif_image_id primary_image_ID,
+                         std::map<heif_image_id, Item>&& items);
+
+    const std::map<heif_image_id, Item>& get_items() const { return m_items; }
+
+    const Item* get_item(heif_image_id ID) const;
+
+    int get_num_images() const { return static_cast<int>(m_items.size()); }
 
     heif_image_id get_primary_image_ID() const { return m_primary_image_ID; }
 
@@ -54,20 +136,47 @@ namespace heif {
 
     Error get_compressed_image_data(heif_image_id ID, std::vector<uint8_t>* out_data) const;
 
+    // Size of the data returned by get_compressed_image_data(), with the codec headers.
+    Error get_compressed_image_data_size(heif_image_id ID, uint64_t* out_size) const;
+
+    // Like get_compressed_image_data(), but into 'dest', which has room for the size
+    // returned by get_compressed_image_data_size().
+    Error read_compressed_image_data(heif_image_id ID, uint8_t* dest) const;
+
+    // Reference the data of an item stored in a single extent, without copying. Only possible
+    // when the input is held in memory (mapped file or memory input). The data stays valid
+    // as long as this HeifFile exists. Returns false if the data has to be read instead.
+    bool get_item_data_span(heif_image_id ID, const uint8_t** out_data, size_t* out_size) const;
+
+    // Whether the data of the item has been received. Always true unless the input is
+    // still arriving.
+    bool is_item_data_available(heif_image_id ID) const;
+
+    // Append the parts of the input range that have to be fetched to 'ranges': the parts not
+    // received yet if the input is still arriving, otherwise the whole range.
+    void get_ranges_to_fetch(uint64_t offset, uint64_t length,
+                             std::vector<heif_byte_range>* ranges) const;
+
+    // --- raw access to the input
+
+    uint64_t get_input_size() const;
+
+    // Read 'length' bytes from file position 'offset' into 'data' (replacing its content).
+    Error read_input_range(uint64_t offset, uint64_t length, std::vector<uint8_t>* data) const;
+
 
     // Add by justin
     // Error get_full_grid_image(uint32_t ID, const std::vector<uint8_t>& grid_data, heif_image* out_data);
     // Error get_image_data(uint32_t ID, heif_image* out_data);
 
 
-    std::shared_ptr<Box_infe> get_infe_box(heif_image_id imageID) {
-      auto iter = m_images.find(imageID);
-      if (iter == m_images.end()) {
-        return nullptr;
-      }
+    // --- boxes, only available when the file was parsed (not read with an item table)
+
+    const std::vector<std::shared_ptr<Box> >& get_top_level_boxes() const { return m_top_level_boxes; }
 
-      return iter->second.m_infe_box;
-    }
+    std::shared_ptr<Box_meta> get_meta_box() const { return m_meta_box; }
+
+    std::shared_ptr<Box_iloc> get_iloc_box() const { return m_iloc_box; }
 
     std::shared_ptr<Box_iref> get_iref_box() { return m_iref_box; }
 
@@ -78,11 +187,30 @@ namespace heif {
     Error get_properties(heif_image_id imageID,
                          std::vector<Box_ipco::Property>& properties) const;
 
+    std::shared_ptr<Box_hvcC> get_hvcC_box(heif_image_id imageID) const;
+
     std::string debug_dump_boxes() const;
 
   private:
+    // Input held in memory: a read-only mapping of the input file, or a copy of memory input.
+    // Item data is then copied from memory instead of seeking in the stream.
+    const uint8_t* m_input_data = nullptr;
+    uint64_t m_input_size = 0;
+
+    void* m_mapped_file = nullptr;
+    size_t m_mapped_size = 0;
+    std::vector<uint8_t> m_memory_input;
+
+    // Input that is still arriving, read instead of m_input_data or m_input_stream.
+    std::shared_ptr<PushInput> m_push_input;
+
+    std::unique_ptr<std::streambuf> m_input_buffer;
     std::unique_ptr<std::istream> m_input_stream;
 
+    // The file may be shared between contexts in different threads (see ParsedFileCache),
+    // reads from m_input_stream are serialized.
+    mutable std::mutex m_read_mutex;
+
     std::vector<std::shared_ptr<Box> > m_top_level_boxes;
 
     std::shared_ptr<Box_ftyp> m_ftyp_box;
@@ -94,21 +222,31 @@ namespace heif {
     std::shared_ptr<Box_idat> m_idat_box;
     std::shared_ptr<Box_iref> m_iref_box;
 
-    struct Image {
-      std::shared_ptr<Box_infe> m_infe_box;
-    };
-
-    std::map<heif_image_id, Image> m_images;  // map from image ID to info structure
+    std::map<heif_image_id, Item> m_items;  // map from item ID to info structure
 
-    // list of image items (does not include hidden images or Exif data)
-    std::vector<heif_image_id> m_valid_image_IDs;
+    heif_resource_limits m_limits;
 
     heif_image_id m_primary_image_ID;
 
 
+    // Map the file, or fall back to reading it through an ifstream.
+    Error open_input_file(const char* input_filename);
+
+    void set_input_memory(const uint8_t* data, uint64_t size);
+
     Error parse_heif_file(BitstreamRange& bitstream);
 
-    bool get_image_info(heif_image_id ID, const Image** image) const;
+    Error build_item_table(const std::vector<std::shared_ptr<Box>>& infe_boxes);
+
+    Error read_item_data(const Item& item, std::vector<uint8_t>* data) const;
+
+    // Item that get_compressed_image_data() can return data for.
+    Error get_coded_item(heif_image_id ID, const Item** out_item) const;
+
+    // Append the given range of the input to 'data', or copy it to 'dest'. The caller holds
+    // m_read_mutex when reading from the stream.
+    Error append_input_range(uint64_t offset, uint64_t length, std::vector<uint8_t>* data) const;
+    Error read_input(uint64_t offset, uint64_t length, uint8_t* dest) const;
   };
 
 }
@@ -0,0 +1,508 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_hevc.h"
+#include "bitstream.h"
+
+#include <vector>
+
+
+using namespace heif;
+
+
+namespace {
+
+  const int kNalSPS = 33;
+  const int kNalPPS = 34;
+
+  const int kMaxSubLayers = 7;
+  const int kMaxShortTermRefPicSets = 64;
+  const int kMaxDeltaPocs = 16;
+  const int kMaxLongTermRefPics = 32;
+  const int kMaxTileColumns = 20;
+  const int kMaxTileRows = 22;
+
+
+  Error invalid_parameter_set(const char* message)
+  {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_Invalid_parameter_set,
+                 message);
+  }
+
+
+  // Copy the payload of a NAL unit without its header and the emulation prevention bytes.
+  void get_rbsp(const uint8_t* nal, size_t size, std::vector<uint8_t>* rbsp)
+  {
+    rbsp->clear();
+    rbsp->reserve(size);
+
+    int zeros = 0;
+    for (size_t i = 2; i < size; i++) {
+      if (zeros == 2 && nal[i] == 3) {
+        zeros = 0;
+        continue;
+      }
+
+      zeros = (nal[i] == 0) ? zeros + 1 : 0;
+      rbsp->push_back(nal[i]);
+    }
+  }
+
+
+  bool read_uvlc(BitReader& reader, int max_value, int* value)
+  {
+    return reader.get_uvlc(value) && *value <= max_value;
+  }
+
+
+  void skip_profile_tier_level(BitReader& reader, int max_sub_layers_minus1, HEVCStreamInfo* info)
+  {
+    reader.skip_bits(2);  // general_profile_space
+    info->general_tier_flag = reader.get_bits(1) != 0;
+    info->general_profile_idc = (uint8_t)reader.get_bits(5);
+    reader.skip_bits(32);  // general_profile_compatibility_flags
+    reader.skip_bits(4);   // progressive, interlaced, non_packed, frame_only
+    reader.skip_bits(32);  // constraint flags (43 bits) and inbld flag
+    reader.skip_bits(12);
+    info->general_level_idc = (uint8_t)reader.get_bits(8);
+
+    bool sub_layer_profile_present[kMaxSubLayers];
+    bool sub_layer_level_present[kMaxSubLayers];
+
+    for (int i = 0; i < max_sub_layers_minus1; i++) {
+      sub_layer_profile_present[i] = reader.get_bits(1) != 0;
+      sub_layer_level_present[i] = reader.get_bits(1) != 0;
+    }
+
+    if (max_sub_layers_minus1 > 0) {
+      reader.skip_bits(2 * (8 - max_sub_layers_minus1));
+    }
+
+    for (int i = 0; i < max_sub_layers_minus1; i++) {
+      if (sub_layer_profile_present[i]) {
+        reader.skip_bits(32);
+        reader.skip_bits(32);
+        reader.skip_bits(24);
+      }
+
+      if (sub_layer_level_present[i]) {
+        reader.skip_bits(8);
+      }
+    }
+  }
+
+
+  bool skip_scaling_list_data(BitReader& reader)
+  {
+    int value;
+
+    for (int size_id = 0; size_id < 4; size_id++) {
+      for (int matrix_id = 0; matrix_id < 6; matrix_id += (size_id == 3) ? 3 : 1) {
+        if (!reader.get_bits(1)) {
+          // scaling_list_pred_matrix_id_delta
+          if (!reader.get_uvlc(&value)) {
+            return false;
+          }
+        }
+        else {
+          int num_coefs = (size_id == 0) ? 16 : 64;
+
+          if (size_id > 1 && !reader.get_svlc(&value)) {
+            return false;
+          }
+
+          for (int i = 0; i < num_coefs; i++) {
+            if (!reader.get_svlc(&value)) {
+              return false;
+            }
+          }
+        }
+      }
+    }
+
+    return true;
+  }
+
+
+  // Skip st_ref_pic_set(idx). 'num_delta_pocs' holds the number of pictures of the sets read
+  // before, needed for sets predicted from the previous one.
+  bool skip_short_term_ref_pic_set(BitReader& reader, int idx, int* num_delta_pocs)
+  {
+    int value;
+
+    if (idx != 0 && reader.get_bits(1)) {
+      // inter_ref_pic_set_prediction_flag: predicted from the previous set
+      reader.skip_bits(1);  // delta_rps_sign
+      if (!reader.get_uvlc(&value)) {  // abs_delta_rps_minus1
+        return false;
+      }
+
+      int count = 0;
+      for (int j = 0; j <= num_delta_pocs[idx - 1]; j++) {
+        bool used_by_curr_pic = reader.get_bits(1) != 0;
+        bool use_delta = used_by_curr_pic || reader.get_bits(1) != 0;
+        if (use_delta) {
+          count++;
+        }
+      }
+
+      if (count > kMaxDeltaPocs) {
+        return false;
+      }
+
+      num_delta_pocs[idx] = count;
+      return true;
+    }
+
+    int num_negative, num_positive;
+    if (!read_uvlc(reader, kMaxDeltaPocs, &num_negative) ||
+        !read_uvlc(reader, kMaxDeltaPocs - num_negative, &num_positive)) {
+      return false;
+    }
+
+    for (int i = 0; i < num_negative + num_positive; i++) {
+      if (!reader.get_uvlc(&value)) {  // delta_poc_s0/s1_minus1
+        return false;
+      }
+      reader.skip_bits(1);  // used_by_curr_pic_s0/s1_flag
+    }
+
+    num_delta_pocs[idx] = num_negative + num_positive;
+    return true;
+  }
+
+
+  void read_vui(BitReader& reader, HEVCStreamInfo* info)
+  {
+    if (reader.get_bits(1)) {  // aspect_ratio_info_present_flag
+      int aspect_ratio_idc = reader.get_bits(8);
+      if (aspect_ratio_idc == 255) {
+        reader.skip_bits(32);  // sar_width, sar_height
+      }
+    }
+
+    if (reader.get_bits(1)) {  // overscan_info_present_flag
+      reader.skip_bits(1);
+    }
+
+    if (reader.get_bits(1)) {  // video_signal_type_present_flag
+      info->has_video_signal_type = true;
+
+      reader.skip_bits(3);  // video_format
+      info->full_range = reader.get_bits(1) != 0;
+
+      if (reader.get_bits(1)) {  // colour_description_present_flag
+        info->has_colour_description = true;
+        info->colour_primaries = (uint8_t)reader.get_bits(8);
+        info->transfer_characteristics = (uint8_t)reader.get_bits(8);
+        info->matrix_coefficients = (uint8_t)reader.get_bits(8);
+      }
+    }
+
+    // The remaining VUI fields (chroma sample location, timing, bitstream restrictions)
+    // are not needed.
+  }
+
+
+  Error parse_sps(BitReader& reader, HEVCStreamInfo* info)
+  {
+    int value;
+
+    reader.skip_bits(4);  // sps_video_parameter_set_id
+    int max_sub_layers_minus1 = reader.get_bits(3);
+    if (max_sub_layers_minus1 >= kMaxSubLayers) {
+      return invalid_parameter_set("Too many sub-layers in SPS");
+    }
+    reader.skip_bits(1);  // sps_temporal_id_nesting_flag
+
+    skip_profile_tier_level(reader, max_sub_layers_minus1, info);
+
+    if (!reader.get_uvlc(&value)) {  // sps_seq_parameter_set_id
+      return invalid_parameter_set("Invalid SPS ID");
+    }
+
+    if (!read_uvlc(reader, 3, &info->chroma_format_idc)) {
+      return invalid_parameter_set("Invalid chroma format in SPS");
+    }
+
+    if (info->chroma_format_idc == 3) {
+      info->separate_colour_planes = reader.get_bits(1) != 0;
+    }
+
+    int width, height;
+    if (!reader.get_uvlc(&width) || !reader.get_uvlc(&height) ||
+        width == 0 || height == 0) {
+      return invalid_parameter_set("Invalid picture size in SPS");
+    }
+
+    info->coded_width = (uint32_t)width;
+    info->coded_height = (uint32_t)height;
+
+    if (reader.get_bits(1)) {  // conformance_window_flag
+      int left, right, top, bottom;
+      if (!reader.get_uvlc(&left) || !reader.get_uvlc(&right) ||
+          !reader.get_uvlc(&top) || !reader.get_uvlc(&bottom)) {
+        return invalid_parameter_set("Invalid conformance window in SPS");
+      }
+
+      // offsets are given in chroma samples
+      bool subsampled = !info->separate_colour_planes && info->chroma_format_idc != 0;
+      uint32_t sub_width = (subsampled && info->chroma_format_idc != 3) ? 2 : 1;
+      uint32_t sub_height = (subsampled && info->chroma_format_idc == 1) ? 2 : 1;
+
+      info->conf_win_left = sub_width * (uint32_t)left;
+      info->conf_win_right = sub_width * (uint32_t)right;
+      info->conf_win_top = sub_height * (uint32_t)top;
+      info->conf_win_bottom = sub_height * (uint32_t)bottom;
+
+      if ((uint64_t)info->conf_win_left + info->conf_win_right >= info->coded_width ||
+          (uint64_t)info->conf_win_top + info->conf_win_bottom >= info->coded_height) {
+        return invalid_parameter_set("Conformance window in SPS is larger than the picture");
+      }
+    }
+
+    int bit_depth_luma_minus8, bit_depth_chroma_minus8;
+    if (!read_uvlc(reader, 8, &bit_depth_luma_minus8) ||
+        !read_uvlc(reader, 8, &bit_depth_chroma_minus8)) {
+      return invalid_parameter_set("Invalid bit depth in SPS");
+    }
+
+    info->bit_depth_luma = bit_depth_luma_minus8 + 8;
+    info->bit_depth_chroma = bit_depth_chroma_minus8 + 8;
+
+    int log2_max_poc_lsb_minus4;
+    if (!read_uvlc(reader, 12, &log2_max_poc_lsb_minus4)) {
+      return invalid_parameter_set("Invalid POC size in SPS");
+    }
+
+    bool sub_layer_ordering_info_present = reader.get_bits(1) != 0;
+    for (int i = sub_layer_ordering_info_present ? 0 : max_sub_layers_minus1;
+         i <= max_sub_layers_minus1; i++) {
+      for (int k = 0; k < 3; k++) {  // max_dec_pic_buffering, num_reorder_pics, max_latency
+        if (!reader.get_uvlc(&value)) {
+          return invalid_parameter_set("Invalid sub-layer ordering info in SPS");
+        }
+      }
+    }
+
+    int log2_min_cb_size_minus3, log2_diff_max_min_cb_size;
+    if (!read_uvlc(reader, 3, &log2_min_cb_size_minus3) ||
+        !read_uvlc(reader, 3, &log2_diff_max_min_cb_size) ||
+        log2_min_cb_size_minus3 + log2_diff_max_min_cb_size > 3) {
+      return invalid_parameter_set("Invalid coding block size in SPS");
+    }
+
+    info->log2_ctb_size = log2_min_cb_size_minus3 + 3 + log2_diff_max_min_cb_size;
+
+    for (int k = 0; k < 4; k++) {  // transform block sizes and hierarchy depths
+      if (!reader.get_uvlc(&value)) {
+        return invalid_parameter_set("Invalid transform block size in SPS");
+      }
+    }
+
+    if (reader.get_bits(1)) {  // scaling_list_enabled_flag
+      if (reader.get_bits(1) && !skip_scaling_list_data(reader)) {
+        return invalid_parameter_set("Invalid scaling list in SPS");
+      }
+    }
+
+    reader.skip_bits(2);  // amp_enabled_flag, sample_adaptive_offset_enabled_flag
+
+    if (reader.get_bits(1)) {  // pcm_enabled_flag
+      reader.skip_bits(8);  // pcm sample bit depths
+      if (!reader.get_uvlc(&value) || !reader.get_uvlc(&value)) {
+        return invalid_parameter_set("Invalid PCM block size in SPS");
+      }
+      reader.skip_bits(1);  // pcm_loop_filter_disabled_flag
+    }
+
+    int num_short_term_ref_pic_sets;
+    if (!read_uvlc(reader, kMaxShortTermRefPicSets, &num_short_term_ref_pic_sets)) {
+      return invalid_parameter_set("Too many short-term reference picture sets in SPS");
+    }
+
+    int num_delta_pocs[kMaxShortTermRefPicSets];
+    for (int i = 0; i < num_short_term_ref_pic_sets; i++) {
+      if (!skip_short_term_ref_pic_set(reader, i, num_delta_pocs)) {
+        return invalid_parameter_set("Invalid short-term reference picture set in SPS");
+      }
+    }
+
+    if (reader.get_bits(1)) {  // long_term_ref_pics_present_flag
+      int num_long_term_ref_pics;
+      if (!read_uvlc(reader, kMaxLongTermRefPics, &num_long_term_ref_pics)) {
+        return invalid_parameter_set("Too many long-term reference pictures in SPS");
+      }
+
+      for (int i = 0; i < num_long_term_ref_pics; i++) {
+        reader.skip_bits(log2_max_poc_lsb_minus4 + 4);  // lt_ref_pic_poc_lsb_sps
+        reader.skip_bits(1);  // used_by_curr_pic_lt_sps_flag
+      }
+    }
+
+    reader.skip_bits(2);  // sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
+
+    if (reader.get_bits(1)) {  // vui_parameters_present_flag
+      read_vui(reader, info);
+    }
+
+    if (reader.overrun()) {
+      return invalid_parameter_set("SPS is truncated");
+    }
+
+    info->has_sps = true;
+    return Error::Ok;
+  }
+
+
+  Error parse_pps(BitReader& reader, HEVCStreamInfo* info)
+  {
+    int value;
+
+    if (!reader.get_uvlc(&value) ||  // pps_pic_parameter_set_id
+        !reader.get_uvlc(&value)) {  // pps_seq_parameter_set_id
+      return invalid_parameter_set("Invalid PPS ID");
+    }
+
+    // dependent_slice_segments_enabled_flag, output_flag_present_flag,
+    // num_extra_slice_header_bits, sign_data_hiding_enabled_flag, cabac_init_present_flag
+    reader.skip_bits(7);
+
+    if (!reader.get_uvlc(&value) ||  // num_ref_idx_l0_default_active_minus1
+        !reader.get_uvlc(&value) ||  // num_ref_idx_l1_default_active_minus1
+        !reader.get_svlc(&value)) {  // init_qp_minus26
+      return invalid_parameter_set("Invalid PPS");
+    }
+
+    reader.skip_bits(2);  // constrained_intra_pred_flag, transform_skip_enabled_flag
+
+    if (reader.get_bits(1)) {  // cu_qp_delta_enabled_flag
+      if (!reader.get_uvlc(&value)) {  // diff_cu_qp_delta_depth
+        return invalid_parameter_set("Invalid PPS");
+      }
+    }
+
+    if (!reader.get_svlc(&value) ||  // pps_cb_qp_offset
+        !reader.get_svlc(&value)) {  // pps_cr_qp_offset
+      return invalid_parameter_set("Invalid PPS");
+    }
+
+    // pps_slice_chroma_qp_offsets_present_flag, weighted_pred_flag, weighted_bipred_flag,
+    // transquant_bypass_enabled_flag
+    reader.skip_bits(4);
+
+    info->tiles_enabled = reader.get_bits(1) != 0;
+    info->entropy_coding_sync = reader.get_bits(1) != 0;
+
+    if (info->tiles_enabled) {
+      int num_tile_columns_minus1, num_tile_rows_minus1;
+      if (!read_uvlc(reader, kMaxTileColumns - 1, &num_tile_columns_minus1) ||
+          !read_uvlc(reader, kMaxTileRows - 1, &num_tile_rows_minus1)) {
+        return invalid_parameter_set("Too many tiles in PPS");
+      }
+
+      info->num_tile_columns = num_tile_columns_minus1 + 1;
+      info->num_tile_rows = num_tile_rows_minus1 + 1;
+      info->uniform_tile_spacing = reader.get_bits(1) != 0;
+
+      // The explicit tile sizes and the remaining fields are not needed.
+    }
+
+    if (reader.overrun()) {
+      return invalid_parameter_set("PPS is truncated");
+    }
+
+    info->has_pps = true;
+    return Error::Ok;
+  }
+
+}
+
+
+heif_chroma HEVCStreamInfo::get_chroma() const
+{
+  switch (chroma_format_idc) {
+  case 0: return heif_chroma_monochrome;
+  case 2: return heif_chroma_422;
+  case 3: return heif_chroma_444;
+  default: return heif_chroma_420;
+  }
+}
+
+
+Error heif::parse_hevc_headers(const uint8_t* data, size_t size, int nal_length_size,
+                               HEVCStreamInfo* out_info)
+{
+  *out_info = HEVCStreamInfo();
+
+  if (nal_length_size < 1 || nal_length_size > 4) {
+    return invalid_parameter_set("Invalid NAL length size");
+  }
+
+  std::vector<uint8_t> rbsp;
+  size_t pos = 0;
+
+  while (pos < size && !(out_info->has_sps && out_info->has_pps)) {
+    if (size - pos < (size_t)nal_length_size) {
+      return invalid_parameter_set("Truncated NAL unit in 'hvcC' headers");
+    }
+
+    size_t nal_size = 0;
+    for (int i = 0; i < nal_length_size; i++) {
+      nal_size = (nal_size << 8) | data[pos + i];
+    }
+    pos += nal_length_size;
+
+    if (nal_size > size - pos) {
+      return invalid_parameter_set("Truncated NAL unit in 'hvcC' headers");
+    }
+
+    const uint8_t* nal = data + pos;
+    pos += nal_size;
+
+    if (nal_size < 3) {
+      continue;
+    }
+
+    int nal_type = (nal[0] >> 1) & 0x3F;
+    int layer_id = ((nal[0] & 1) << 5) | (nal[1] >> 3);
+
+    bool is_sps = (nal_type == kNalSPS && !out_info->has_sps);
+    bool is_pps = (nal_type == kNalPPS && !out_info->has_pps);
+
+    if (layer_id != 0 || !(is_sps || is_pps)) {
+      continue;
+    }
+
+    get_rbsp(nal, nal_size, &rbsp);
+    BitReader reader(rbsp.data(), (int)rbsp.size());
+
+    Error err = is_sps ? parse_sps(reader, out_info) : parse_pps(reader, out_info);
+    if (err && reader.overrun()) {
+      return invalid_parameter_set(is_sps ? "SPS is truncated" : "PPS is truncated");
+    }
+    else if (err) {
+      return err;
+    }
+  }
+
+  return Error::Ok;
+}
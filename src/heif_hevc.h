@@ -0,0 +1,103 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_HEVC_H
+#define LIBHEIF_HEIF_HEVC_H
+
+#include "error.h"
+#include "heif.h"
+
+#include <stdint.h>
+
+
+namespace heif {
+
+  // Properties of an HEVC stream, read from its SPS and PPS without a decoder.
+  struct HEVCStreamInfo {
+
+    // --- SPS
+
+    bool has_sps = false;
+
+    uint8_t general_profile_idc = 0;
+    uint8_t general_level_idc = 0;
+    bool general_tier_flag = false;
+
+    int chroma_format_idc = 1;  // 0: monochrome, 1: 4:2:0, 2: 4:2:2, 3: 4:4:4
+    bool separate_colour_planes = false;
+
+    // size of the decoded pictures, before cropping to the conformance window
+    uint32_t coded_width = 0;
+    uint32_t coded_height = 0;
+
+    // conformance window, in luma samples
+    uint32_t conf_win_left = 0;
+    uint32_t conf_win_right = 0;
+    uint32_t conf_win_top = 0;
+    uint32_t conf_win_bottom = 0;
+
+    int bit_depth_luma = 8;
+    int bit_depth_chroma = 8;
+
+    int log2_ctb_size = 4;
+
+    // --- VUI, part of the SPS
+
+    bool has_video_signal_type = false;
+    bool full_range = false;
+
+    // ISO/IEC 23091-2 codes, 2 (unspecified) if there is no colour description
+    bool has_colour_description = false;
+    uint8_t colour_primaries = 2;
+    uint8_t transfer_characteristics = 2;
+    uint8_t matrix_coefficients = 2;
+
+    // --- PPS
+
+    bool has_pps = false;
+
+    bool tiles_enabled = false;
+    int num_tile_columns = 1;
+    int num_tile_rows = 1;
+    bool uniform_tile_spacing = true;
+
+    bool entropy_coding_sync = false;  // wavefront parallel processing
+
+
+    uint32_t get_cropped_width() const { return coded_width - conf_win_left - conf_win_right; }
+    uint32_t get_cropped_height() const { return coded_height - conf_win_top - conf_win_bottom; }
+
+    heif_chroma get_chroma() const;
+
+    // number of coding tree blocks in a row and in a column
+    uint32_t get_ctb_columns() const { return (coded_width + (1u << log2_ctb_size) - 1) >> log2_ctb_size; }
+    uint32_t get_ctb_rows() const { return (coded_height + (1u << log2_ctb_size) - 1) >> log2_ctb_size; }
+  };
+
+  // Parse the parameter sets of an HEVC stream given as NAL units, each prefixed with its size
+  // in 'nal_length_size' bytes (the 'hvcC' headers as stored in HeifFile::Item). The first
+  // SPS and PPS of the base layer are read; other NAL units are skipped. All reads are
+  // bounds checked. Without an SPS, out_info->has_sps is false and no error is returned.
+  Error parse_hevc_headers(const uint8_t* data, size_t size, int nal_length_size,
+                           HEVCStreamInfo* out_info);
+
+}
+
+#endif
@@ -0,0 +1,577 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_image.h"
+
+#include <algorithm>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+using namespace heif;
+
+
+ImageTransform::ImageTransform(int width, int height)
+  : m_width(width),
+    m_height(height),
+    m_crop_width(width),
+    m_crop_height(height)
+{
+}
+
+
+void ImageTransform::set_crop(int left, int top, int width, int height)
+{
+  int right = std::min(left + width, m_width);
+  int bottom = std::min(top + height, m_height);
+
+  m_crop_left = std::max(0, std::min(left, m_width));
+  m_crop_top = std::max(0, std::min(top, m_height));
+  m_crop_width = std::max(0, right - m_crop_left);
+  m_crop_height = std::max(0, bottom - m_crop_top);
+}
+
+
+void ImageTransform::set_rotation(int degrees_ccw)
+{
+  m_rotation = ((degrees_ccw % 360) + 360) % 360;
+}
+
+
+void ImageTransform::set_mirror(int axis)
+{
+  m_mirror_axis = axis;
+}
+
+
+bool ImageTransform::is_identity() const
+{
+  return (m_crop_left == 0 && m_crop_top == 0 &&
+          m_crop_width == m_width && m_crop_height == m_height &&
+          m_rotation == 0 && m_mirror_axis < 0);
+}
+
+
+void ImageTransform::get_mapping(int crop_w, int crop_h, int c[6]) const
+{
+  switch (m_rotation) {
+  case 90:
+    c[0] =  0; c[1] =  1; c[2] = 0;
+    c[3] = -1; c[4] =  0; c[5] = crop_w - 1;
+    break;
+  case 180:
+    c[0] = -1; c[1] =  0; c[2] = crop_w - 1;
+    c[3] =  0; c[4] = -1; c[5] = crop_h - 1;
+    break;
+  case 270:
+    c[0] =  0; c[1] = -1; c[2] = crop_h - 1;
+    c[3] =  1; c[4] =  0; c[5] = 0;
+    break;
+  default:
+    c[0] =  1; c[1] =  0; c[2] = 0;
+    c[3] =  0; c[4] =  1; c[5] = 0;
+    break;
+  }
+
+  int out_w = swaps_axes() ? crop_h : crop_w;
+  int out_h = swaps_axes() ? crop_w : crop_h;
+
+  if (m_mirror_axis == 0) {
+    c[0] = -c[0]; c[1] = -c[1]; c[2] = out_w - 1 - c[2];
+  }
+  else if (m_mirror_axis == 1) {
+    c[3] = -c[3]; c[4] = -c[4]; c[5] = out_h - 1 - c[5];
+  }
+}
+
+
+bool ImageTransform::map_rect(int x, int y, int w, int h,
+                              int* out_x, int* out_y, int* out_w, int* out_h) const
+{
+  int x0 = std::max(x, m_crop_left) - m_crop_left;
+  int y0 = std::max(y, m_crop_top) - m_crop_top;
+  int x1 = std::min(x + w, m_crop_left + m_crop_width) - m_crop_left;
+  int y1 = std::min(y + h, m_crop_top + m_crop_height) - m_crop_top;
+
+  if (x0 >= x1 || y0 >= y1) {
+    return false;
+  }
+
+  int c[6];
+  get_mapping(m_crop_width, m_crop_height, c);
+
+  // map two opposite corners (inclusive) and take their bounding box
+
+  int ax = c[0]*x0 + c[1]*y0 + c[2];
+  int ay = c[3]*x0 + c[4]*y0 + c[5];
+  int bx = c[0]*(x1-1) + c[1]*(y1-1) + c[2];
+  int by = c[3]*(x1-1) + c[4]*(y1-1) + c[5];
+
+  *out_x = std::min(ax, bx);
+  *out_y = std::min(ay, by);
+  *out_w = std::abs(bx - ax) + 1;
+  *out_h = std::abs(by - ay) + 1;
+
+  return true;
+}
+
+
+// ---
+
+
+HeifPixelImage::HeifPixelImage()
+{
+}
+
+
+HeifPixelImage::~HeifPixelImage()
+{
+}
+
+
+int HeifPixelImage::get_number_of_planes(heif_chroma chroma)
+{
+  switch (chroma) {
+  case heif_chroma_monochrome:
+    return 1;
+  case heif_chroma_420:
+  case heif_chroma_422:
+  case heif_chroma_444:
+    return 3;
+  case heif_chroma_interleaved_24bit:
+  case heif_chroma_interleaved_32bit:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+int HeifPixelImage::get_bytes_per_pixel(heif_chroma chroma)
+{
+  switch (chroma) {
+  case heif_chroma_interleaved_24bit:
+    return 3;
+  case heif_chroma_interleaved_32bit:
+    return 4;
+  default:
+    return 1;
+  }
+}
+
+
+void HeifPixelImage::get_subsampling(heif_chroma chroma, int plane, int* shift_x, int* shift_y)
+{
+  *shift_x = 0;
+  *shift_y = 0;
+
+  if (plane == 0) {
+    return;
+  }
+
+  if (chroma == heif_chroma_420) {
+    *shift_x = 1;
+    *shift_y = 1;
+  }
+  else if (chroma == heif_chroma_422) {
+    *shift_x = 1;
+  }
+}
+
+
+void HeifPixelImage::set_plane_sizes(int width, int height, heif_chroma chroma)
+{
+  m_width = width;
+  m_height = height;
+  m_chroma = chroma;
+  m_num_planes = get_number_of_planes(chroma);
+
+  for (int c=0;c<3;c++) {
+    int shift_x, shift_y;
+    get_subsampling(chroma, c, &shift_x, &shift_y);
+
+    m_planes[c] = Plane();
+
+    if (c < m_num_planes) {
+      m_planes[c].width  = (width  + (1<<shift_x) - 1) >> shift_x;
+      m_planes[c].height = (height + (1<<shift_y) - 1) >> shift_y;
+    }
+  }
+}
+
+
+std::shared_ptr<HeifPixelImage> HeifPixelImage::new_image(const std::shared_ptr<MemoryAccount>& account)
+{
+  if (!account) {
+    return std::make_shared<HeifPixelImage>();
+  }
+
+  return std::allocate_shared<HeifPixelImage>(PoolAllocator<HeifPixelImage>(account->get_buffer_pool()));
+}
+
+
+Error HeifPixelImage::create(int width, int height, heif_chroma chroma,
+                             const std::shared_ptr<MemoryAccount>& account,
+                             const PlaneLayout& layout)
+{
+  if (width <= 0 || height <= 0 || get_number_of_planes(chroma) == 0) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "Invalid image size or chroma format");
+  }
+
+  if (layout.alignment & (layout.alignment - 1)) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "Plane alignment has to be a power of two");
+  }
+
+  m_buffer.release();
+  m_memory_charge.release();
+  m_parent.reset();
+
+  set_plane_sizes(width, height, chroma);
+
+  size_t align_mask = (layout.alignment ? layout.alignment - 1 : 0);
+
+  size_t size = 0;
+  for (int c=0;c<m_num_planes;c++) {
+    size_t stride = (static_cast<size_t>(m_planes[c].width) * get_bytes_per_pixel(chroma) +
+                     layout.row_padding + align_mask) & ~align_mask;
+    if (stride > INT_MAX) {
+      return Error(heif_error_Usage_error,
+                   heif_suberror_Unspecified,
+                   "Invalid image size or plane layout");
+    }
+
+    m_planes[c].stride = static_cast<int>(stride);
+    size += stride * m_planes[c].height;
+  }
+
+  Error err = m_memory_charge.charge(account, size, "Decoded image");
+  if (err) {
+    return err;
+  }
+
+  std::shared_ptr<BufferPool> pool;
+  if (account) {
+    pool = account->get_buffer_pool();
+  }
+
+  if (!m_buffer.allocate(pool, size, layout.alignment)) {
+    return Error(heif_error_Memory_allocation_error,
+                 heif_suberror_Unspecified);
+  }
+
+  // planes are stored one after the other, each row padded to the stride. As the strides
+  // are multiples of the alignment, every plane starts aligned.
+  uint8_t* p = m_buffer.data();
+  for (int c=0;c<m_num_planes;c++) {
+    m_planes[c].mem = p;
+    p += static_cast<size_t>(m_planes[c].stride) * m_planes[c].height;
+  }
+
+  return Error::Ok;
+}
+
+
+void HeifPixelImage::wrap_planes(int width, int height, heif_chroma chroma,
+                                 uint8_t* const planes[3], const int strides[3])
+{
+  m_buffer.release();
+  m_memory_charge.release();
+  m_parent.reset();
+
+  set_plane_sizes(width, height, chroma);
+
+  for (int c=0;c<m_num_planes;c++) {
+    m_planes[c].mem = planes[c];
+    m_planes[c].stride = strides[c];
+  }
+}
+
+
+Error HeifPixelImage::move_memory_charge(const std::shared_ptr<MemoryAccount>& account) const
+{
+  if (m_parent) {
+    return m_parent->move_memory_charge(account);
+  }
+
+  return m_memory_charge.move_to(account, "Cached image");
+}
+
+
+std::shared_ptr<HeifPixelImage> HeifPixelImage::create_view(const std::shared_ptr<const HeifPixelImage>& src,
+                                                            int left, int top, int width, int height,
+                                                            const std::shared_ptr<MemoryAccount>& account)
+{
+  auto view = new_image(account);
+
+  view->set_plane_sizes(width, height, src->m_chroma);
+  view->m_parent = src;
+
+  for (int c=0;c<view->m_num_planes;c++) {
+    int shift_x, shift_y;
+    get_subsampling(src->m_chroma, c, &shift_x, &shift_y);
+
+    const Plane& src_plane = src->m_planes[c];
+
+    view->m_planes[c].mem = (src_plane.mem + (top >> shift_y) * src_plane.stride +
+                             (left >> shift_x) * get_bytes_per_pixel(src->m_chroma));
+    view->m_planes[c].stride = src_plane.stride;
+  }
+
+  return view;
+}
+
+
+bool HeifPixelImage::has_layout(const PlaneLayout& layout) const
+{
+  // The stride of a view extends beyond its last row, so the padding is not guaranteed.
+  if (m_parent && layout.row_padding) {
+    return false;
+  }
+
+  uintptr_t align_mask = (layout.alignment ? layout.alignment - 1 : 0);
+
+  for (int c=0;c<m_num_planes;c++) {
+    const Plane& plane = m_planes[c];
+
+    if ((reinterpret_cast<uintptr_t>(plane.mem) & align_mask) != 0 ||
+        (static_cast<uintptr_t>(plane.stride) & align_mask) != 0 ||
+        plane.stride < plane.width * get_bytes_per_pixel(m_chroma) + (int64_t)layout.row_padding) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+uint8_t* HeifPixelImage::get_plane(int plane, int* out_stride)
+{
+  if (plane < 0 || plane >= m_num_planes) {
+    return nullptr;
+  }
+
+  if (out_stride) {
+    *out_stride = m_planes[plane].stride;
+  }
+
+  return m_planes[plane].mem;
+}
+
+
+const uint8_t* HeifPixelImage::get_plane(int plane, int* out_stride) const
+{
+  if (plane < 0 || plane >= m_num_planes) {
+    return nullptr;
+  }
+
+  if (out_stride) {
+    *out_stride = m_planes[plane].stride;
+  }
+
+  return m_planes[plane].mem;
+}
+
+
+void HeifPixelImage::fill(const uint8_t values[3])
+{
+  if (get_bytes_per_pixel(m_chroma) != 1) {
+    return;
+  }
+
+  for (int c=0;c<m_num_planes;c++) {
+    Plane& plane = m_planes[c];
+
+    for (int y=0;y<plane.height;y++) {
+      memset(plane.mem + y*plane.stride, values[c], plane.width);
+    }
+  }
+}
+
+
+Error HeifPixelImage::copy_into(HeifPixelImage* dst, int dst_x, int dst_y) const
+{
+  if (dst->m_chroma != m_chroma) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion,
+                 "Cannot combine images with different chroma formats");
+  }
+
+  for (int c=0;c<m_num_planes;c++) {
+    int shift_x, shift_y;
+    get_subsampling(m_chroma, c, &shift_x, &shift_y);
+
+    const Plane& src_plane = m_planes[c];
+    const Plane& dst_plane = dst->m_planes[c];
+
+    // position of this plane in the destination plane, clipped at all sides
+
+    int x0 = dst_x >> shift_x;
+    int y0 = dst_y >> shift_y;
+
+    int src_x = 0, src_y = 0;
+    if (x0 < 0) { src_x = -x0; x0 = 0; }
+    if (y0 < 0) { src_y = -y0; y0 = 0; }
+
+    int w = std::min(src_plane.width  - src_x, dst_plane.width  - x0);
+    int h = std::min(src_plane.height - src_y, dst_plane.height - y0);
+
+    if (w <= 0 || h <= 0) {
+      continue;
+    }
+
+    int bpp = get_bytes_per_pixel(m_chroma);
+
+    const uint8_t* in = src_plane.mem + src_y * src_plane.stride + src_x * bpp;
+    uint8_t* out = dst_plane.mem + y0 * dst_plane.stride + x0 * bpp;
+
+    for (int y=0;y<h;y++) {
+      memcpy(out + y*dst_plane.stride, in + y*src_plane.stride, w * bpp);
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+// Copy a w x h block of samples. The source sample (u,v) is written to
+// out + u*step_u + v*step_v.
+static void copy_plane_transformed(const uint8_t* in, int in_stride, int w, int h,
+                                   uint8_t* out, ptrdiff_t step_u, ptrdiff_t step_v)
+{
+  if (step_u == 1) {
+    // no rotation, rows may be flipped vertically
+
+    for (int v=0;v<h;v++) {
+      memcpy(out + v*step_v, in + v*in_stride, w);
+    }
+  }
+  else if (step_u == -1) {
+    // horizontally mirrored rows
+
+    for (int v=0;v<h;v++) {
+      const uint8_t* s = in + v*in_stride;
+      uint8_t* d = out + v*step_v;
+
+      for (int u=0;u<w;u++) {
+        d[-u] = s[u];
+      }
+    }
+  }
+  else {
+    // Transposition. Work on small blocks so that the lines read from the source
+    // and the lines written to the destination both stay in the cache.
+
+    const int block_size = 16;
+
+    for (int v0=0; v0<h; v0+=block_size) {
+      int v1 = std::min(v0 + block_size, h);
+
+      for (int u0=0; u0<w; u0+=block_size) {
+        int u1 = std::min(u0 + block_size, w);
+
+        for (int v=v0; v<v1; v++) {
+          const uint8_t* s = in + v*in_stride;
+          uint8_t* d = out + v*step_v;
+
+          for (int u=u0; u<u1; u++) {
+            d[u*step_u] = s[u];
+          }
+        }
+      }
+    }
+  }
+}
+
+
+Error HeifPixelImage::copy_into_transformed(HeifPixelImage* dst, int src_x, int src_y,
+                                            const ImageTransform& transform) const
+{
+  if (dst->m_chroma != m_chroma) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion,
+                 "Cannot combine images with different chroma formats");
+  }
+
+  if (get_bytes_per_pixel(m_chroma) != 1) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion,
+                 "Transformations are applied before the conversion to interleaved RGB");
+  }
+
+  if (transform.swaps_axes() && m_chroma == heif_chroma_422) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion,
+                 "Cannot rotate 4:2:2 images by 90 degrees");
+  }
+
+  for (int c=0;c<m_num_planes;c++) {
+    int shift_x, shift_y;
+    get_subsampling(m_chroma, c, &shift_x, &shift_y);
+
+    const Plane& src_plane = m_planes[c];
+    const Plane& dst_plane = dst->m_planes[c];
+
+    // crop window in plane coordinates, its size follows from the output plane
+
+    int crop_x = transform.get_crop_left() >> shift_x;
+    int crop_y = transform.get_crop_top() >> shift_y;
+    int crop_w = transform.swaps_axes() ? dst_plane.height : dst_plane.width;
+    int crop_h = transform.swaps_axes() ? dst_plane.width : dst_plane.height;
+
+    // part of this plane that is inside of the crop window
+
+    int px = src_x >> shift_x;
+    int py = src_y >> shift_y;
+
+    int x0 = std::max(px, crop_x);
+    int y0 = std::max(py, crop_y);
+    int x1 = std::min(px + src_plane.width, crop_x + crop_w);
+    int y1 = std::min(py + src_plane.height, crop_y + crop_h);
+
+    if (x0 >= x1 || y0 >= y1) {
+      continue;
+    }
+
+    int m[6];
+    transform.get_mapping(crop_w, crop_h, m);
+
+    int u = x0 - crop_x;
+    int v = y0 - crop_y;
+    int out_x = m[0]*u + m[1]*v + m[2];
+    int out_y = m[3]*u + m[4]*v + m[5];
+
+    ptrdiff_t step_u = m[0] + (ptrdiff_t)m[3] * dst_plane.stride;
+    ptrdiff_t step_v = m[1] + (ptrdiff_t)m[4] * dst_plane.stride;
+
+    const uint8_t* in = src_plane.mem + (y0 - py) * src_plane.stride + (x0 - px);
+    uint8_t* out = dst_plane.mem + out_y * dst_plane.stride + out_x;
+
+    copy_plane_transformed(in, src_plane.stride, x1 - x0, y1 - y0, out, step_u, step_v);
+  }
+
+  return Error::Ok;
+}
@@ -0,0 +1,203 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_IMAGE_H
+#define LIBHEIF_HEIF_IMAGE_H
+
+#include "heif.h"
+#include "error.h"
+#include "heif_limits.h"
+
+#include <memory>
+
+
+namespace heif {
+
+  // Geometric transformations of an image: the 'clap' crop window, the 'irot' rotation
+  // and the 'imir' mirroring, applied in this order (the order required by HEIF).
+  // Positions refer to the uncropped source image, in luma samples.
+  class ImageTransform {
+  public:
+    // Identity transform of a width x height image.
+    ImageTransform(int width = 0, int height = 0);
+
+    // The crop window is clipped to the image.
+    void set_crop(int left, int top, int width, int height);
+
+    void set_rotation(int degrees_ccw);  // 0, 90, 180 or 270
+
+    void set_mirror(int axis);  // -1: none, 0: vertical axis (left <-> right), 1: horizontal axis
+
+    bool is_identity() const;
+
+    // True if the transform only crops, i.e. the output is a rectangle of the source.
+    bool is_crop_only() const { return m_rotation == 0 && m_mirror_axis < 0; }
+
+    bool swaps_axes() const { return m_rotation == 90 || m_rotation == 270; }
+
+    int get_source_width() const { return m_width; }
+    int get_source_height() const { return m_height; }
+
+    int get_crop_left() const { return m_crop_left; }
+    int get_crop_top() const { return m_crop_top; }
+
+    int get_output_width() const { return swaps_axes() ? m_crop_height : m_crop_width; }
+    int get_output_height() const { return swaps_axes() ? m_crop_width : m_crop_height; }
+
+    // Map the source rectangle to the output image. Returns false if it is outside of the crop window.
+    bool map_rect(int x, int y, int w, int h,
+                  int* out_x, int* out_y, int* out_w, int* out_h) const;
+
+    // Coefficients of the mapping from a position (u,v) in a crop_w x crop_h window to the output:
+    // out_x = c[0]*u + c[1]*v + c[2], out_y = c[3]*u + c[4]*v + c[5]
+    void get_mapping(int crop_w, int crop_h, int coeffs[6]) const;
+
+  private:
+    int m_width, m_height;
+
+    int m_crop_left = 0;
+    int m_crop_top = 0;
+    int m_crop_width, m_crop_height;
+
+    int m_rotation = 0;
+    int m_mirror_axis = -1;
+  };
+
+
+  // Memory layout of the planes of an image.
+  struct PlaneLayout {
+    // the start of each plane and its stride are multiples of this (a power of two),
+    // 0 for rows without padding
+    uint32_t alignment = 0;
+
+    // minimum number of bytes after the last pixel of each row
+    uint32_t row_padding = 0;
+  };
+
+
+  // Decoded image with up to three planes of 8-bit samples, or one plane of
+  // interleaved RGB / RGBA pixels.
+  // The planes are either owned by the image (create()) or reference
+  // memory owned by somebody else, e.g. a decoder frame (wrap_planes()).
+  class HeifPixelImage {
+  public:
+    HeifPixelImage();
+    ~HeifPixelImage();
+
+    HeifPixelImage(const HeifPixelImage&) = delete;
+    HeifPixelImage& operator=(const HeifPixelImage&) = delete;
+
+    // New image object, taken from the buffer pool of 'account' if given. Use this
+    // instead of std::make_shared() on decoding paths, which should not allocate.
+    static std::shared_ptr<HeifPixelImage> new_image(const std::shared_ptr<MemoryAccount>& account);
+
+    // Allocate all planes in one memory block from the buffer pool of 'account', if given.
+    // It is charged to the account as long as the image exists.
+    Error create(int width, int height, heif_chroma chroma,
+                 const std::shared_ptr<MemoryAccount>& account = nullptr,
+                 const PlaneLayout& layout = PlaneLayout());
+
+    // Reference external planes. The memory has to stay valid as long as this image is used.
+    void wrap_planes(int width, int height, heif_chroma chroma,
+                     uint8_t* const planes[3], const int strides[3]);
+
+    // Create a view of the rectangle (left,top,width,height) of 'src', in luma samples.
+    // The view points into the planes of 'src' without copying and keeps 'src' alive.
+    // 'src' must not be modified while the view exists.
+    static std::shared_ptr<HeifPixelImage> create_view(const std::shared_ptr<const HeifPixelImage>& src,
+                                                       int left, int top, int width, int height,
+                                                       const std::shared_ptr<MemoryAccount>& account = nullptr);
+
+    int get_width() const { return m_width; }
+    int get_height() const { return m_height; }
+
+    heif_chroma get_chroma_format() const { return m_chroma; }
+
+    int get_bit_depth() const { return 8; }
+
+    int get_number_of_planes() const { return m_num_planes; }
+
+    int get_plane_width(int plane) const { return m_planes[plane].width; }
+    int get_plane_height(int plane) const { return m_planes[plane].height; }
+
+    uint8_t* get_plane(int plane, int* out_stride);
+    const uint8_t* get_plane(int plane, int* out_stride) const;
+
+    // Whether the planes are stored as described by 'layout'.
+    bool has_layout(const PlaneLayout& layout) const;
+
+    // Number of bytes of pixel memory kept alive by this image. For views,
+    // this is the memory of the image they refer to.
+    size_t get_memory_size() const { return m_parent ? m_parent->get_memory_size() : m_buffer.size(); }
+
+    // Account that this memory is charged to, null if it is not charged.
+    const MemoryAccount* get_memory_account() const {
+      return m_parent ? m_parent->get_memory_account() : m_memory_charge.get_account();
+    }
+
+    // Charge the memory to 'account' instead, when the image cache takes it over. Only called
+    // before the image is shared with other threads, or if it is charged to 'account' already.
+    Error move_memory_charge(const std::shared_ptr<MemoryAccount>& account) const;
+
+    // Set all samples of each plane to values[plane]. Only for planar images.
+    void fill(const uint8_t values[3]);
+
+    // Copy this image into 'dst' with its top-left corner at (dst_x,dst_y) in luma samples.
+    // Parts outside of 'dst' are clipped. Both images must have the same chroma format.
+    Error copy_into(HeifPixelImage* dst, int dst_x, int dst_y) const;
+
+    // Copy this image into 'dst', which has the output size of 'transform', as if it was placed
+    // at (src_x,src_y) on the transform's source image and the transform was then applied.
+    // Parts outside of the crop window are skipped. This places tiles directly at their final
+    // position, so that no intermediate full-size image has to be rotated or cropped.
+    Error copy_into_transformed(HeifPixelImage* dst, int src_x, int src_y,
+                                const ImageTransform& transform) const;
+
+    static int get_number_of_planes(heif_chroma chroma);
+    static int get_bytes_per_pixel(heif_chroma chroma);  // bytes per sample of each plane
+    static void get_subsampling(heif_chroma chroma, int plane, int* shift_x, int* shift_y);
+
+  private:
+    struct Plane {
+      uint8_t* mem = nullptr;
+      int stride = 0;
+      int width = 0;
+      int height = 0;
+    };
+
+    int m_width = 0;
+    int m_height = 0;
+    heif_chroma m_chroma = heif_chroma_undefined;
+
+    int m_num_planes = 0;
+    Plane m_planes[3];
+
+    AllocatedBuffer m_buffer;
+    mutable MemoryCharge m_memory_charge;  // moved by move_memory_charge()
+
+    // image whose planes are referenced by this view
+    std::shared_ptr<const HeifPixelImage> m_parent;
+
+    void set_plane_sizes(int width, int height, heif_chroma chroma);
+  };
+
+}
+
+#endif
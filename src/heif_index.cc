@@ -0,0 +1,361 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_index.h"
+
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace heif;
+
+
+enum IndexItemFlags {
+  kItemHidden = 1,
+  kItemHasIspe = 2,
+  kItemHasClap = 4,
+  kItemHasAuxC = 8,
+  kItemHasData = 16,
+  kItemHasNclx = 32
+};
+
+
+// --- writing
+
+class IndexWriter
+{
+public:
+  void write8(uint8_t v) { m_data.push_back(v); }
+
+  void write32(uint32_t v) {
+    for (int shift=24; shift>=0; shift-=8) {
+      m_data.push_back((uint8_t)(v >> shift));
+    }
+  }
+
+  void write64(uint64_t v) {
+    write32((uint32_t)(v >> 32));
+    write32((uint32_t)(v & 0xFFFFFFFF));
+  }
+
+  void write(const uint8_t* data, size_t size) {
+    write32((uint32_t)size);
+    m_data.insert(m_data.end(), data, data+size);
+  }
+
+  void write(const std::string& str) { write((const uint8_t*)str.data(), str.size()); }
+  void write(const std::vector<uint8_t>& vec) { write(vec.data(), vec.size()); }
+
+  const std::vector<uint8_t>& get_data() const { return m_data; }
+
+private:
+  std::vector<uint8_t> m_data;
+};
+
+
+Error heif::write_index_file(const char* index_filename,
+                             const FileIdentity& file,
+                             const HeifFile& heif_file)
+{
+  IndexWriter writer;
+
+  writer.write32(fourcc("hidx"));
+  writer.write32(kIndexFileVersion);
+  writer.write64(file.get_size());
+  writer.write64((uint64_t)file.get_mtime_sec());
+  writer.write64((uint64_t)file.get_mtime_nsec());
+  writer.write32(heif_file.get_primary_image_ID());
+
+  const auto& items = heif_file.get_items();
+  writer.write32((uint32_t)items.size());
+
+  for (const auto& pair : items) {
+    const HeifFile::Item& item = pair.second;
+
+    writer.write32(item.id);
+    writer.write(item.item_type);
+
+    uint8_t flags = 0;
+    if (item.hidden)   flags |= kItemHidden;
+    if (item.has_ispe) flags |= kItemHasIspe;
+    if (item.has_clap) flags |= kItemHasClap;
+    if (item.has_auxC) flags |= kItemHasAuxC;
+    if (item.has_data) flags |= kItemHasData;
+    if (item.has_nclx) flags |= kItemHasNclx;
+    writer.write8(flags);
+
+    writer.write32(item.reference_type);
+    writer.write32((uint32_t)item.references.size());
+    for (heif_image_id ref : item.references) {
+      writer.write32(ref);
+    }
+
+    writer.write32(item.ispe_width);
+    writer.write32(item.ispe_height);
+    writer.write32((uint32_t)item.clap_left);
+    writer.write32((uint32_t)item.clap_top);
+    writer.write32((uint32_t)item.clap_width);
+    writer.write32((uint32_t)item.clap_height);
+    writer.write32((uint32_t)item.rotation);
+    writer.write8(item.mirror_axis < 0 ? 0xFF : (uint8_t)item.mirror_axis);
+
+    writer.write(item.aux_type);
+    writer.write(item.aux_subtypes);
+
+    writer.write8((uint8_t)item.nal_length_size);
+    writer.write(item.codec_headers);
+
+    writer.write32(item.colour_primaries);
+    writer.write32(item.transfer_characteristics);
+    writer.write32(item.matrix_coefficients);
+    writer.write8(item.full_range ? 1 : 0);
+    writer.write(item.icc_profile);
+
+    writer.write32((uint32_t)item.extents.size());
+    for (const auto& extent : item.extents) {
+      writer.write64(extent.offset);
+      writer.write64(extent.length);
+    }
+  }
+
+
+  // --- write to a temporary file first, so that readers never see a partial index
+
+  std::string tmp_filename = std::string(index_filename) + ".tmp";
+
+  FILE* fh = fopen(tmp_filename.c_str(), "wb");
+  if (!fh) {
+    return Error(heif_error_Encoding_error,
+                 heif_suberror_Cannot_write_output_data,
+                 "Cannot create index file");
+  }
+
+  const std::vector<uint8_t>& data = writer.get_data();
+  size_t n = fwrite(data.data(), 1, data.size(), fh);
+
+  if (fclose(fh) != 0 || n != data.size() ||
+      rename(tmp_filename.c_str(), index_filename) != 0) {
+    unlink(tmp_filename.c_str());
+
+    return Error(heif_error_Encoding_error,
+                 heif_suberror_Cannot_write_output_data,
+                 "Cannot write index file");
+  }
+
+  return Error::Ok;
+}
+
+
+// --- reading
+
+class IndexReader
+{
+public:
+  IndexReader(const uint8_t* data, size_t size) : m_data(data), m_end(data+size) { }
+
+  bool error() const { return m_error; }
+
+  uint8_t read8() {
+    if (!check(1)) return 0;
+    return *m_data++;
+  }
+
+  uint32_t read32() {
+    if (!check(4)) return 0;
+    uint32_t v = ((uint32_t)m_data[0] << 24) | ((uint32_t)m_data[1] << 16) |
+                 ((uint32_t)m_data[2] <<  8) | ((uint32_t)m_data[3]);
+    m_data += 4;
+    return v;
+  }
+
+  uint64_t read64() {
+    uint64_t hi = read32();
+    uint64_t lo = read32();
+    return (hi << 32) | lo;
+  }
+
+  template <class T> void read(T* out) {
+    uint32_t size = read32();
+    if (!check(size)) return;
+    out->assign(m_data, m_data+size);
+    m_data += size;
+  }
+
+  // number of elements that follow, each at least 'min_element_size' bytes long
+  uint32_t read_count(size_t min_element_size) {
+    uint32_t n = read32();
+    if (!check(n * (uint64_t)min_element_size)) return 0;
+    return n;
+  }
+
+private:
+  const uint8_t* m_data;
+  const uint8_t* m_end;
+  bool m_error = false;
+
+  bool check(uint64_t n) {
+    if (m_error || n > (uint64_t)(m_end - m_data)) {
+      m_error = true;
+      return false;
+    }
+    return true;
+  }
+};
+
+
+static Error parse_index(const uint8_t* data, size_t size,
+                         const FileIdentity& file,
+                         heif_image_id* primary_image_ID,
+                         std::map<heif_image_id, HeifFile::Item>* items)
+{
+  IndexReader reader(data, size);
+
+  if (reader.read32() != fourcc("hidx") ||
+      reader.read32() != kIndexFileVersion) {
+    return Error(heif_error_Unsupported_filetype,
+                 heif_suberror_Unsupported_data_version,
+                 "Not an index file or unsupported index version");
+  }
+
+  uint64_t file_size = reader.read64();
+  int64_t mtime_sec = (int64_t)reader.read64();
+  int64_t mtime_nsec = (int64_t)reader.read64();
+
+  if (file_size != file.get_size() ||
+      mtime_sec != file.get_mtime_sec() ||
+      mtime_nsec != file.get_mtime_nsec()) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_Unspecified,
+                 "Index file does not match the input file");
+  }
+
+  *primary_image_ID = reader.read32();
+
+  uint32_t num_items = reader.read_count(4);
+
+  for (uint32_t i=0; i<num_items && !reader.error(); i++) {
+    HeifFile::Item item;
+
+    item.id = reader.read32();
+    reader.read(&item.item_type);
+
+    uint8_t flags = reader.read8();
+    item.hidden   = (flags & kItemHidden) != 0;
+    item.has_ispe = (flags & kItemHasIspe) != 0;
+    item.has_clap = (flags & kItemHasClap) != 0;
+    item.has_auxC = (flags & kItemHasAuxC) != 0;
+    item.has_data = (flags & kItemHasData) != 0;
+    item.has_nclx = (flags & kItemHasNclx) != 0;
+
+    item.reference_type = reader.read32();
+    uint32_t num_refs = reader.read_count(4);
+    for (uint32_t r=0; r<num_refs; r++) {
+      item.references.push_back(reader.read32());
+    }
+
+    item.ispe_width  = reader.read32();
+    item.ispe_height = reader.read32();
+    item.clap_left   = (int)reader.read32();
+    item.clap_top    = (int)reader.read32();
+    item.clap_width  = (int)reader.read32();
+    item.clap_height = (int)reader.read32();
+    item.rotation    = (int)reader.read32();
+
+    uint8_t mirror_axis = reader.read8();
+    item.mirror_axis = (mirror_axis == 0xFF ? -1 : mirror_axis);
+
+    reader.read(&item.aux_type);
+    reader.read(&item.aux_subtypes);
+
+    item.nal_length_size = reader.read8();
+    reader.read(&item.codec_headers);
+
+    item.colour_primaries = (uint16_t)reader.read32();
+    item.transfer_characteristics = (uint16_t)reader.read32();
+    item.matrix_coefficients = (uint16_t)reader.read32();
+    item.full_range = reader.read8() != 0;
+    reader.read(&item.icc_profile);
+
+    uint32_t num_extents = reader.read_count(16);
+    for (uint32_t e=0; e<num_extents; e++) {
+      HeifFile::Item::Extent extent;
+      extent.offset = reader.read64();
+      extent.length = reader.read64();
+      item.extents.push_back(extent);
+    }
+
+    (*items)[item.id] = std::move(item);
+  }
+
+  if (reader.error()) {
+    items->clear();
+
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_End_of_data,
+                 "Truncated index file");
+  }
+
+  return Error::Ok;
+}
+
+
+Error heif::read_index_file(const char* index_filename,
+                            const FileIdentity& file,
+                            heif_image_id* primary_image_ID,
+                            std::map<heif_image_id, HeifFile::Item>* items)
+{
+  int fd = open(index_filename, O_RDONLY);
+  if (fd < 0) {
+    return Error(heif_error_Input_does_not_exist,
+                 heif_suberror_Unspecified);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_End_of_data);
+  }
+
+  size_t size = (size_t)st.st_size;
+
+  void* mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mem == MAP_FAILED) {
+    return Error(heif_error_Input_does_not_exist,
+                 heif_suberror_Unspecified,
+                 "Cannot map index file");
+  }
+
+  Error err = parse_index(static_cast<const uint8_t*>(mem), size,
+                          file, primary_image_ID, items);
+
+  munmap(mem, size);
+
+  return err;
+}
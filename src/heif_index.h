@@ -0,0 +1,71 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_INDEX_H
+#define LIBHEIF_HEIF_INDEX_H
+
+#include <map>
+
+#include "error.h"
+#include "heif_cache.h"
+#include "heif_file.h"
+
+
+namespace heif {
+
+  // Compact binary index of a HEIF file, stored in a sidecar file next to it.
+  // It holds the item table of HeifFile (item types, references, properties,
+  // prebuilt hvcC headers and absolute data extents), so that a file can be
+  // opened again without parsing its 'meta' box.
+  //
+  // All numbers are big-endian:
+  //
+  //   header:  'hidx', u32 version,
+  //            u64 file size, i64 mtime seconds, i64 mtime nanoseconds,
+  //            u32 primary item ID, u32 number of items
+  //
+  //   item:    u32 ID, str type, u8 flags (see below),
+  //            u32 reference type, u32 number of references, u32 reference IDs[],
+  //            u32 ispe width, u32 ispe height,
+  //            u32 clap left, u32 clap top, u32 clap width, u32 clap height,
+  //            u32 rotation, u8 mirror axis (0xFF: none),
+  //            str aux type, str aux subtypes,
+  //            u8 NAL length size, str codec headers,
+  //            u32 colour primaries, u32 transfer characteristics, u32 matrix coefficients,
+  //            u8 full range, str ICC profile,
+  //            u32 number of extents, { u64 offset, u64 length }[]
+  //
+  // 'str' is a u32 length followed by the data bytes.
+  // The index is only used if size and modification time of the file match.
+
+  static const uint32_t kIndexFileVersion = 3;
+
+  Error write_index_file(const char* index_filename,
+                         const FileIdentity& file,
+                         const HeifFile& heif_file);
+
+  Error read_index_file(const char* index_filename,
+                        const FileIdentity& file,
+                        heif_image_id* primary_image_ID,
+                        std::map<heif_image_id, HeifFile::Item>* items);
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_limits.h"
+
+#include <sstream>
+
+
+using namespace heif;
+
+
+const heif_resource_limits& heif::get_default_resource_limits()
+{
+  static const heif_resource_limits limits = {
+    1,                       // version
+    0,                       // max_memory_bytes
+    (uint64_t)32768 * 32768, // max_image_pixels
+    0,                       // max_tiles, bounded by max_items
+    1024,                    // max_items
+    1024,                    // max_children_per_box
+    32,                      // max_extents_per_item
+    50 * 1024 * 1024         // max_item_data_size, 50 MB
+  };
+
+  return limits;
+}
+
+
+bool heif::have_same_file_limits(const heif_resource_limits& a, const heif_resource_limits& b)
+{
+  return (a.max_image_pixels == b.max_image_pixels &&
+          a.max_tiles == b.max_tiles &&
+          a.max_items == b.max_items &&
+          a.max_children_per_box == b.max_children_per_box &&
+          a.max_extents_per_item == b.max_extents_per_item &&
+          a.max_item_data_size == b.max_item_data_size);
+}
+
+
+Error heif::limit_exceeded_error(const char* what, uint64_t value, uint64_t limit)
+{
+  std::stringstream sstr;
+  sstr << what << " (" << value << ") exceeds the security limit of " << limit;
+
+  return Error(heif_error_Memory_allocation_error,
+               heif_suberror_Security_limit_exceeded,
+               sstr.str());
+}
+
+
+// Released buffers kept for reuse by default, enough for the output and intermediate
+// images of typical camera pictures.
+static const uint64_t DEFAULT_MAX_POOLED_BYTES = 64 * 1024 * 1024;
+
+
+MemoryAccount::MemoryAccount()
+  : m_buffer_pool(std::make_shared<BufferPool>(m_allocator, DEFAULT_MAX_POOLED_BYTES))
+{
+}
+
+
+void MemoryAccount::set_allocator(const std::shared_ptr<const Allocator>& allocator)
+{
+  m_allocator = allocator;
+  m_buffer_pool = std::make_shared<BufferPool>(allocator, m_buffer_pool->get_max_retained_bytes());
+}
+
+
+Error MemoryAccount::charge(uint64_t size, const char* what)
+{
+  uint64_t limit = m_limit;
+  uint64_t current = m_current;
+
+  do {
+    if (limit != 0 && (current > limit || size > limit - current)) {
+      m_rejected++;
+
+      std::stringstream sstr;
+      sstr << what << " of " << size << " bytes would exceed the memory limit of " << limit
+           << " bytes (" << current << " bytes in use)";
+
+      return Error(heif_error_Memory_allocation_error,
+                   heif_suberror_Security_limit_exceeded,
+                   sstr.str());
+    }
+  } while (!m_current.compare_exchange_weak(current, current + size));
+
+  uint64_t new_current = current + size;
+  uint64_t peak = m_peak;
+  while (new_current > peak && !m_peak.compare_exchange_weak(peak, new_current)) {
+  }
+
+  return Error::Ok;
+}
+
+
+Error MemoryCharge::charge(const std::shared_ptr<MemoryAccount>& account, uint64_t size,
+                           const char* what)
+{
+  release();
+
+  if (!account || size == 0) {
+    return Error::Ok;
+  }
+
+  Error err = account->charge(size, what);
+  if (err) {
+    return err;
+  }
+
+  m_account = account;
+  m_size = size;
+
+  return Error::Ok;
+}
+
+
+Error MemoryCharge::move_to(const std::shared_ptr<MemoryAccount>& account, const char* what)
+{
+  if (m_size == 0 || m_account == account) {
+    return Error::Ok;
+  }
+
+  if (account) {
+    Error err = account->charge(m_size, what);
+    if (err) {
+      return err;
+    }
+  }
+
+  uint64_t size = m_size;
+  release();
+
+  if (account) {
+    m_account = account;
+    m_size = size;
+  }
+
+  return Error::Ok;
+}
+
+
+void MemoryCharge::release()
+{
+  if (m_account) {
+    m_account->release(m_size);
+    m_account.reset();
+  }
+
+  m_size = 0;
+}
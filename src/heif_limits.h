@@ -0,0 +1,113 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_LIMITS_H
+#define LIBHEIF_HEIF_LIMITS_H
+
+#include "error.h"
+#include "heif.h"
+#include "heif_allocator.h"
+
+#include <atomic>
+#include <memory>
+
+
+namespace heif {
+
+  // Limits of a new context.
+  const heif_resource_limits& get_default_resource_limits();
+
+  // Whether a file parsed with limits 'a' may be used with limits 'b': all limits except
+  // the memory limit are the same.
+  bool have_same_file_limits(const heif_resource_limits& a, const heif_resource_limits& b);
+
+  // Error for a 'value' of 'what' exceeding 'limit'.
+  Error limit_exceeded_error(const char* what, uint64_t value, uint64_t limit);
+
+
+  // Bytes held by one context, counted across threads, and the allocator their buffers
+  // come from. Charges exceeding the limit fail without being counted.
+  class MemoryAccount {
+  public:
+    MemoryAccount();
+
+    // Only changed before any buffer is allocated for the context.
+    void set_allocator(const std::shared_ptr<const Allocator>& allocator);
+
+    const std::shared_ptr<const Allocator>& get_allocator() const { return m_allocator; }
+
+    // Pool of the buffers of decoded images and compressed data, taken from the allocator.
+    // Buffers kept in the pool for reuse are not charged to the account.
+    const std::shared_ptr<BufferPool>& get_buffer_pool() const { return m_buffer_pool; }
+
+    void set_limit(uint64_t max_bytes) { m_limit = max_bytes; }
+
+    Error charge(uint64_t size, const char* what);
+
+    void release(uint64_t size) { m_current -= size; }
+
+    uint64_t get_current() const { return m_current; }
+    uint64_t get_peak() const { return m_peak; }
+    uint64_t get_rejected() const { return m_rejected; }
+
+    void reset_peak() { m_peak = m_current.load(); }
+
+  private:
+    std::shared_ptr<const Allocator> m_allocator = Allocator::get_default();
+    std::shared_ptr<BufferPool> m_buffer_pool;
+
+    std::atomic<uint64_t> m_limit{0};
+    std::atomic<uint64_t> m_current{0};
+    std::atomic<uint64_t> m_peak{0};
+    std::atomic<uint64_t> m_rejected{0};
+  };
+
+
+  // Bytes charged to a MemoryAccount for the lifetime of a buffer. They are released when
+  // the charge is destroyed, the account is kept alive until then.
+  class MemoryCharge {
+  public:
+    MemoryCharge() = default;
+    ~MemoryCharge() { release(); }
+
+    MemoryCharge(const MemoryCharge&) = delete;
+    MemoryCharge& operator=(const MemoryCharge&) = delete;
+
+    // Replace the current charge. Nothing is charged if 'account' is null.
+    Error charge(const std::shared_ptr<MemoryAccount>& account, uint64_t size, const char* what);
+
+    void release();
+
+    // Move the charged bytes to 'account', e.g. when another owner takes over the buffer.
+    // The current charge is kept if 'account' rejects them.
+    Error move_to(const std::shared_ptr<MemoryAccount>& account, const char* what);
+
+    uint64_t get_size() const { return m_size; }
+
+    const MemoryAccount* get_account() const { return m_account.get(); }
+
+  private:
+    std::shared_ptr<MemoryAccount> m_account;
+    uint64_t m_size = 0;
+  };
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_PLUGIN_H
+#define LIBHEIF_HEIF_PLUGIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "heif.h"
+
+
+// ====================================================================================================
+//  Decoder plugin API
+//
+//  A decoder plugin decodes the compressed data of image items of one or more compression
+//  formats. Plugins are registered with heif_register_decoder_plugin(). The compressed data
+//  of an image (or of all tiles of a grid image, in decoding order) is pushed to a decoder
+//  instance and the decoded pictures are then fetched one after another.
+// ====================================================================================================
+
+// Version of the interface described by this file.
+#define LIBHEIF_DECODER_PLUGIN_API_VERSION 2
+
+
+// Optional allocator for the frame buffers of a decoder.
+struct heif_decoder_allocator
+{
+  // Allocate 'size' bytes, aligned to 'alignment' bytes (a power of two). Returns NULL on failure.
+  void* (*alloc)(void* user_data, size_t size, size_t alignment);
+
+  void (*free)(void* user_data, void* ptr);
+
+  void* user_data;
+};
+
+
+// A decoded picture. The planes belong to the decoder.
+struct heif_decoded_picture
+{
+  int width;
+  int height;
+
+  enum heif_chroma chroma;  // heif_chroma_monochrome, heif_chroma_420, _422 or _444
+
+  int bits_per_pixel;
+
+  // Y, Cb, Cr (only Y for monochrome images)
+  const uint8_t* planes[3];
+  int strides[3];
+};
+
+
+struct heif_decoder_plugin
+{
+  // LIBHEIF_DECODER_PLUGIN_API_VERSION, or an older version. Fields of newer versions are not used then.
+  int plugin_api_version;
+
+  // version 1
+
+  // Human-readable name of the plugin, e.g. to select a decoder in a benchmark.
+  const char* (*get_plugin_name)(void);
+
+  // Return the priority with which the plugin decodes the compression format, or 0 if it
+  // cannot decode it. The registered plugin with the highest priority is used by default.
+  int (*does_support_format)(enum heif_compression_format format);
+
+  // Create a decoder instance. 'allocator' may be NULL to use the decoder's own frame buffers.
+  // A plugin may also ignore the allocator.
+  struct heif_error (*new_decoder)(void** decoder, const struct heif_decoder_allocator* allocator);
+
+  void (*free_decoder)(void* decoder);
+
+  // Push compressed data. For HEVC, this is a sequence of NAL units, each prefixed with its size
+  // in 'nal_length_size' bytes, starting with the parameter sets from the 'hvcC' box.
+  // The data is not referenced after the call returns.
+  struct heif_error (*push_data)(void* decoder, const uint8_t* data, size_t size,
+                                 int nal_length_size);
+
+  // All data has been pushed. Decode the remaining pictures.
+  struct heif_error (*flush_data)(void* decoder);
+
+  // Get the next decoded picture in decoding order, or set '*out_has_picture' to 0 if there are
+  // no more pictures. The picture stays valid until the next call of get_next_picture() or
+  // free_decoder().
+  struct heif_error (*get_next_picture)(void* decoder, struct heif_decoded_picture* out_picture,
+                                        int* out_has_picture);
+
+  // version 2
+
+  // Decode at 1/denominator of the coded size (2, 4 or 8). Called before any data is pushed.
+  // May be NULL if the plugin cannot decode at a reduced size. Images are then decoded
+  // at their full size.
+  struct heif_error (*set_scaling)(void* decoder, int denominator);
+};
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LIBHEIF_HEIF_PLUGIN_H
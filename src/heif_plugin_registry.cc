@@ -0,0 +1,221 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_plugin_registry.h"
+#include "libde265_dec_api.h"
+#include "libjpeg_dec_api.h"
+
+#include <algorithm>
+#include <mutex>
+
+
+using namespace heif;
+
+
+namespace {
+
+  struct DecoderRegistry {
+    std::mutex mutex;
+    std::vector<const heif_decoder_plugin*> plugins;  // in registration order
+
+    DecoderRegistry() {
+      plugins.push_back(get_decoder_plugin_libde265());
+      plugins.push_back(get_decoder_plugin_libjpeg());
+    }
+  };
+
+  DecoderRegistry& get_registry()
+  {
+    static DecoderRegistry registry;
+    return registry;
+  }
+
+}
+
+
+static Error plugin_error(const heif_error& err)
+{
+  if (err.code == heif_error_Ok) {
+    return Error::Ok;
+  }
+
+  return Error(err.code, err.subcode, err.message ? err.message : "");
+}
+
+
+Error heif::register_decoder(const heif_decoder_plugin* plugin)
+{
+  if (plugin == nullptr) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Null_pointer_argument);
+  }
+
+  if (plugin->plugin_api_version < 1 ||
+      plugin->plugin_api_version > LIBHEIF_DECODER_PLUGIN_API_VERSION) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unsupported_plugin_version);
+  }
+
+  DecoderRegistry& registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  if (std::find(registry.plugins.begin(), registry.plugins.end(), plugin) == registry.plugins.end()) {
+    registry.plugins.push_back(plugin);
+  }
+
+  return Error::Ok;
+}
+
+
+std::vector<const heif_decoder_plugin*> heif::get_decoders(heif_compression_format format)
+{
+  std::vector<std::pair<int, const heif_decoder_plugin*> > candidates;
+
+  {
+    DecoderRegistry& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    // the most recently registered plugin wins among plugins with the same priority
+    for (auto it = registry.plugins.rbegin(); it != registry.plugins.rend(); ++it) {
+      int priority = (*it)->does_support_format(format);
+      if (priority > 0) {
+        candidates.push_back(std::make_pair(priority, *it));
+      }
+    }
+  }
+
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const std::pair<int, const heif_decoder_plugin*>& a,
+                      const std::pair<int, const heif_decoder_plugin*>& b) {
+                     return a.first > b.first;
+                   });
+
+  std::vector<const heif_decoder_plugin*> decoders;
+  for (const auto& candidate : candidates) {
+    decoders.push_back(candidate.second);
+  }
+
+  return decoders;
+}
+
+
+const heif_decoder_plugin* heif::get_decoder(heif_compression_format format)
+{
+  std::vector<const heif_decoder_plugin*> decoders = get_decoders(format);
+  return decoders.empty() ? nullptr : decoders[0];
+}
+
+
+static Error get_picture_view(const heif_decoded_picture& picture, HeifPixelImage* view)
+{
+  switch (picture.chroma) {
+  case heif_chroma_monochrome:
+  case heif_chroma_420:
+  case heif_chroma_422:
+  case heif_chroma_444:
+    break;
+  default:
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_color_conversion,
+                 "Unknown chroma format of decoded image");
+  }
+
+  if (picture.bits_per_pixel != 8) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_data_version,
+                 "Only images with 8 bits per sample are supported");
+  }
+
+  uint8_t* planes[3] = { nullptr, nullptr, nullptr };
+  int strides[3] = { 0, 0, 0 };
+
+  for (int c=0;c<HeifPixelImage::get_number_of_planes(picture.chroma);c++) {
+    planes[c] = const_cast<uint8_t*>(picture.planes[c]);
+    strides[c] = picture.strides[c];
+  }
+
+  view->wrap_planes(picture.width, picture.height, picture.chroma, planes, strides);
+
+  return Error::Ok;
+}
+
+
+Error heif::decode_stream(const heif_decoder_plugin* plugin,
+                          const uint8_t* data, size_t size, int nal_length_size,
+                          int scale_denominator,
+                          const std::shared_ptr<MemoryAccount>& account,
+                          const PictureCallback& on_picture)
+{
+  // frame buffers from the context's allocator, if it has its own
+  heif_decoder_allocator frame_allocator;
+  const heif_decoder_allocator* frame_allocator_ptr = nullptr;
+  if (account && !account->get_allocator()->is_default()) {
+    frame_allocator = account->get_allocator()->get_decoder_allocator();
+    frame_allocator_ptr = &frame_allocator;
+  }
+
+  void* decoder = nullptr;
+  Error result = plugin_error(plugin->new_decoder(&decoder, frame_allocator_ptr));
+  if (result) {
+    return result;
+  }
+
+  if (scale_denominator > 1 && plugin->plugin_api_version >= 2 && plugin->set_scaling) {
+    result = plugin_error(plugin->set_scaling(decoder, scale_denominator));
+  }
+
+  if (!result) {
+    result = plugin_error(plugin->push_data(decoder, data, size, nal_length_size));
+  }
+
+  if (!result) {
+    result = plugin_error(plugin->flush_data(decoder));
+  }
+
+  while (!result) {
+    heif_decoded_picture picture;
+    int has_picture = 0;
+    result = plugin_error(plugin->get_next_picture(decoder, &picture, &has_picture));
+    if (result || !has_picture) {
+      break;
+    }
+
+    HeifPixelImage view;
+    result = get_picture_view(picture, &view);
+    if (result) {
+      break;
+    }
+
+    uint64_t frame_size = 0;
+    for (int c = 0; c < view.get_number_of_planes(); c++) {
+      frame_size += (uint64_t)picture.strides[c] * view.get_plane_height(c);
+    }
+
+    MemoryCharge frame_charge;
+    result = frame_charge.charge(account, frame_size, "Decoder frame");
+    if (!result) {
+      result = on_picture(view);
+    }
+  }
+
+  plugin->free_decoder(decoder);
+
+  return result;
+}
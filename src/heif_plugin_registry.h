@@ -0,0 +1,77 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_PLUGIN_REGISTRY_H
+#define LIBHEIF_HEIF_PLUGIN_REGISTRY_H
+
+#include <vector>
+
+#include "error.h"
+#include "heif_image.h"
+#include "heif_limits.h"
+#include "heif_plugin.h"
+
+
+namespace heif {
+
+  Error register_decoder(const heif_decoder_plugin* plugin);
+
+  // All registered plugins that decode 'format', highest priority first.
+  std::vector<const heif_decoder_plugin*> get_decoders(heif_compression_format format);
+
+  // The plugin with the highest priority for 'format', or nullptr.
+  const heif_decoder_plugin* get_decoder(heif_compression_format format);
+
+
+  // Reference to a callable taking a decoded picture. Unlike std::function, it never
+  // allocates. The callable has to exist as long as the reference is used.
+  class PictureCallback {
+  public:
+    template <class F> PictureCallback(const F& callable)
+      : m_callable(&callable), m_call(&call<F>) {}
+
+    Error operator()(const HeifPixelImage& picture) const { return m_call(m_callable, picture); }
+
+  private:
+    template <class F> static Error call(const void* callable, const HeifPixelImage& picture)
+    {
+      return (*static_cast<const F*>(callable))(picture);
+    }
+
+    const void* m_callable;
+    Error (*m_call)(const void* callable, const HeifPixelImage& picture);
+  };
+
+
+  // Decode a stream of compressed data with a new instance of 'plugin'.
+  // 'on_picture' is called for every decoded picture in decoding order. The image passed
+  // to it references the decoder's frame buffer and is only valid during the call.
+  // With a 'scale_denominator' > 1, the pictures are decoded at a reduced size if the
+  // plugin supports it. Each frame is charged to 'account' (may be null) while it is
+  // passed to 'on_picture'.
+  Error decode_stream(const heif_decoder_plugin* plugin,
+                      const uint8_t* data, size_t size, int nal_length_size,
+                      int scale_denominator,
+                      const std::shared_ptr<MemoryAccount>& account,
+                      const PictureCallback& on_picture);
+
+}
+
+#endif
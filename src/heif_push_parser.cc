@@ -0,0 +1,378 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_push_parser.h"
+#include "box.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <sstream>
+#include <string.h>
+
+
+using namespace heif;
+
+
+// Small chunks are collected into blocks of at least this size.
+static const size_t MIN_BLOCK_SIZE = 256*1024;
+
+
+// --- PushInput
+
+std::map<uint64_t, PushInput::Block>::const_iterator PushInput::find_block(uint64_t offset) const
+{
+  auto iter = m_blocks.upper_bound(offset);
+  if (iter == m_blocks.begin()) {
+    return m_blocks.end();
+  }
+
+  --iter;
+  if (offset - iter->first >= iter->second.size) {
+    return m_blocks.end();
+  }
+
+  return iter;
+}
+
+
+uint64_t PushInput::available_length(uint64_t offset, uint64_t length) const
+{
+  uint64_t available = 0;
+
+  // blocks may adjoin each other
+  while (available < length) {
+    auto iter = find_block(offset + available);
+    if (iter == m_blocks.end()) {
+      break;
+    }
+
+    available += iter->first + iter->second.size - (offset + available);
+  }
+
+  return std::min(available, length);
+}
+
+
+void PushInput::add(uint64_t offset, const uint8_t* data, size_t size)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    while (size > 0) {
+      // skip data that has been received before
+      uint64_t known = available_length(offset, size);
+      offset += known;
+      data += known;
+      size -= (size_t)known;
+      if (size == 0) {
+        break;
+      }
+
+      // the new part ends where the next block starts
+      size_t n = size;
+      auto next = m_blocks.upper_bound(offset);
+      if (next != m_blocks.end() && next->first - offset < n) {
+        n = (size_t)(next->first - offset);
+      }
+
+      // continue the previous block if it ends here, otherwise start a new one
+      auto prev = m_blocks.upper_bound(offset);
+      Block* block = nullptr;
+      if (prev != m_blocks.begin()) {
+        --prev;
+        if (prev->first + prev->second.size == offset &&
+            prev->second.size < prev->second.capacity) {
+          block = &prev->second;
+        }
+      }
+
+      if (block) {
+        n = std::min(n, block->capacity - block->size);
+      }
+      else {
+        Block new_block;
+        new_block.capacity = std::max(n, MIN_BLOCK_SIZE);
+        new_block.data.reset(new uint8_t[new_block.capacity]);
+        new_block.size = 0;
+
+        block = &(m_blocks[offset] = std::move(new_block));
+      }
+
+      memcpy(block->data.get() + block->size, data, n);
+      block->size += n;
+
+      offset += n;
+      data += n;
+      size -= n;
+
+      m_received_end = std::max(m_received_end, offset);
+    }
+  }
+
+  m_data_arrived.notify_all();
+}
+
+
+void PushInput::set_end_of_data()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_end_of_data = true;
+  }
+
+  m_data_arrived.notify_all();
+}
+
+
+bool PushInput::is_end_of_data() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_end_of_data;
+}
+
+
+uint64_t PushInput::get_received_end() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_received_end;
+}
+
+
+bool PushInput::is_available(uint64_t offset, uint64_t length) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return available_length(offset, length) == length;
+}
+
+
+bool PushInput::wait_for_range(uint64_t offset, uint64_t length) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  for (;;) {
+    if (available_length(offset, length) == length) {
+      return true;
+    }
+
+    if (m_end_of_data) {
+      return false;
+    }
+
+    m_data_arrived.wait(lock);
+  }
+}
+
+
+size_t PushInput::copy_available(uint64_t offset, size_t length, uint8_t* dest) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  size_t copied = 0;
+  while (copied < length) {
+    auto iter = find_block(offset);
+    if (iter == m_blocks.end()) {
+      break;
+    }
+
+    size_t start = (size_t)(offset - iter->first);
+    size_t n = std::min(length - copied, iter->second.size - start);
+
+    memcpy(dest + copied, iter->second.data.get() + start, n);
+    copied += n;
+    offset += n;
+  }
+
+  return copied;
+}
+
+
+void PushInput::copy_range(uint64_t offset, uint64_t length, uint8_t* dest) const
+{
+  size_t copied = copy_available(offset, (size_t)length, dest);
+  assert(copied == length);
+  (void)copied;
+}
+
+
+bool PushInput::get_span(uint64_t offset, uint64_t length, const uint8_t** out_data) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto iter = find_block(offset);
+  if (iter == m_blocks.end() || offset - iter->first + length > iter->second.size) {
+    return false;
+  }
+
+  *out_data = iter->second.data.get() + (offset - iter->first);
+  return true;
+}
+
+
+void PushInput::get_missing_ranges(uint64_t offset, uint64_t length,
+                                   std::vector<heif_byte_range>* ranges) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  uint64_t end = offset + length;
+  while (offset < end) {
+    offset += available_length(offset, end - offset);
+    if (offset == end) {
+      break;
+    }
+
+    // missing up to the next block
+    uint64_t missing_end = end;
+    auto next = m_blocks.upper_bound(offset);
+    if (next != m_blocks.end() && next->first < end) {
+      missing_end = next->first;
+    }
+
+    ranges->push_back(heif_byte_range{offset, missing_end - offset});
+    offset = missing_end;
+  }
+}
+
+
+// --- HeifPushParser
+
+HeifPushParser::HeifPushParser()
+  : m_input(std::make_shared<PushInput>())
+{
+}
+
+
+HeifPushParser::~HeifPushParser()
+{
+  // Files reading from the input may outlive the parser, they must not wait for more data.
+  m_input->set_end_of_data();
+}
+
+
+Error HeifPushParser::push_data(const uint8_t* data, size_t size)
+{
+  return push_data_at(m_push_pos, data, size);
+}
+
+
+Error HeifPushParser::push_data_at(uint64_t offset, const uint8_t* data, size_t size)
+{
+  if (m_input->is_end_of_data()) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "Data pushed after the end of the data");
+  }
+
+  m_input->add(offset, data, size);
+  m_push_pos = offset + size;
+
+  return scan_box_headers();
+}
+
+
+bool HeifPushParser::has_ftyp() const
+{
+  return m_ftyp_end != 0 && m_input->is_available(m_ftyp_pos, m_ftyp_end - m_ftyp_pos);
+}
+
+
+bool HeifPushParser::has_meta() const
+{
+  return m_meta_end != 0 && m_input->is_available(m_meta_pos, m_meta_end - m_meta_pos);
+}
+
+
+Error HeifPushParser::scan_box_headers()
+{
+  // --- walk over the top-level box headers that have arrived
+
+  while (m_meta_end == 0) {
+    if (!m_input->is_available(m_next_box_pos, 8)) {
+      break;
+    }
+
+    uint8_t header[16];
+    m_input->copy_range(m_next_box_pos, 8, header);
+
+    uint64_t box_size = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) |
+                        ((uint32_t)header[2] << 8) | header[3];
+    uint32_t type = ((uint32_t)header[4] << 24) | ((uint32_t)header[5] << 16) |
+                    ((uint32_t)header[6] << 8) | header[7];
+    uint64_t header_size = 8;
+
+    if (box_size == 1) {
+      if (!m_input->is_available(m_next_box_pos, 16)) {
+        break;
+      }
+
+      m_input->copy_range(m_next_box_pos + 8, 8, header + 8);
+
+      box_size = 0;
+      for (int i=8;i<16;i++) {
+        box_size = (box_size << 8) | header[i];
+      }
+
+      header_size = 16;
+    }
+
+    if (box_size == BoxHeader::size_until_end_of_file) {
+      // The box extends to the end of the file, there is nothing after it.
+      // A 'meta' box of unknown size cannot be parsed before all data has arrived.
+      break;
+    }
+
+    if (box_size < header_size || m_next_box_pos + box_size < m_next_box_pos) {
+      std::stringstream sstr;
+      sstr << "Invalid size of top-level box at file position " << m_next_box_pos;
+
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_Invalid_box_size,
+                   sstr.str());
+    }
+
+    if (type == fourcc("ftyp") && m_ftyp_end == 0) {
+      m_ftyp_pos = m_next_box_pos;
+      m_ftyp_end = m_next_box_pos + box_size;
+    }
+    else if (type == fourcc("meta")) {
+      m_meta_pos = m_next_box_pos;
+      m_meta_end = m_next_box_pos + box_size;
+    }
+
+    m_next_box_pos += box_size;
+  }
+
+  return Error::Ok;
+}
+
+
+void HeifPushParser::get_fetch_ranges(std::vector<heif_byte_range>* ranges) const
+{
+  if (m_ftyp_end != 0) {
+    m_input->get_missing_ranges(m_ftyp_pos, m_ftyp_end - m_ftyp_pos, ranges);
+  }
+
+  if (m_meta_end != 0) {
+    m_input->get_missing_ranges(m_meta_pos, m_meta_end - m_meta_pos, ranges);
+  }
+  else {
+    // The header of the next box: 8 bytes, or 16 with a 64 bit size.
+    m_input->get_missing_ranges(m_next_box_pos, 16, ranges);
+  }
+}
@@ -0,0 +1,153 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_PUSH_PARSER_H
+#define LIBHEIF_HEIF_PUSH_PARSER_H
+
+#include "error.h"
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace heif {
+
+  // Input of a file that arrives in chunks, in order or as separately fetched byte ranges.
+  // It is shared between the HeifPushParser that receives the data and the HeifFile reading
+  // from it, possibly from other threads. Received data is never moved, so it can be
+  // referenced without a copy.
+  class PushInput {
+  public:
+    // Store data at file position 'offset'. Parts that have been received before are ignored.
+    void add(uint64_t offset, const uint8_t* data, size_t size);
+
+    // No more data will arrive. Wakes up all readers waiting for data.
+    void set_end_of_data();
+
+    bool is_end_of_data() const;
+
+    // End of the received data with the highest file position.
+    uint64_t get_received_end() const;
+
+    bool is_available(uint64_t offset, uint64_t length) const;
+
+    // Wait until the range has been received. Returns false if the data ended before.
+    bool wait_for_range(uint64_t offset, uint64_t length) const;
+
+    // Copy a range that has been received.
+    void copy_range(uint64_t offset, uint64_t length, uint8_t* dest) const;
+
+    // Copy the received data starting at 'offset', up to 'length' bytes, and stop at the first
+    // missing byte. Returns the number of bytes copied.
+    size_t copy_available(uint64_t offset, size_t length, uint8_t* dest) const;
+
+    // Reference a received range without a copy. Only possible if it was stored in one block.
+    bool get_span(uint64_t offset, uint64_t length, const uint8_t** out_data) const;
+
+    // Append the parts of the range that have not been received yet to 'ranges'.
+    void get_missing_ranges(uint64_t offset, uint64_t length,
+                            std::vector<heif_byte_range>* ranges) const;
+
+  private:
+    struct Block {
+      std::unique_ptr<uint8_t[]> data;
+      size_t size;        // bytes received into this block
+      size_t capacity;
+    };
+
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_data_arrived;
+
+    // blocks by file position, they do not overlap
+    std::map<uint64_t, Block> m_blocks;
+    uint64_t m_received_end = 0;
+    bool m_end_of_data = false;
+
+    // the following are called with m_mutex held
+
+    // Block containing file position 'offset', or m_blocks.end().
+    std::map<uint64_t, Block>::const_iterator find_block(uint64_t offset) const;
+
+    // Number of received bytes starting at 'offset', counting at most up to 'length'.
+    uint64_t available_length(uint64_t offset, uint64_t length) const;
+  };
+
+
+  // Receives a file in chunks, as they are downloaded, and tracks which of its top-level
+  // boxes are complete. As soon as 'ftyp' and 'meta' have arrived, a HeifContext can read
+  // the file from get_input(). It can decode images while the rest of the data is still
+  // arriving: reads of missing data wait until it is pushed or set_end_of_data() is called.
+  //
+  // The data does not have to arrive in order. With byte range requests, the ranges from
+  // get_fetch_ranges() lead to the 'meta' box without reading the data in between.
+  class HeifPushParser : public ErrorBuffer {
+  public:
+    HeifPushParser();
+    ~HeifPushParser();
+
+    HeifPushParser(const HeifPushParser&) = delete;
+    HeifPushParser& operator=(const HeifPushParser&) = delete;
+
+    // Append data after the previously pushed chunk.
+    Error push_data(const uint8_t* data, size_t size);
+
+    // Add data from file position 'offset'.
+    Error push_data_at(uint64_t offset, const uint8_t* data, size_t size);
+
+    void set_end_of_data() { m_input->set_end_of_data(); }
+
+    bool has_ftyp() const;
+
+    bool has_meta() const;
+
+    // Size of the file up to the end of the 'meta' box.
+    uint64_t get_meta_end() const { return m_meta_end; }
+
+    // Byte ranges that are needed next to complete 'ftyp' and 'meta': the rest of these boxes
+    // if their headers have been seen, otherwise the next top-level box header. Empty when
+    // both boxes are complete.
+    void get_fetch_ranges(std::vector<heif_byte_range>* ranges) const;
+
+    const std::shared_ptr<PushInput>& get_input() const { return m_input; }
+
+  private:
+    std::shared_ptr<PushInput> m_input;
+
+    // file position after the data of the last push_data()
+    uint64_t m_push_pos = 0;
+
+    // position of the next top-level box header to look at
+    uint64_t m_next_box_pos = 0;
+
+    // positions of the boxes, the ends are 0 while unknown
+    uint64_t m_ftyp_pos = 0;
+    uint64_t m_ftyp_end = 0;
+    uint64_t m_meta_pos = 0;
+    uint64_t m_meta_end = 0;
+
+    Error scan_box_headers();
+  };
+
+}
+
+#endif
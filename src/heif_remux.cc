@@ -0,0 +1,559 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_remux.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <stdio.h>
+#include <unistd.h>
+
+
+using namespace heif;
+
+
+// Data is copied between the files in blocks of this size.
+static const uint64_t COPY_BLOCK_SIZE = 1024*1024;
+
+
+namespace {
+
+  class BoxWriter
+  {
+  public:
+    void write16(uint16_t v) {
+      m_data.push_back((uint8_t)(v >> 8));
+      m_data.push_back((uint8_t)(v & 0xFF));
+    }
+
+    void write32(uint32_t v) {
+      for (int shift=24; shift>=0; shift-=8) {
+        m_data.push_back((uint8_t)(v >> shift));
+      }
+    }
+
+    void write64(uint64_t v) {
+      write32((uint32_t)(v >> 32));
+      write32((uint32_t)(v & 0xFFFFFFFF));
+    }
+
+    // write 'v' with 0, 4 or 8 bytes
+    void write_sized(uint64_t v, int size) {
+      if (size==4) {
+        write32((uint32_t)v);
+      }
+      else if (size==8) {
+        write64(v);
+      }
+    }
+
+    // Box header with a 32 bit or, if required, a 64 bit size field.
+    void write_box_header(uint32_t type, uint64_t box_size_without_header) {
+      if (box_size_without_header + 8 <= 0xFFFFFFFF) {
+        write32((uint32_t)(box_size_without_header + 8));
+        write32(type);
+      }
+      else {
+        write32(1);
+        write32(type);
+        write64(box_size_without_header + 16);
+      }
+    }
+
+    void patch32(size_t pos, uint32_t v) {
+      for (int i=0;i<4;i++) {
+        m_data[pos+i] = (uint8_t)(v >> (24-8*i));
+      }
+    }
+
+    size_t size() const { return m_data.size(); }
+
+    const std::vector<uint8_t>& get_data() const { return m_data; }
+
+  private:
+    std::vector<uint8_t> m_data;
+  };
+
+
+  struct BoxPosition {
+    std::shared_ptr<Box> box;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+
+  // A range of the input that is copied into the new 'mdat'.
+  struct Chunk {
+    uint64_t input_offset;
+    uint64_t length;
+  };
+
+
+  int required_size(uint64_t max_value)
+  {
+    return (max_value > 0xFFFFFFFF) ? 8 : 4;
+  }
+
+}
+
+
+static std::vector<uint8_t> write_iloc(const Box_iloc& iloc,
+                                       const std::vector<Box_iloc::Item>& items)
+{
+  uint64_t max_offset = 0;
+  uint64_t max_length = 0;
+  uint64_t max_base_offset = 0;
+  uint64_t max_index = 0;
+  bool need_construction_method = false;
+  bool need_32bit_IDs = (items.size() > 0xFFFF);
+
+  for (const auto& item : items) {
+    need_32bit_IDs |= (item.item_ID > 0xFFFF);
+    need_construction_method |= (item.construction_method != 0);
+    max_base_offset = std::max(max_base_offset, item.base_offset);
+
+    for (const auto& extent : item.extents) {
+      max_offset = std::max(max_offset, extent.offset);
+      max_length = std::max(max_length, extent.length);
+      max_index = std::max(max_index, extent.index);
+    }
+  }
+
+  int offset_size = required_size(max_offset);
+  int length_size = required_size(max_length);
+  int base_offset_size = (max_base_offset == 0) ? 0 : required_size(max_base_offset);
+  int index_size = (max_index == 0) ? 0 : required_size(max_index);
+
+  // Keep the input version unless a field requires a newer one.
+  uint8_t version = iloc.get_version();
+  if (need_construction_method && version < 1) {
+    version = 1;
+  }
+  if (need_32bit_IDs || index_size > 0) {
+    version = 2;
+  }
+
+  BoxWriter writer;
+  writer.write32(0); // size, patched below
+  writer.write32(fourcc("iloc"));
+  writer.write32(((uint32_t)version << 24) | iloc.get_flags());
+
+  writer.write16((uint16_t)((offset_size << 12) | (length_size << 8) | (base_offset_size << 4) |
+                            (version > 1 ? index_size : 0)));
+
+  if (version < 2) {
+    writer.write16((uint16_t)items.size());
+  }
+  else {
+    writer.write32((uint32_t)items.size());
+  }
+
+  for (const auto& item : items) {
+    if (version < 2) {
+      writer.write16((uint16_t)item.item_ID);
+    }
+    else {
+      writer.write32(item.item_ID);
+    }
+
+    if (version >= 1) {
+      writer.write16(item.construction_method);
+    }
+
+    writer.write16(item.data_reference_index);
+    writer.write_sized(item.base_offset, base_offset_size);
+
+    writer.write16((uint16_t)item.extents.size());
+    for (const auto& extent : item.extents) {
+      if (version > 1) {
+        writer.write_sized(extent.index, index_size);
+      }
+
+      writer.write_sized(extent.offset, offset_size);
+      writer.write_sized(extent.length, length_size);
+    }
+  }
+
+  writer.patch32(0, (uint32_t)writer.size());
+
+  return writer.get_data();
+}
+
+
+static bool item_is_relocated(const Box_iloc::Item& item)
+{
+  return item.construction_method == 0 && item.data_reference_index == 0;
+}
+
+
+// Order in which the data of the items is stored in the output.
+static std::vector<heif_image_id> get_item_order(const HeifFile& file,
+                                                 const std::vector<Box_iloc::Item>& iloc_items,
+                                                 bool decoding_order)
+{
+  // --- all items, in the order of their data in the input
+
+  std::vector<const Box_iloc::Item*> by_position;
+  for (const auto& item : iloc_items) {
+    by_position.push_back(&item);
+  }
+
+  auto first_offset = [](const Box_iloc::Item* item) {
+    return item->extents.empty() ? 0 : item->base_offset + item->extents[0].offset;
+  };
+
+  std::stable_sort(by_position.begin(), by_position.end(),
+                   [&](const Box_iloc::Item* a, const Box_iloc::Item* b) {
+                     return first_offset(a) < first_offset(b);
+                   });
+
+
+  std::vector<heif_image_id> order;
+  std::set<heif_image_id> added;
+
+  if (decoding_order) {
+    // an image, followed by the images it is derived from ('dimg': grid tiles, overlay inputs)
+    std::function<void(heif_image_id)> add_image = [&](heif_image_id ID) {
+      if (!added.insert(ID).second) {
+        return;
+      }
+
+      order.push_back(ID);
+
+      const HeifFile::Item* item = file.get_item(ID);
+      if (item && item->reference_type == fourcc("dimg")) {
+        for (heif_image_id ref : item->references) {
+          add_image(ref);
+        }
+      }
+    };
+
+    heif_image_id primary_ID = file.get_primary_image_ID();
+
+    auto add_referencing_primary = [&](uint32_t reference_type) {
+      for (const auto& pair : file.get_items()) {
+        const HeifFile::Item& item = pair.second;
+        if (item.reference_type == reference_type &&
+            std::find(item.references.begin(), item.references.end(), primary_ID) != item.references.end()) {
+          add_image(item.id);
+        }
+      }
+    };
+
+    add_referencing_primary(fourcc("thmb"));
+    add_image(primary_ID);
+    add_referencing_primary(fourcc("auxl"));
+    add_referencing_primary(fourcc("cdsc"));
+  }
+
+  for (const Box_iloc::Item* item : by_position) {
+    if (added.insert(item->item_ID).second) {
+      order.push_back(item->item_ID);
+    }
+  }
+
+  return order;
+}
+
+
+static Error copy_input_range(const HeifFile& file, uint64_t offset, uint64_t length, FILE* out)
+{
+  std::vector<uint8_t> buffer;
+
+  uint64_t block_size = COPY_BLOCK_SIZE;
+  uint64_t max_size = file.get_limits().max_item_data_size;
+  if (max_size && max_size < block_size) {
+    block_size = max_size;
+  }
+
+  while (length > 0) {
+    uint64_t n = std::min(length, block_size);
+
+    Error err = file.read_input_range(offset, n, &buffer);
+    if (err) {
+      return err;
+    }
+
+    if (fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size()) {
+      return Error(heif_error_Encoding_error,
+                   heif_suberror_Cannot_write_output_data);
+    }
+
+    offset += n;
+    length -= n;
+  }
+
+  return Error::Ok;
+}
+
+
+static Error write_output(const HeifFile& file,
+                          const std::shared_ptr<Box_iloc>& iloc_box,
+                          const BoxPosition& ftyp,
+                          const BoxPosition& meta,
+                          const std::vector<BoxPosition>& meta_children,
+                          const std::vector<BoxPosition>& other_boxes,
+                          const std::vector<uint8_t>& meta_header,
+                          const std::vector<uint8_t>& iloc_data,
+                          const std::vector<uint8_t>& mdat_header,
+                          const std::vector<Chunk>& chunks,
+                          FILE* out)
+{
+  Error err = copy_input_range(file, ftyp.offset, ftyp.size, out);
+  if (err) {
+    return err;
+  }
+
+  if (fwrite(meta_header.data(), 1, meta_header.size(), out) != meta_header.size()) {
+    return Error(heif_error_Encoding_error,
+                 heif_suberror_Cannot_write_output_data);
+  }
+
+  for (const auto& child : meta_children) {
+    if (child.box == iloc_box) {
+      if (fwrite(iloc_data.data(), 1, iloc_data.size(), out) != iloc_data.size()) {
+        return Error(heif_error_Encoding_error,
+                     heif_suberror_Cannot_write_output_data);
+      }
+    }
+    else {
+      err = copy_input_range(file, child.offset, child.size, out);
+      if (err) {
+        return err;
+      }
+    }
+  }
+
+  for (const auto& box : other_boxes) {
+    err = copy_input_range(file, box.offset, box.size, out);
+    if (err) {
+      return err;
+    }
+  }
+
+  if (fwrite(mdat_header.data(), 1, mdat_header.size(), out) != mdat_header.size()) {
+    return Error(heif_error_Encoding_error,
+                 heif_suberror_Cannot_write_output_data);
+  }
+
+  for (const auto& chunk : chunks) {
+    err = copy_input_range(file, chunk.input_offset, chunk.length, out);
+    if (err) {
+      return err;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Error heif::write_fast_start_file(const HeifFile& file, const char* output_filename,
+                                  bool decoding_order)
+{
+  std::shared_ptr<Box_meta> meta_box = file.get_meta_box();
+  std::shared_ptr<Box_iloc> iloc_box = file.get_iloc_box();
+  if (!meta_box || !iloc_box) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Unspecified,
+                 "Remuxing needs the boxes of the file, it cannot be done on a file opened from an index");
+  }
+
+  uint64_t input_size = file.get_input_size();
+
+
+  // --- positions of the top-level boxes and of the boxes in 'meta'
+
+  BoxPosition ftyp{nullptr, 0, 0};
+  BoxPosition meta{nullptr, 0, 0};
+  std::vector<BoxPosition> other_boxes;
+
+  uint64_t position = 0;
+  for (const auto& box : file.get_top_level_boxes()) {
+    BoxPosition box_position{box, position, box->get_box_size()};
+    position += box->get_box_size();
+
+    uint32_t type = box->get_short_type();
+    if (type == fourcc("ftyp") && !ftyp.box) {
+      ftyp = box_position;
+    }
+    else if (box == meta_box) {
+      meta = box_position;
+    }
+    else if (type != fourcc("mdat") && type != fourcc("free") && type != fourcc("skip")) {
+      other_boxes.push_back(box_position);
+    }
+  }
+
+  std::vector<BoxPosition> meta_children;
+
+  position = meta.offset + meta_box->get_header_size();
+  for (const auto& child : meta_box->get_all_child_boxes()) {
+    meta_children.push_back(BoxPosition{child, position, child->get_box_size()});
+    position += child->get_box_size();
+  }
+
+  if (!ftyp.box || !meta.box || position != meta.offset + meta.size || position > input_size) {
+    return Error(heif_error_Unsupported_feature,
+                 heif_suberror_Unspecified,
+                 "Cannot determine the box layout of the file for remuxing");
+  }
+
+
+  // --- collect the item data, each input range is stored once
+
+  std::vector<Box_iloc::Item> items = iloc_box->get_items();
+
+  std::vector<Chunk> chunks;
+  std::map<std::pair<uint64_t, uint64_t>, uint64_t> chunk_positions;
+  uint64_t mdat_data_size = 0;
+
+  std::map<heif_image_id, size_t> item_index;
+  for (size_t i=0;i<items.size();i++) {
+    item_index.insert(std::make_pair(items[i].item_ID, i));
+  }
+
+  std::vector<bool> relocated(items.size(), false);
+
+  for (heif_image_id ID : get_item_order(file, items, decoding_order)) {
+    auto iter = item_index.find(ID);
+    if (iter == item_index.end() || !item_is_relocated(items[iter->second])) {
+      continue;
+    }
+
+    Box_iloc::Item& item = items[iter->second];
+    relocated[iter->second] = true;
+
+    for (auto& extent : item.extents) {
+      uint64_t offset = item.base_offset + extent.offset;
+      if (offset < item.base_offset || offset > input_size) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_End_of_data,
+                     "Extent in iloc box references data outside of file bounds");
+      }
+
+      // a length of zero extends to the end of the file
+      uint64_t length = extent.length;
+      if (length == 0) {
+        length = input_size - offset;
+      }
+      else if (length > input_size - offset) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_End_of_data,
+                     "Extent in iloc box references data outside of file bounds");
+      }
+
+      auto key = std::make_pair(offset, length);
+      auto chunk_iter = chunk_positions.find(key);
+      if (chunk_iter == chunk_positions.end()) {
+        chunk_iter = chunk_positions.insert(std::make_pair(key, mdat_data_size)).first;
+        chunks.push_back(Chunk{offset, length});
+        mdat_data_size += length;
+      }
+
+      // relative to the start of the 'mdat' data for now
+      extent.offset = chunk_iter->second;
+      extent.length = length;
+    }
+
+    item.base_offset = 0;
+  }
+
+
+  // --- build 'iloc'. Its size may depend on the offsets, hence repeat until the layout is stable.
+
+  BoxWriter mdat_header;
+  mdat_header.write_box_header(fourcc("mdat"), mdat_data_size);
+
+  uint64_t other_boxes_size = 0;
+  for (const auto& box : other_boxes) {
+    other_boxes_size += box.size;
+  }
+
+  uint64_t iloc_size = iloc_box->get_box_size();
+  std::vector<Box_iloc::Item> output_items;
+  std::vector<uint8_t> iloc_data;
+  BoxWriter meta_header;
+
+  for (;;) {
+    uint64_t meta_content_size = meta.size - meta_box->get_header_size() - iloc_box->get_box_size() + iloc_size;
+
+    meta_header = BoxWriter();
+    meta_header.write_box_header(fourcc("meta"), meta_content_size + 4);
+    meta_header.write32(((uint32_t)meta_box->get_version() << 24) | meta_box->get_flags());
+
+    uint64_t mdat_data_start = (ftyp.size + meta_header.size() + meta_content_size +
+                                other_boxes_size + mdat_header.size());
+
+    output_items = items;
+    for (size_t i=0;i<output_items.size();i++) {
+      if (relocated[i]) {
+        for (auto& extent : output_items[i].extents) {
+          extent.offset += mdat_data_start;
+        }
+      }
+    }
+
+    iloc_data = write_iloc(*iloc_box, output_items);
+    if (iloc_data.size() == iloc_size) {
+      break;
+    }
+
+    iloc_size = iloc_data.size();
+  }
+
+
+  // --- write to a temporary file first, the output may replace the input
+
+  std::string tmp_filename = std::string(output_filename) + ".tmp";
+
+  FILE* fh = fopen(tmp_filename.c_str(), "wb");
+  if (!fh) {
+    return Error(heif_error_Encoding_error,
+                 heif_suberror_Cannot_write_output_data,
+                 "Cannot create output file");
+  }
+
+  Error err = write_output(file, iloc_box, ftyp, meta, meta_children, other_boxes,
+                           meta_header.get_data(), iloc_data, mdat_header.get_data(),
+                           chunks, fh);
+
+  if (fclose(fh) != 0 && !err) {
+    err = Error(heif_error_Encoding_error,
+                heif_suberror_Cannot_write_output_data,
+                "Cannot write output file");
+  }
+
+  if (!err && rename(tmp_filename.c_str(), output_filename) != 0) {
+    err = Error(heif_error_Encoding_error,
+                heif_suberror_Cannot_write_output_data,
+                "Cannot write output file");
+  }
+
+  if (err) {
+    unlink(tmp_filename.c_str());
+  }
+
+  return err;
+}
@@ -0,0 +1,50 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_REMUX_H
+#define LIBHEIF_HEIF_REMUX_H
+
+#include "error.h"
+#include "heif_file.h"
+
+
+namespace heif {
+
+  // Losslessly rewrite a parsed HEIF file as 'ftyp', 'meta', other top-level boxes and
+  // a single 'mdat' at the end ("fast start"), so that the items can be located and
+  // decoded from a prefix of the file while it is still being downloaded.
+  //
+  // The item data stored in the file itself (construction method 0, data reference 0)
+  // is copied into the new 'mdat' and the 'iloc' box is rewritten to point there.
+  // Everything else in 'meta' is copied unchanged; 'mdat', 'free' and 'skip' boxes
+  // are dropped. Extents shared by several items are stored once.
+  //
+  // With 'decoding_order', the data is arranged in the order needed to show the
+  // primary image: its thumbnails, the image itself (a derived image followed by its
+  // tiles or inputs), its auxiliary images, its metadata, then all remaining items.
+  // Otherwise the items keep their original order.
+  //
+  // The output is written to a temporary file first, so the input file may be replaced.
+  Error write_fast_start_file(const HeifFile& file, const char* output_filename,
+                              bool decoding_order);
+
+}
+
+#endif
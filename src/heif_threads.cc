@@ -0,0 +1,201 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_threads.h"
+
+#include <algorithm>
+#include <utility>
+
+
+using namespace heif;
+
+
+ThreadPool::ThreadPool(int num_threads)
+{
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+
+  for (int i=0; i<num_threads; i++) {
+    m_threads.push_back(std::thread(&ThreadPool::worker_main, this));
+  }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_tasks.clear();
+    m_num_tasks = 0;
+  }
+
+  m_cond.notify_all();
+
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+}
+
+
+ThreadPool& ThreadPool::get_instance()
+{
+  static ThreadPool pool(std::thread::hardware_concurrency());
+  return pool;
+}
+
+
+void ThreadPool::add_task(std::function<void()> task, TaskGroup* group)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_num_tasks == m_tasks.size()) {
+      // full, unroll the ring into a larger buffer
+      std::vector<Task> tasks(std::max<size_t>(16, m_tasks.size() * 2));
+      for (size_t i = 0; i < m_num_tasks; i++) {
+        tasks[i] = std::move(m_tasks[(m_first_task + i) % m_tasks.size()]);
+      }
+
+      m_tasks.swap(tasks);
+      m_first_task = 0;
+    }
+
+    Task& slot = m_tasks[(m_first_task + m_num_tasks) % m_tasks.size()];
+    slot.run = std::move(task);
+    slot.group = group;
+    m_num_tasks++;
+  }
+
+  m_cond.notify_one();
+}
+
+
+ThreadPool::Task ThreadPool::pop_task()
+{
+  Task task = std::move(m_tasks[m_first_task]);
+  m_tasks[m_first_task].run = nullptr;
+
+  m_first_task = (m_first_task + 1) % m_tasks.size();
+  m_num_tasks--;
+
+  return task;
+}
+
+
+void ThreadPool::run_task(Task& task)
+{
+  task.run();
+
+  if (task.group) {
+    task.group->finish_task();
+  }
+}
+
+
+bool ThreadPool::run_pending_task()
+{
+  Task task;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_num_tasks == 0) {
+      return false;
+    }
+
+    task = pop_task();
+  }
+
+  run_task(task);
+
+  return true;
+}
+
+
+void ThreadPool::worker_main()
+{
+  for (;;) {
+    Task task;
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]() { return m_stop || m_num_tasks > 0; });
+
+      if (m_stop) {
+        return;
+      }
+
+      task = pop_task();
+    }
+
+    run_task(task);
+  }
+}
+
+
+
+TaskGroup::~TaskGroup()
+{
+  wait();
+}
+
+
+void TaskGroup::add_task(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_num_pending++;
+  }
+
+  m_pool.add_task(std::move(task), this);
+}
+
+
+void TaskGroup::finish_task()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_num_pending--;
+  if (m_num_pending == 0) {
+    m_cond.notify_all();
+  }
+}
+
+
+void TaskGroup::wait()
+{
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_num_pending == 0) {
+        return;
+      }
+    }
+
+    // Help with queued work. If the queue is empty, all of our
+    // remaining tasks are running in other threads.
+
+    if (!m_pool.run_pending_task()) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]() { return m_num_pending == 0; });
+      return;
+    }
+  }
+}
@@ -0,0 +1,113 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_THREADS_H
+#define LIBHEIF_HEIF_THREADS_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace heif {
+
+  class TaskGroup;
+
+
+  // Fixed-size pool of worker threads running queued tasks in FIFO order.
+  // Queueing a task does not allocate once the queue has grown to its working size,
+  // if the task fits into std::function without allocating (e.g. a lambda capturing
+  // at most two pointers or references).
+  class ThreadPool {
+  public:
+    explicit ThreadPool(int num_threads);
+
+    // Tasks that did not start yet are dropped, running tasks are finished.
+    ~ThreadPool();
+
+    // The library's shared pool, started on first use with one thread per CPU core.
+    static ThreadPool& get_instance();
+
+    int get_num_threads() const { return (int)m_threads.size(); }
+
+    // 'group' (may be null) is notified when the task has finished.
+    void add_task(std::function<void()> task, TaskGroup* group = nullptr);
+
+    // Run one queued task in the calling thread, if there is one.
+    // Returns false if the queue was empty.
+    bool run_pending_task();
+
+  private:
+    struct Task {
+      std::function<void()> run;
+      TaskGroup* group = nullptr;
+    };
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+
+    // ring buffer of queued tasks, grown when full
+    std::vector<Task> m_tasks;
+    size_t m_first_task = 0;
+    size_t m_num_tasks = 0;
+
+    bool m_stop = false;
+
+    void worker_main();
+
+    // Take the next task from the queue, m_mutex is held.
+    Task pop_task();
+
+    static void run_task(Task& task);
+  };
+
+
+  // Tasks on a ThreadPool that are waited for together. While waiting, the calling
+  // thread runs queued tasks itself, so that waiting from a pool thread cannot deadlock.
+  class TaskGroup {
+  public:
+    explicit TaskGroup(ThreadPool& pool) : m_pool(pool) { }
+
+    // waits for all tasks
+    ~TaskGroup();
+
+    void add_task(std::function<void()> task);
+
+    void wait();
+
+  private:
+    friend class ThreadPool;
+
+    ThreadPool& m_pool;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    int m_num_pending = 0;
+
+    void finish_task();
+  };
+
+}
+
+#endif
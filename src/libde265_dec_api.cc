@@ -0,0 +1,306 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libde265_dec_api.h"
+
+#include <limits>
+
+
+de265_error heif_de265_push_nal_units(de265_decoder_context* ctx,
+                                      const uint8_t* data, int data_len,
+                                      int nal_length_size)
+{
+  if (nal_length_size < 1 || nal_length_size > 4) {
+    return DE265_ERROR_CODED_PARAMETER_OUT_OF_RANGE;
+  }
+
+  int ptr = 0;
+
+  while (data_len - ptr >= nal_length_size) {
+    uint32_t nal_size = 0;
+    for (int i=0;i<nal_length_size;i++) {
+      nal_size = (nal_size << 8) | data[ptr++];
+    }
+
+    if (nal_size > static_cast<uint32_t>(data_len - ptr)) {
+      // NAL unit extends past the end of the data
+      return DE265_ERROR_PREMATURE_END_OF_SLICE;
+    }
+
+    de265_error err = de265_push_NAL(ctx, data + ptr, (int)nal_size, 0, nullptr);
+    if (err != DE265_OK) {
+      return err;
+    }
+
+    ptr += nal_size;
+  }
+
+  return DE265_OK;
+}
+
+
+// --- decoder plugin
+
+namespace {
+
+  struct libde265_decoder {
+    de265_decoder_context* ctx = nullptr;
+
+    // only used with custom frame buffers
+    heif_decoder_allocator allocator;
+  };
+
+}
+
+
+static const heif_error kOk = { heif_error_Ok, heif_suberror_Unspecified, "Success" };
+
+
+static heif_error decoder_error(de265_error err)
+{
+  heif_error error = { heif_error_Decoder_plugin_error,
+                       heif_suberror_Unspecified,
+                       de265_get_error_text(err) };
+  return error;
+}
+
+
+// libde265 reads and writes up to this many bytes after the end of a plane
+// (MEMORY_PADDING of its own frame buffer allocation).
+static const size_t kPlanePadding = 64;
+
+
+// Frame buffers from the caller's allocator. Each plane is allocated separately and
+// remembered in the plane's user data, so that it can be released again. The planes
+// are laid out like libde265's default buffers: the stride is given in pixels.
+static int libde265_get_buffer(de265_decoder_context*, struct de265_image_spec* spec,
+                               struct de265_image* img, void* userdata)
+{
+  const heif_decoder_allocator& allocator = static_cast<libde265_decoder*>(userdata)->allocator;
+
+  int num_planes = 3;
+  int shift_x = 1, shift_y = 1;
+
+  switch (spec->format) {
+  case de265_image_format_mono8:    num_planes = 1; break;
+  case de265_image_format_YUV420P8: break;
+  case de265_image_format_YUV422P8: shift_y = 0; break;
+  case de265_image_format_YUV444P8: shift_x = shift_y = 0; break;
+  default:
+    return 0;
+  }
+
+  int alignment = spec->alignment > 0 ? spec->alignment : 1;
+
+  void* planes[3] = { nullptr, nullptr, nullptr };
+
+  for (int c=0;c<num_planes;c++) {
+    int bits_per_pixel = (c==0 ? spec->luma_bits_per_pixel : spec->chroma_bits_per_pixel);
+    int width  = (c==0 ? spec->width  : (spec->width  + (1<<shift_x) - 1) >> shift_x);
+    int height = (c==0 ? spec->height : (spec->height + (1<<shift_y) - 1) >> shift_y);
+
+    int bytes_per_pixel = (bits_per_pixel + 7) / 8;
+    int stride = (width + alignment - 1) / alignment * alignment;
+
+    size_t size = (size_t)stride * bytes_per_pixel * height + kPlanePadding;
+
+    planes[c] = allocator.alloc(allocator.user_data, size, alignment);
+    if (planes[c] == nullptr) {
+      for (int i=0;i<c;i++) {
+        allocator.free(allocator.user_data, planes[i]);
+      }
+
+      return 0;
+    }
+
+    de265_set_image_plane(img, c, planes[c], stride, planes[c]);
+  }
+
+  return 1;
+}
+
+
+static void libde265_release_buffer(de265_decoder_context*, struct de265_image* img, void* userdata)
+{
+  const heif_decoder_allocator& allocator = static_cast<libde265_decoder*>(userdata)->allocator;
+
+  for (int c=0;c<3;c++) {
+    void* plane = de265_get_image_plane_user_data(img, c);
+    if (plane) {
+      allocator.free(allocator.user_data, plane);
+    }
+  }
+}
+
+
+static const char* libde265_plugin_name()
+{
+  return "libde265 HEVC decoder";
+}
+
+
+static int libde265_does_support_format(enum heif_compression_format format)
+{
+  return format == heif_compression_HEVC ? 100 : 0;
+}
+
+
+static heif_error libde265_new_decoder(void** decoder, const heif_decoder_allocator* allocator)
+{
+  libde265_decoder* dec = new libde265_decoder;
+  dec->ctx = de265_new_decoder();
+  de265_start_worker_threads(dec->ctx, 1);
+
+  if (allocator) {
+    static de265_image_allocation allocation = { libde265_get_buffer, libde265_release_buffer };
+
+    dec->allocator = *allocator;
+    de265_set_image_allocation_functions(dec->ctx, &allocation, dec);
+  }
+
+  *decoder = dec;
+  return kOk;
+}
+
+
+static void libde265_free_decoder(void* decoder)
+{
+  libde265_decoder* dec = static_cast<libde265_decoder*>(decoder);
+
+  de265_free_decoder(dec->ctx);
+  delete dec;
+}
+
+
+static heif_error libde265_push_data(void* decoder, const uint8_t* data, size_t size,
+                                     int nal_length_size)
+{
+  libde265_decoder* dec = static_cast<libde265_decoder*>(decoder);
+
+  if (size > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    heif_error error = { heif_error_Memory_allocation_error,
+                         heif_suberror_Security_limit_exceeded,
+                         "Compressed image data too large" };
+    return error;
+  }
+
+  de265_error err = heif_de265_push_nal_units(dec->ctx, data, (int)size, nal_length_size);
+  if (err != DE265_OK) {
+    return decoder_error(err);
+  }
+
+  return kOk;
+}
+
+
+static heif_error libde265_flush_data(void* decoder)
+{
+  libde265_decoder* dec = static_cast<libde265_decoder*>(decoder);
+
+  de265_error err = de265_flush_data(dec->ctx);
+  if (err != DE265_OK) {
+    return decoder_error(err);
+  }
+
+  return kOk;
+}
+
+
+static heif_error libde265_get_next_picture(void* decoder, heif_decoded_picture* out_picture,
+                                            int* out_has_picture)
+{
+  libde265_decoder* dec = static_cast<libde265_decoder*>(decoder);
+
+  *out_has_picture = 0;
+
+  int more = 1;
+  while (more) {
+    more = 0;
+    de265_error err = de265_decode(dec->ctx, &more);
+    if (err != DE265_OK) {
+      return decoder_error(err);
+    }
+
+    const struct de265_image* picture = de265_get_next_picture(dec->ctx);
+
+    // skip warnings
+    while (de265_get_warning(dec->ctx) != DE265_OK) {
+    }
+
+    if (picture == nullptr) {
+      continue;
+    }
+
+    switch (de265_get_chroma_format(picture)) {
+    case de265_chroma_mono: out_picture->chroma = heif_chroma_monochrome; break;
+    case de265_chroma_420:  out_picture->chroma = heif_chroma_420; break;
+    case de265_chroma_422:  out_picture->chroma = heif_chroma_422; break;
+    case de265_chroma_444:  out_picture->chroma = heif_chroma_444; break;
+    default:
+      out_picture->chroma = heif_chroma_undefined;
+    }
+
+    out_picture->width = de265_get_image_width(picture, 0);
+    out_picture->height = de265_get_image_height(picture, 0);
+    out_picture->bits_per_pixel = de265_get_bits_per_pixel(picture, 0);
+
+    int num_planes = (out_picture->chroma == heif_chroma_monochrome ? 1 : 3);
+
+    for (int c=0;c<3;c++) {
+      out_picture->planes[c] = nullptr;
+      out_picture->strides[c] = 0;
+
+      if (c < num_planes) {
+        if (de265_get_bits_per_pixel(picture, c) != out_picture->bits_per_pixel) {
+          heif_error error = { heif_error_Unsupported_feature,
+                               heif_suberror_Unsupported_data_version,
+                               "Different bit depths of luma and chroma are not supported" };
+          return error;
+        }
+
+        out_picture->planes[c] = de265_get_image_plane(picture, c, &out_picture->strides[c]);
+      }
+    }
+
+    *out_has_picture = 1;
+    return kOk;
+  }
+
+  return kOk;
+}
+
+
+static const heif_decoder_plugin decoder_libde265 = {
+  LIBHEIF_DECODER_PLUGIN_API_VERSION,
+  libde265_plugin_name,
+  libde265_does_support_format,
+  libde265_new_decoder,
+  libde265_free_decoder,
+  libde265_push_data,
+  libde265_flush_data,
+  libde265_get_next_picture,
+  nullptr  // set_scaling
+};
+
+
+const heif_decoder_plugin* get_decoder_plugin_libde265()
+{
+  return &decoder_libde265;
+}
@@ -0,0 +1,45 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_LIBDE265_DEC_API_H
+#define LIBHEIF_LIBDE265_DEC_API_H
+
+#include <stdint.h>
+
+#include "libde265/de265.h"
+
+#include "heif_plugin.h"
+
+
+// Feed the length-prefixed NAL units of a HEIF item (as produced by
+// HeifFile::get_compressed_image_data()) to libde265. Each NAL is passed with
+// de265_push_NAL() directly from 'data', so no start codes are needed and the
+// decoder does not have to scan the stream for them.
+//
+// 'nal_length_size' is the size of the NAL length prefix from the 'hvcC' box.
+de265_error heif_de265_push_nal_units(de265_decoder_context* ctx,
+                                      const uint8_t* data, int data_len,
+                                      int nal_length_size);
+
+
+// HEVC decoder plugin using libde265. It is registered by default.
+const struct heif_decoder_plugin* get_decoder_plugin_libde265();
+
+#endif
@@ -0,0 +1,522 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libjpeg_dec_api.h"
+
+#include <algorithm>
+#include <new>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+extern "C" {
+#include "jpeglib.h"
+#include "jerror.h"
+}
+
+
+#if JPEG_LIB_VERSION >= 70
+#define MIN_DCT_V_SCALED_SIZE(cinfo) ((cinfo)->min_DCT_v_scaled_size)
+#define DCT_H_SCALED_SIZE(comp) ((comp)->DCT_h_scaled_size)
+#define DCT_V_SCALED_SIZE(comp) ((comp)->DCT_v_scaled_size)
+#else
+#define MIN_DCT_V_SCALED_SIZE(cinfo) ((cinfo)->min_DCT_scaled_size)
+#define DCT_H_SCALED_SIZE(comp) ((comp)->DCT_scaled_size)
+#define DCT_V_SCALED_SIZE(comp) ((comp)->DCT_scaled_size)
+#endif
+
+// maximum number of sample rows of one component in an iMCU row (4 blocks of 16 rows)
+static const int kMaxRowsPerIMCU = 64;
+
+
+namespace {
+
+  struct libjpeg_decoder {
+    std::vector<uint8_t> data;
+
+    int scale_denominator = 1;
+
+    // the caller's allocator, or malloc() and free()
+    heif_decoder_allocator allocator;
+
+    bool decoded = false;
+    heif_decoded_picture picture;
+    uint8_t* planes[3] = { nullptr, nullptr, nullptr };
+    uint8_t* row = nullptr;
+
+    bool out_of_memory = false;
+    char error_message[JMSG_LENGTH_MAX];
+  };
+
+  struct error_handler {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+    char* message;
+  };
+
+}
+
+
+static const heif_error kOk = { heif_error_Ok, heif_suberror_Unspecified, "Success" };
+
+static const heif_error kOutOfMemory = { heif_error_Memory_allocation_error,
+                                         heif_suberror_Unspecified,
+                                         "Out of memory in the JPEG decoder" };
+
+
+// --- buffers of the decoded picture
+
+static const size_t kPlaneAlignment = 16;
+
+static void* default_alloc(void*, size_t size, size_t)
+{
+  // malloc() returns memory aligned for any type, which covers kPlaneAlignment
+  return malloc(size);
+}
+
+
+static void default_free(void*, void* ptr)
+{
+  free(ptr);
+}
+
+
+static uint8_t* allocate_buffer(libjpeg_decoder* dec, size_t size)
+{
+  return static_cast<uint8_t*>(dec->allocator.alloc(dec->allocator.user_data, size, kPlaneAlignment));
+}
+
+
+static void release_buffers(libjpeg_decoder* dec)
+{
+  for (int c=0;c<3;c++) {
+    if (dec->planes[c]) {
+      dec->allocator.free(dec->allocator.user_data, dec->planes[c]);
+      dec->planes[c] = nullptr;
+    }
+  }
+
+  if (dec->row) {
+    dec->allocator.free(dec->allocator.user_data, dec->row);
+    dec->row = nullptr;
+  }
+}
+
+
+static void on_jpeg_error(j_common_ptr cinfo)
+{
+  error_handler* handler = reinterpret_cast<error_handler*>(cinfo->err);
+
+  (*cinfo->err->format_message)(cinfo, handler->message);
+  longjmp(handler->setjmp_buffer, 1);
+}
+
+
+static void on_jpeg_output_message(j_common_ptr)
+{
+  // do not print warnings about corrupt data to stderr
+}
+
+
+// --- source manager reading from the pushed data
+
+static void init_source(j_decompress_ptr)
+{
+}
+
+
+static boolean fill_input_buffer(j_decompress_ptr cinfo)
+{
+  // Premature end of data. Insert an EOI marker, so that the image is
+  // decoded as far as possible (as libjpeg's own data sources do).
+  static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+
+  cinfo->src->next_input_byte = eoi;
+  cinfo->src->bytes_in_buffer = 2;
+  return TRUE;
+}
+
+
+static void skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+  struct jpeg_source_mgr* src = cinfo->src;
+
+  if (num_bytes <= 0) {
+    return;
+  }
+
+  if (static_cast<size_t>(num_bytes) > src->bytes_in_buffer) {
+    fill_input_buffer(cinfo);
+    return;
+  }
+
+  src->next_input_byte += num_bytes;
+  src->bytes_in_buffer -= num_bytes;
+}
+
+
+static void term_source(j_decompress_ptr)
+{
+}
+
+
+// Chroma format of the component planes as the IDCT outputs them, or heif_chroma_undefined if
+// they have to be upsampled by libjpeg. Must be called after jpeg_calc_output_dimensions().
+// Note that libjpeg scales chroma components less than luma if that avoids upsampling,
+// e.g. 4:2:0 images decoded at half size have 4:4:4 planes.
+static heif_chroma get_raw_chroma(j_decompress_ptr cinfo)
+{
+  if (cinfo->jpeg_color_space == JCS_GRAYSCALE && cinfo->num_components == 1) {
+    return heif_chroma_monochrome;
+  }
+
+  if (cinfo->jpeg_color_space != JCS_YCbCr || cinfo->num_components != 3) {
+    return heif_chroma_undefined;
+  }
+
+  const jpeg_component_info* luma = &cinfo->comp_info[0];
+  int luma_x = luma->h_samp_factor * DCT_H_SCALED_SIZE(luma);
+  int luma_y = luma->v_samp_factor * DCT_V_SCALED_SIZE(luma);
+
+  int ratio_x = 0, ratio_y = 0;
+
+  for (int c=1;c<3;c++) {
+    const jpeg_component_info* chroma = &cinfo->comp_info[c];
+    int chroma_x = chroma->h_samp_factor * DCT_H_SCALED_SIZE(chroma);
+    int chroma_y = chroma->v_samp_factor * DCT_V_SCALED_SIZE(chroma);
+
+    if (luma_x % chroma_x != 0 || luma_y % chroma_y != 0) {
+      return heif_chroma_undefined;
+    }
+
+    if (c==1) {
+      ratio_x = luma_x / chroma_x;
+      ratio_y = luma_y / chroma_y;
+    }
+    else if (ratio_x != luma_x / chroma_x || ratio_y != luma_y / chroma_y) {
+      return heif_chroma_undefined;
+    }
+  }
+
+  if (ratio_x==1 && ratio_y==1) { return heif_chroma_444; }
+  if (ratio_x==2 && ratio_y==1) { return heif_chroma_422; }
+  if (ratio_x==2 && ratio_y==2) { return heif_chroma_420; }
+
+  return heif_chroma_undefined;
+}
+
+
+// Full-range BT.601, as JFIF uses it. 16 bit fixed point.
+static inline void rgb_to_ycbcr(int r, int g, int b, uint8_t* y, uint8_t* cb, uint8_t* cr)
+{
+  const int offset = (128 << 16) + (1 << 15);
+
+  *y  = (uint8_t)((19595 * r + 38470 * g + 7471 * b + (1 << 15)) >> 16);
+  *cb = (uint8_t)std::min((-11059 * r - 21709 * g + 32768 * b + offset) >> 16, 255);
+  *cr = (uint8_t)std::min((32768 * r - 27439 * g - 5329 * b + offset) >> 16, 255);
+}
+
+
+// Planar YCbCr (or grayscale) images are read with jpeg_read_raw_data(), without
+// upsampling and colour conversion. Other images are converted to YCbCr 4:4:4 by libjpeg.
+// The planes come from the decoder's allocator, a failed allocation sets out_of_memory.
+//
+// No C++ objects may live in this function, libjpeg errors return with longjmp().
+static bool decode_jpeg(libjpeg_decoder* dec)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct error_handler jerr;
+  struct jpeg_source_mgr source;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = on_jpeg_error;
+  jerr.pub.output_message = on_jpeg_output_message;
+  jerr.message = dec->error_message;
+
+  if (setjmp(jerr.setjmp_buffer)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+
+  jpeg_create_decompress(&cinfo);
+
+  source.next_input_byte = dec->data.data();
+  source.bytes_in_buffer = dec->data.size();
+  source.init_source = init_source;
+  source.fill_input_buffer = fill_input_buffer;
+  source.skip_input_data = skip_input_data;
+  source.resync_to_restart = jpeg_resync_to_restart;
+  source.term_source = term_source;
+  cinfo.src = &source;
+
+  jpeg_read_header(&cinfo, TRUE);
+
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = dec->scale_denominator;
+  cinfo.raw_data_out = TRUE;
+  jpeg_calc_output_dimensions(&cinfo);
+
+  heif_chroma chroma = get_raw_chroma(&cinfo);
+  if (chroma == heif_chroma_undefined) {
+    // libjpeg does not convert RGB to YCbCr when decoding, this is done below
+    cinfo.raw_data_out = FALSE;
+    cinfo.out_color_space = (cinfo.jpeg_color_space == JCS_RGB ? JCS_RGB : JCS_YCbCr);
+    chroma = heif_chroma_444;
+  }
+
+  jpeg_start_decompress(&cinfo);
+
+  heif_decoded_picture& picture = dec->picture;
+  picture.width = cinfo.output_width;
+  picture.height = cinfo.output_height;
+  picture.chroma = chroma;
+  picture.bits_per_pixel = 8;
+
+  for (int c=0;c<3;c++) {
+    picture.planes[c] = nullptr;
+    picture.strides[c] = 0;
+  }
+
+  if (cinfo.raw_data_out) {
+    // The IDCT writes whole blocks, the planes are padded to full iMCU rows and columns.
+
+    int lines_per_imcu = cinfo.max_v_samp_factor * MIN_DCT_V_SCALED_SIZE(&cinfo);
+    int component_lines[3];
+
+    for (int c=0;c<cinfo.num_components;c++) {
+      const jpeg_component_info* comp = &cinfo.comp_info[c];
+
+      int blocks_x = (comp->width_in_blocks + comp->h_samp_factor - 1) / comp->h_samp_factor * comp->h_samp_factor;
+      component_lines[c] = comp->v_samp_factor * DCT_V_SCALED_SIZE(comp);
+
+      if (component_lines[c] > kMaxRowsPerIMCU) {
+        ERREXIT(&cinfo, JERR_BAD_SAMPLING);
+      }
+
+      picture.strides[c] = blocks_x * DCT_H_SCALED_SIZE(comp);
+      dec->planes[c] = allocate_buffer(dec, (size_t)picture.strides[c] * cinfo.total_iMCU_rows * component_lines[c]);
+      if (!dec->planes[c]) {
+        dec->out_of_memory = true;
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+      }
+
+      picture.planes[c] = dec->planes[c];
+    }
+
+    JSAMPROW rows[3][kMaxRowsPerIMCU];
+    JSAMPARRAY plane_rows[3] = { rows[0], rows[1], rows[2] };
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+      JDIMENSION imcu_row = cinfo.output_scanline / lines_per_imcu;
+
+      for (int c=0;c<cinfo.num_components;c++) {
+        for (int i=0;i<component_lines[c];i++) {
+          rows[c][i] = dec->planes[c] + ((size_t)imcu_row * component_lines[c] + i) * picture.strides[c];
+        }
+      }
+
+      jpeg_read_raw_data(&cinfo, plane_rows, lines_per_imcu);
+    }
+  }
+  else {
+    for (int c=0;c<3;c++) {
+      picture.strides[c] = cinfo.output_width;
+      dec->planes[c] = allocate_buffer(dec, (size_t)cinfo.output_width * cinfo.output_height);
+      if (!dec->planes[c]) {
+        dec->out_of_memory = true;
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+      }
+
+      picture.planes[c] = dec->planes[c];
+    }
+
+    dec->row = allocate_buffer(dec, (size_t)cinfo.output_width * 3);
+    if (!dec->row) {
+      dec->out_of_memory = true;
+      jpeg_destroy_decompress(&cinfo);
+      return false;
+    }
+
+    JSAMPROW row = dec->row;
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+      uint8_t* out[3];
+      for (int c=0;c<3;c++) {
+        out[c] = dec->planes[c] + (size_t)cinfo.output_scanline * cinfo.output_width;
+      }
+
+      jpeg_read_scanlines(&cinfo, &row, 1);
+
+      if (cinfo.out_color_space == JCS_RGB) {
+        for (JDIMENSION x=0;x<cinfo.output_width;x++) {
+          rgb_to_ycbcr(row[3*x + 0], row[3*x + 1], row[3*x + 2], &out[0][x], &out[1][x], &out[2][x]);
+        }
+      }
+      else {
+        for (JDIMENSION x=0;x<cinfo.output_width;x++) {
+          out[0][x] = row[3*x + 0];
+          out[1][x] = row[3*x + 1];
+          out[2][x] = row[3*x + 2];
+        }
+      }
+    }
+  }
+
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+
+  return true;
+}
+
+
+// --- decoder plugin
+
+static const char* libjpeg_plugin_name()
+{
+  return "libjpeg JPEG decoder";
+}
+
+
+static int libjpeg_does_support_format(enum heif_compression_format format)
+{
+  return format == heif_compression_JPEG ? 100 : 0;
+}
+
+
+static heif_error libjpeg_new_decoder(void** decoder, const heif_decoder_allocator* allocator)
+{
+  libjpeg_decoder* dec = new (std::nothrow) libjpeg_decoder;
+  if (!dec) {
+    return kOutOfMemory;
+  }
+
+  if (allocator) {
+    dec->allocator = *allocator;
+  }
+  else {
+    dec->allocator.alloc = default_alloc;
+    dec->allocator.free = default_free;
+    dec->allocator.user_data = nullptr;
+  }
+
+  *decoder = dec;
+  return kOk;
+}
+
+
+static void libjpeg_free_decoder(void* decoder)
+{
+  libjpeg_decoder* dec = static_cast<libjpeg_decoder*>(decoder);
+
+  release_buffers(dec);
+  delete dec;
+}
+
+
+static heif_error libjpeg_set_scaling(void* decoder, int denominator)
+{
+  if (denominator != 1 && denominator != 2 && denominator != 4 && denominator != 8) {
+    heif_error error = { heif_error_Usage_error,
+                         heif_suberror_Unspecified,
+                         "JPEG images can only be scaled by 1/2, 1/4 or 1/8" };
+    return error;
+  }
+
+  static_cast<libjpeg_decoder*>(decoder)->scale_denominator = denominator;
+  return kOk;
+}
+
+
+static heif_error libjpeg_push_data(void* decoder, const uint8_t* data, size_t size,
+                                    int /* nal_length_size */)
+{
+  libjpeg_decoder* dec = static_cast<libjpeg_decoder*>(decoder);
+
+  try {
+    dec->data.insert(dec->data.end(), data, data + size);
+  }
+  catch (const std::bad_alloc&) {
+    return kOutOfMemory;
+  }
+
+  return kOk;
+}
+
+
+static heif_error libjpeg_flush_data(void*)
+{
+  return kOk;
+}
+
+
+static heif_error libjpeg_get_next_picture(void* decoder, heif_decoded_picture* out_picture,
+                                           int* out_has_picture)
+{
+  libjpeg_decoder* dec = static_cast<libjpeg_decoder*>(decoder);
+
+  *out_has_picture = 0;
+
+  // the data of an item is exactly one picture
+  if (dec->decoded) {
+    return kOk;
+  }
+
+  dec->decoded = true;
+
+  if (!decode_jpeg(dec)) {
+    if (dec->out_of_memory) {
+      return kOutOfMemory;
+    }
+
+    heif_error error = { heif_error_Decoder_plugin_error,
+                         heif_suberror_Unspecified,
+                         dec->error_message };
+    return error;
+  }
+
+  *out_picture = dec->picture;
+  *out_has_picture = 1;
+  return kOk;
+}
+
+
+static const heif_decoder_plugin decoder_libjpeg = {
+  LIBHEIF_DECODER_PLUGIN_API_VERSION,
+  libjpeg_plugin_name,
+  libjpeg_does_support_format,
+  libjpeg_new_decoder,
+  libjpeg_free_decoder,
+  libjpeg_push_data,
+  libjpeg_flush_data,
+  libjpeg_get_next_picture,
+  libjpeg_set_scaling
+};
+
+
+const heif_decoder_plugin* get_decoder_plugin_libjpeg()
+{
+  return &decoder_libjpeg;
+}
@@ -0,0 +1,31 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2017 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_LIBJPEG_DEC_API_H
+#define LIBHEIF_LIBJPEG_DEC_API_H
+
+#include "heif_plugin.h"
+
+
+// JPEG decoder plugin using libjpeg. It is registered by default.
+// Images can be decoded at 1/2, 1/4 or 1/8 of their size directly from the DCT coefficients.
+const struct heif_decoder_plugin* get_decoder_plugin_libjpeg();
+
+#endif
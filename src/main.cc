@@ -6,7 +6,6 @@
 #include <string.h>
 #include <unistd.h>
 
-#include "libde265/de265.h"
 #include "jpeglib.h"
 #include "jerror.h"
 
@@ -21,102 +20,6 @@ using namespace std;
 int sdl_refresh_image();
 
 
-int merge_tile_to_heif_image(const struct de265_image* tile_img, int idx_tile, heif_image *heif_img)
-{
-    int row_x, col_y;
-    uint8_t *heif_img_yuv[3] = { 0 };
-    int heif_img_width = 0, heif_img_height = 0;
-
-    int tile_width = 0, tile_height = 0;
-#if 0
-    int bits = 0;
-    int chroma_fmt = 0;
-    int colorspace = 0;
-
-    //
-    bits = heif_img->info.bit_depth;
-    chroma_fmt = heif_img->info.chroma;
-    colorspace = heif_img->info.colorspace;
-#endif
-
-    row_x = idx_tile / heif_img->tile_columns;
-    col_y = idx_tile % heif_img->tile_columns;
-
-    int len = heif_img->width * heif_img->height;
-
-    if(!heif_img->yuv_image) {
-        // default for YUV420
-        heif_img->yuv_len = len * 3 / 2;
-        heif_img->yuv_image = new uint8_t[len * 3 / 2];
-        memset(heif_img->yuv_image, 0, len * 3 / 2);
-    }
-    else if((len * 3 / 2) > heif_img->yuv_len){
-        delete [] heif_img->yuv_image;
-        heif_img->yuv_len = len * 3 / 2;
-        heif_img->yuv_image = new uint8_t[len * 3 / 2];
-        memset(heif_img->yuv_image, 0, len * 3 / 2);
-    }
-
-    heif_img_yuv[0] = heif_img->yuv_image;
-    heif_img_yuv[1] = heif_img_yuv[0] + len;
-    heif_img_yuv[2] = heif_img_yuv[1] + len / 4;
-
-    heif_img_width = heif_img->width;
-    heif_img_height = heif_img->height;
-
-
-    //
-    tile_width = de265_get_image_width(tile_img, 0);   // heif_img->tile_info->width;
-    tile_height = de265_get_image_height(tile_img, 0);   // heif_img->tile_info->height;
-    // printf("merge_tile_to_heif_image() idx_tile = %d\n", idx_tile);
-
-    // ---------------------------------------------------------------------------
-    for (int c = 0; c < 3; c++) {
-
-        int stride;
-        const uint8_t* data = de265_get_image_plane(tile_img, c, &stride);
-
-        int w = de265_get_image_width(tile_img, c);
-        int h = de265_get_image_height(tile_img, c);
-
-        // correct heif_img_width
-        int dst_width = 0, dst_height = 0;
-        if(c == 0) {
-            dst_width = heif_img_width;
-            dst_height = heif_img_height;
-        }
-        else {
-            dst_width = heif_img_width / 2;
-            dst_height = heif_img_height / 2;
-        }
-
-
-        tile_width = w;
-        tile_height = h;
-
-
-        uint8_t *dst_mem = heif_img_yuv[c] + (row_x * tile_height * dst_width) + (col_y * tile_width);
-
-        // correct w and h for right and bottom crop
-        if(col_y + 1 == heif_img->tile_columns) {
-            w = dst_width - col_y * tile_width;
-        }
-
-        if(row_x + 1 == heif_img->tile_rows) {
-            h = dst_height - row_x * tile_height;
-        }
-
-
-        for (int y=0; y<h; y++) {
-            memcpy(dst_mem + y*dst_width, data + y*stride, w);
-        }
-    }
-
-
-    return 0;
-}
-
-
 #if 0
 
 
@@ -189,181 +92,6 @@ void convert_yuv420_to_jpeg(uint8_t *yuv_buf, int width, int height, int quality
 #endif
 
 
-/**
- *  libde265 decode image
- * 
- */
-static int heif_decode_grid_image(heif_image *heif_img)
-{
-    de265_error err =DE265_OK;
-    int frame_index = 0;
-    int more = 1;
-
-    // printf("heif_decode_grid_image(), width = %d, height = %d, data_len = %d\n", heif_img->width, heif_img->height, heif_img->_image.data_len);
-
-    de265_decoder_context *ctx = de265_new_decoder();
-    de265_start_worker_threads(ctx, 1);
-
-
-    // push data to decoder
-    de265_push_data(ctx, heif_img->_image.buf, heif_img->_image.data_len, 0, 0);
-    // de265_push_end_of_frame(ctx);
-    de265_flush_data(ctx);
-
-    // get image
-    while(more) {
-        more = 0;
-        err = de265_decode(ctx, &more);
-        if(err != DE265_OK) {
-            more = 0;
-            break;
-        }
-
-        const struct de265_image *img = de265_get_next_picture(ctx);
-        if(img) {
-            // 
-            // printf("de265 decode %d framse\n", frame_index);
-            merge_tile_to_heif_image(img, frame_index, heif_img);
-
-            sdl_refresh_image();
-            frame_index ++;
-
-            // usleep(100000);
-        }
-
-        // img = 0;
-        // printf("more = %d , img = %p\n", more, img);
-        // show warnings
-
-        for (;;) {
-            de265_error warning = de265_get_warning(ctx);
-            if (warning==DE265_OK) {
-              break;
-            }
-
-            fprintf(stderr,"WARNING: %s\n", de265_get_error_text(warning));
-          }
-    }
-
-
-
-
-    // delete decoder
-    de265_free_decoder(ctx);
-
-    return 0;
-}
-
-static int heif_decode_hvc1_image(heif_image *heif_img)
-{
-    de265_error err =DE265_OK;
-    int frame_index = 0;
-    int more = 1;
-
-    // printf("heif_decode_hvc1_image(), width = %d, height = %d\n", heif_img->width, heif_img->height);
-    de265_decoder_context *ctx = de265_new_decoder();
-    de265_reset(ctx);
-    de265_start_worker_threads(ctx, 1);
-
-
-    // push data to decoder
-    de265_push_data(ctx, heif_img->_image.buf, heif_img->_image.data_len, 0, 0);
-    // de265_push_end_of_frame(ctx);
-    de265_flush_data(ctx);
-
-    // get image
-    while(more) {
-        more = 0;
-        err = de265_decode(ctx, &more);
-        if(err != DE265_OK) {
-            more = 0;
-
-            printf("----------- de265_decode err = %d\n", err);
-            break;
-        }
-
-        const struct de265_image *img = de265_get_next_picture(ctx);
-        if(img) {
-            // printf("de265 decode %d framse, img = %p\n", frame_index, img);
-            // 
-            // merge_tile_to_heif_image(img, frame_index, heif_img);
-            uint8_t *heif_img_yuv[3] = { 0 };
-
-            int width = de265_get_image_width(img, 0);
-            int height = de265_get_image_height(img, 0);
-            int len = width * height;
-
-            if(!heif_img->yuv_image) {
-                // default for YUV420
-                heif_img->yuv_len = len * 3 / 2;
-                heif_img->yuv_image = new uint8_t[len * 3 / 2];
-                memset(heif_img->yuv_image, 0, len * 3 / 2);
-
-                // printf("heif_img->yuv_image = %p, len = %d\n", heif_img->yuv_image, heif_img->yuv_len);
-            }
-            else if((len * 3 / 2) > heif_img->yuv_len){
-                delete [] heif_img->yuv_image;
-                heif_img->yuv_len = len * 3 / 2;
-                heif_img->yuv_image = new uint8_t[len * 3 / 2];
-                memset(heif_img->yuv_image, 0, len * 3 / 2);
-                // printf("heif_img->yuv_image = %p, len = %d\n", heif_img->yuv_image, heif_img->yuv_len);
-            }
-
-            heif_img_yuv[0] = heif_img->yuv_image;
-            heif_img_yuv[1] = heif_img_yuv[0] + len;
-            heif_img_yuv[2] = heif_img_yuv[1] + len / 4;
-            
-            for (int c = 0; c < 3; c++) {
-                int stride;
-                const uint8_t* data = de265_get_image_plane(img, c, &stride);
-
-                int w = de265_get_image_width(img, c);
-                int h = de265_get_image_height(img, c);
-
-                // printf("w = %d, h = %d, stride = %d\n", w, h, stride);
-
-                uint8_t *dst_mem = heif_img_yuv[c];
-                for(int y = 0; y < h; y++) {
-                    memcpy(dst_mem + y*w, data+y*stride, w);
-                }
-
-            }
-
-
-
-
-            sdl_refresh_image();
-            frame_index ++;
-            break;
-            // usleep(100000);
-        }
-
-        // img = 0;
-        // printf("more = %d , img = %p\n", more, img);
-        // show warnings
-
-        for (;;) {
-            de265_error warning = de265_get_warning(ctx);
-            if (warning==DE265_OK) {
-              break;
-            }
-
-            fprintf(stderr,"WARNING: %s\n", de265_get_error_text(warning));
-            break;
-          }
-    }
-
-
-
-
-    // delete decoder
-    de265_free_decoder(ctx);
-
-    return 0;
-}
-
-
-
 // save hevc data to file
 int save_hevc_to_file(const char *file_name, uint8_t *data, int data_len)
 {
@@ -392,12 +120,10 @@ int sdl_refresh_image()
 
 int heif_switch_image(heif_handle h, int index, heif_image *img)
 {
-    heif_get_image_data(h, index, img);
-    if(HEIF_IMAGE_TYPE_GRID == img->image_type) {
-        heif_decode_grid_image(img);
-    }
-    if(HEIF_IMAGE_TYPE_HVC1 == img->image_type) {
-        heif_decode_hvc1_image(img);
+    heif_error err = heif_decode_image(h, index, NULL, img);
+    if(0 != err.code) {
+        std::cerr << "Can not decode HEIF image " << err.message << endl;
+        return -1;
     }
 
     sdl_refresh_image();
@@ -454,34 +180,16 @@ int main(int argc, char **argv)
     index = idx_primary;
     heif_image *image_data = heif_create_image_buffer(h);
     //memset(&image_data, 0x0, sizeof(heif_image));
-    err = heif_get_image_data(h, index, image_data);
+    err = heif_decode_image(h, index, NULL, image_data);
 
     if(0 != err.code) {
-        std::cerr << "Can not get HEIF image data " << err.message << endl;
+        std::cerr << "Can not decode HEIF image " << err.message << endl;
 
+        heif_destory_image_buffer(h, image_data);
+        heif_handle_free(h);
         return 0;
     }
 
-
-#if 1
-    if(HEIF_IMAGE_TYPE_GRID == image_data->image_type) {
-        heif_decode_grid_image(image_data);
-
-        // std::cout << "grid image size " << image_data->_image.data_len << std::endl;
-        // const char *file_name = "grid_image.hevc";
-        // save_hevc_to_file(file_name, image_data->_image.buf, image_data->_image.data_len);
-        
-    }
-    else if(HEIF_IMAGE_TYPE_HVC1 == image_data->image_type) {
-        // const char *file_name = "hvc1_image.hevc";
-        // save_hevc_to_file(file_name, image_data->_image.buf, image_data->_image.data_len);
-        heif_decode_hvc1_image(image_data);
-    }
-
-
-    // cout << "save hevc finsh" << endl;
-#endif
-
     // TODO：
 
 
@@ -570,19 +278,12 @@ int main(int argc, char **argv)
         else if(event.type == SFM_REFRESH_EVENT) {
             // display
             // printf("--- event.type == SFM_REFRESH_EVENT(%d)\n", event.type);
-            if(image_data->yuv_image) {
-                width = image_data->width;
-                int stride = width, chroma_stride = width / 2;
-                const uint8_t* y = image_data->yuv_image;
-                const uint8_t* cb = y + width * height;
-                const uint8_t* cr = cb + width*height / 4;
-
+            if(image_data->planes[0] && image_data->chroma == heif_chroma_420) {
                 // printf("");
-                // printf("y=%p, stride=%d, cb = %p, cr = %p, chroma_stride = %d\n", y, stride, cb, cr, chroma_stride);
-                SDL_UpdateYUVTexture(texture, NULL, 
-                                    y, stride,
-                                    cb, chroma_stride,
-                                    cr, chroma_stride);
+                SDL_UpdateYUVTexture(texture, NULL,
+                                    image_data->planes[0], image_data->strides[0],
+                                    image_data->planes[1], image_data->strides[1],
+                                    image_data->planes[2], image_data->strides[2]);
 
                 // SDL_UpdateTexture(texture, NULL, image_data->yuv_image, width);
 
@@ -1 +1,4 @@
-gcc test_de265.c -g -o test_de265_dec -I /usr/local/include -L /usr/local/lib -lde265
\ No newline at end of file
+gcc test_de265.c -g -o test_de265_dec -I /usr/local/include -L /usr/local/lib -lde265
+g++ -std=gnu++11 -g -pthread -c $(ls ../src/*.cc | grep -v -e main.cc -e heif_faststart.cc) -I /usr/local/include
+gcc test_decode_alloc.c -g -o test_decode_alloc -I ../src *.o -L /usr/local/lib -lde265 -ljpeg -lstdc++ -pthread
+gcc test_derivation_cycle.c -g -o test_derivation_cycle -I ../src *.o -L /usr/local/lib -lde265 -ljpeg -lstdc++ -pthread
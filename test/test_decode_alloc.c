@@ -0,0 +1,294 @@
+/*****************************************************************************
+ * @Description: Check that decoding an image again on a warm handle does not
+ * allocate heap memory. malloc() and friends are interposed and counted while
+ * the images of the input file are decoded repeatedly with a null HEVC decoder
+ * plugin, which does not allocate itself. The time spent in the real decoder
+ * (and its own allocations) is not part of the test.
+ *
+ * Usage: test_decode_alloc input_file [rounds]
+ * Returns 0 if all images decoded without allocations, 1 otherwise.
+*****************************************************************************/
+#include "heif.h"
+#include "heif_plugin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t num, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+static volatile int counting = 0;
+static volatile int allocations = 0;
+
+void* malloc(size_t size)
+{
+    if(counting) allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size)
+{
+    if(counting) allocations++;
+    return __libc_calloc(num, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if(counting) allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    if(counting) allocations++;
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : 12;  // ENOMEM
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+
+// ----------------------------------------------------------------------------
+// null HEVC decoder: returns one (gray) picture of the tile size per coded picture
+
+static int pic_width = 0;
+static int pic_height = 0;
+static uint8_t* pic_data = NULL;
+
+// The alpha image of RGB output is decoded in parallel to the colour image, so each
+// decoder keeps its own state. The instances are taken from a fixed pool, creating a
+// decoder does not allocate.
+#define MAX_DECODERS 16
+
+struct null_decoder_state {
+    int in_use;
+    int pending_pictures;
+};
+
+static struct null_decoder_state decoders[MAX_DECODERS];
+
+static const struct heif_error error_ok = { heif_error_Ok, heif_suberror_Unspecified, "" };
+static const struct heif_error error_no_decoder = { heif_error_Memory_allocation_error,
+                                                    heif_suberror_Unspecified,
+                                                    "too many null decoders" };
+
+static const char* null_get_plugin_name(void)
+{
+    return "null decoder";
+}
+
+static int null_does_support_format(enum heif_compression_format format)
+{
+    return format == heif_compression_HEVC ? 1000 : 0;
+}
+
+static struct heif_error null_new_decoder(void** decoder, const struct heif_decoder_allocator* allocator)
+{
+    int i;
+    (void)allocator;
+
+    for(i = 0; i < MAX_DECODERS; i++) {
+        if(__sync_bool_compare_and_swap(&decoders[i].in_use, 0, 1)) {
+            decoders[i].pending_pictures = 0;
+            *decoder = &decoders[i];
+            return error_ok;
+        }
+    }
+
+    return error_no_decoder;
+}
+
+static void null_free_decoder(void* decoder)
+{
+    struct null_decoder_state* state = (struct null_decoder_state*)decoder;
+    __sync_lock_release(&state->in_use);
+}
+
+static struct heif_error null_push_data(void* decoder, const uint8_t* data, size_t size,
+                                        int nal_length_size)
+{
+    struct null_decoder_state* state = (struct null_decoder_state*)decoder;
+    size_t pos = 0;
+
+    while(pos + nal_length_size <= size) {
+        size_t nal_size = 0;
+        int i;
+        for(i = 0; i < nal_length_size; i++) {
+            nal_size = (nal_size << 8) | data[pos + i];
+        }
+        pos += nal_length_size;
+
+        // count the VCL NAL units
+        if(nal_size > 0 && pos < size && ((data[pos] >> 1) & 0x3f) < 32) {
+            state->pending_pictures++;
+        }
+        pos += nal_size;
+    }
+
+    return error_ok;
+}
+
+static struct heif_error null_flush_data(void* decoder)
+{
+    (void)decoder;
+    return error_ok;
+}
+
+static struct heif_error null_get_next_picture(void* decoder, struct heif_decoded_picture* out_picture,
+                                               int* out_has_picture)
+{
+    struct null_decoder_state* state = (struct null_decoder_state*)decoder;
+
+    if(state->pending_pictures == 0) {
+        *out_has_picture = 0;
+        return error_ok;
+    }
+
+    state->pending_pictures--;
+    *out_has_picture = 1;
+
+    out_picture->width = pic_width;
+    out_picture->height = pic_height;
+    out_picture->chroma = heif_chroma_420;
+    out_picture->bits_per_pixel = 8;
+    out_picture->planes[0] = pic_data;
+    out_picture->planes[1] = pic_data + pic_width * pic_height;
+    out_picture->planes[2] = pic_data + pic_width * pic_height;
+    out_picture->strides[0] = pic_width;
+    out_picture->strides[1] = pic_width / 2;
+    out_picture->strides[2] = pic_width / 2;
+    return error_ok;
+}
+
+static const struct heif_decoder_plugin null_decoder = {
+    2,
+    null_get_plugin_name,
+    null_does_support_format,
+    null_new_decoder,
+    null_free_decoder,
+    null_push_data,
+    null_flush_data,
+    null_get_next_picture,
+    NULL
+};
+
+
+// ----------------------------------------------------------------------------
+
+static int decode_all(heif_handle h, int num_images, const struct heif_decoding_options* options,
+                      heif_image* img)
+{
+    int i;
+    for(i = 0; i < num_images; i++) {
+        struct heif_error err = heif_decode_image(h, i, options, img);
+        if(err.code != heif_error_Ok) {
+            printf("image %d: %s\n", i, err.message);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 3;
+    int failed = 0;
+    int i;
+
+    if(argc < 2) {
+        printf("Usage: test_decode_alloc input_file [rounds]\n");
+        return 1;
+    }
+    if(argc > 2) {
+        rounds = atoi(argv[2]);
+    }
+
+    heif_handle h = heif_hendle_alloc();
+    struct heif_error err = heif_read_from_file(h, argv[1]);
+    if(err.code != heif_error_Ok) {
+        printf("Can not read HEIF file: %s\n", err.message);
+        heif_handle_free(h);
+        return 1;
+    }
+
+    int num_images = heif_get_number_of_images(h);
+    heif_image* img = heif_create_image_buffer(h);
+
+    // the null decoder returns pictures of the coded size (tile size of grid images)
+    err = heif_get_image_data(h, heif_get_primary_image_index(h), img);
+    if(err.code != heif_error_Ok) {
+        printf("Can not get image data: %s\n", err.message);
+        failed = 1;
+        goto done;
+    }
+
+    if(img->image_type == 1) {
+        pic_width = img->tile_width;
+        pic_height = img->tile_height;
+    }
+    else {
+        pic_width = img->width;
+        pic_height = img->height;
+    }
+
+    pic_data = calloc((size_t)pic_width * pic_height * 2, 1);
+    memset(pic_data, 128, (size_t)pic_width * pic_height * 2);
+
+    struct heif_decoding_options* options = heif_decoding_options_alloc();
+    options->decoder_plugin = &null_decoder;
+
+    // YCbCr and RGB output, each into a fresh image and from the image cache
+    for(i = 0; i < 4; i++) {
+        const char* output = (i & 1) ? "rgb" : "ycbcr";
+        const char* mode = (i & 2) ? "cached" : "uncached";
+
+        options->output_chroma = (i & 1) ? heif_chroma_interleaved_32bit : heif_chroma_undefined;
+        options->bypass_image_cache = (i & 2) ? 0 : 1;
+        heif_image_cache_set_budget((i & 2) ? 64 << 20 : 0);
+
+        // warm up: buffers of the handle grow to their final size
+        if(decode_all(h, num_images, options, img) < 0 ||
+           decode_all(h, num_images, options, img) < 0) {
+            printf("%s, %s: can not decode with the null decoder\n", output, mode);
+            failed = 1;
+            continue;
+        }
+
+        int decode_failed = 0;
+        allocations = 0;
+        counting = 1;
+        int r;
+        for(r = 0; r < rounds; r++) {
+            if(decode_all(h, num_images, options, img) < 0) {
+                decode_failed = 1;
+            }
+        }
+        counting = 0;
+
+        printf("%s, %s: %d images x %d rounds, %d allocations%s\n",
+               output, mode, num_images, rounds, allocations,
+               decode_failed ? ", decoding failed" : "");
+
+        if(allocations != 0 || decode_failed) {
+            failed = 1;
+        }
+    }
+
+    heif_image_cache_set_budget(0);
+    heif_decoding_options_free(options);
+    free(pic_data);
+
+done:
+    heif_destory_image_buffer(h, img);
+    heif_handle_free(h);
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}
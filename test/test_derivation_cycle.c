@@ -0,0 +1,244 @@
+/*****************************************************************************
+ * @Description: Check that derived images referencing each other in a cycle
+ * are rejected instead of recursing until the stack overflows. The files are
+ * built in memory: an overlay ('iovl', primary item) whose single layer is a
+ * second derived image, which references the overlay again. The second image
+ * is an overlay or an identity image ('iden').
+ *
+ * Usage: test_derivation_cycle
+ * Returns 0 if all decodes fail with heif_error_Invalid_input, 1 otherwise.
+*****************************************************************************/
+#include "heif.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static uint8_t file_data[1024];
+static size_t file_size;
+
+
+// ----------------------------------------------------------------------------
+// box writer: boxes are written in place, their size is patched when closed
+
+static void put8(int v)
+{
+    file_data[file_size++] = (uint8_t)v;
+}
+
+static void put16(int v)
+{
+    put8(v >> 8);
+    put8(v);
+}
+
+static void put32(uint32_t v)
+{
+    put16((int)(v >> 16));
+    put16((int)(v & 0xFFFF));
+}
+
+static void put_fourcc(const char* type)
+{
+    memcpy(file_data + file_size, type, 4);
+    file_size += 4;
+}
+
+static size_t open_box(const char* type)
+{
+    size_t start = file_size;
+    put32(0);
+    put_fourcc(type);
+    return start;
+}
+
+static size_t open_full_box(const char* type, int version, int flags)
+{
+    size_t start = open_box(type);
+    put32(((uint32_t)version << 24) | (uint32_t)flags);
+    return start;
+}
+
+static void close_box(size_t start)
+{
+    size_t size = file_size - start;
+    file_data[start + 0] = (uint8_t)(size >> 24);
+    file_data[start + 1] = (uint8_t)(size >> 16);
+    file_data[start + 2] = (uint8_t)(size >> 8);
+    file_data[start + 3] = (uint8_t)size;
+}
+
+static void put_infe(int item_ID, const char* type)
+{
+    size_t infe = open_full_box("infe", 2, 0);
+    put16(item_ID);
+    put16(0);
+    put_fourcc(type);
+    put8(0);
+    close_box(infe);
+}
+
+static void put_dimg(int from_ID, int to_ID)
+{
+    size_t dimg = open_box("dimg");
+    put16(from_ID);
+    put16(1);
+    put16(to_ID);
+    close_box(dimg);
+}
+
+// overlay description: one layer at (0,0) on a 64x64 canvas
+static const int overlay_data_size = 18;
+
+static void put_overlay_data(void)
+{
+    put8(0);
+    put8(0);
+    put16(0);
+    put16(0);
+    put16(0);
+    put16(0xFFFF);
+    put16(64);
+    put16(64);
+    put16(0);
+    put16(0);
+}
+
+
+// Item 1 'iovl' -> item 2 'second_type' -> item 1
+static void build_cyclic_file(const char* second_type)
+{
+    int second_is_overlay = (strcmp(second_type, "iovl") == 0);
+    int num_data_items = second_is_overlay ? 2 : 1;
+    int i;
+
+    file_size = 0;
+
+    size_t ftyp = open_box("ftyp");
+    put_fourcc("heic");
+    put32(0);
+    put_fourcc("mif1");
+    put_fourcc("heic");
+    close_box(ftyp);
+
+    size_t meta = open_full_box("meta", 0, 0);
+
+    size_t hdlr = open_full_box("hdlr", 0, 0);
+    put32(0);
+    put_fourcc("pict");
+    put32(0);
+    put32(0);
+    put32(0);
+    put8(0);
+    close_box(hdlr);
+
+    size_t pitm = open_full_box("pitm", 0, 0);
+    put16(1);
+    close_box(pitm);
+
+    // overlay descriptions in 'idat' (construction method 1)
+    size_t iloc = open_full_box("iloc", 1, 0);
+    put8(0x44);
+    put8(0x00);
+    put16(num_data_items);
+    for(i = 0; i < num_data_items; i++) {
+        put16(i + 1);
+        put16(1);
+        put16(0);
+        put16(1);
+        put32((uint32_t)(i * overlay_data_size));
+        put32((uint32_t)overlay_data_size);
+    }
+    close_box(iloc);
+
+    size_t iinf = open_full_box("iinf", 0, 0);
+    put16(2);
+    put_infe(1, "iovl");
+    put_infe(2, second_type);
+    close_box(iinf);
+
+    size_t iref = open_full_box("iref", 0, 0);
+    put_dimg(1, 2);
+    put_dimg(2, 1);
+    close_box(iref);
+
+    size_t iprp = open_box("iprp");
+    size_t ipco = open_box("ipco");
+    size_t ispe = open_full_box("ispe", 0, 0);
+    put32(64);
+    put32(64);
+    close_box(ispe);
+    close_box(ipco);
+
+    size_t ipma = open_full_box("ipma", 0, 0);
+    put32(2);
+    for(i = 1; i <= 2; i++) {
+        put16(i);
+        put8(1);
+        put8(1);
+    }
+    close_box(ipma);
+    close_box(iprp);
+
+    size_t idat = open_box("idat");
+    for(i = 0; i < num_data_items; i++) {
+        put_overlay_data();
+    }
+    close_box(idat);
+
+    close_box(meta);
+}
+
+
+// ----------------------------------------------------------------------------
+
+static int check_cycle(const char* second_type)
+{
+    int failed = 0;
+    int i, rgb;
+
+    build_cyclic_file(second_type);
+
+    heif_handle h = heif_hendle_alloc();
+    struct heif_error err = heif_read_from_memory(h, file_data, file_size);
+    if(err.code != heif_error_Ok) {
+        printf("iovl -> %s: can not read file: %s\n", second_type, err.message);
+        heif_handle_free(h);
+        return 1;
+    }
+
+    struct heif_decoding_options* options = heif_decoding_options_alloc();
+    options->bypass_image_cache = 1;
+
+    for(i = 0; i < heif_get_number_of_images(h); i++) {
+        for(rgb = 0; rgb < 2; rgb++) {
+            options->output_chroma = rgb ? heif_chroma_interleaved_32bit : heif_chroma_undefined;
+
+            heif_image* img = heif_create_image_buffer(h);
+            err = heif_decode_image(h, i, options, img);
+            heif_destory_image_buffer(h, img);
+
+            printf("iovl -> %s, image %d, %s: %s\n", second_type, i,
+                   rgb ? "rgb" : "ycbcr", err.message);
+
+            // other invalid input errors would mean that the test file is broken
+            if(err.code != heif_error_Invalid_input || err.subcode != heif_suberror_Unspecified) {
+                failed = 1;
+            }
+        }
+    }
+
+    heif_decoding_options_free(options);
+    heif_handle_free(h);
+    return failed;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    failed |= check_cycle("iovl");
+    failed |= check_cycle("iden");
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}